@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "injector.h"
+
+// Keys pressed together, in press order
+using KeyChord = std::vector<uint16_t>;
+
+// Which virtual keys are held down, indexed by key code
+using KeyState = std::bitset<256>;
+
+enum class ChordAction {
+    Click,        // Press in order, release in reverse
+    DoubleClick,  // Two clicks 10 ms apart
+    Press,        // Only press, keys stay held
+    Release,      // Only release, in reverse order
+};
+
+// A key argument with '+' or ',' is a chord sequence rather than a single key name
+inline bool isChordSyntax(const std::string& key) {
+    return key.find_first_of("+,") != std::string::npos;
+}
+
+/**
+ * @brief Parse a chord sequence such as "ctrl+shift+key_s" or "ctrl+k,ctrl+c"
+ *
+ * Chords are separated by ',' and keys within a chord by '+'. Keys are key_ names,
+ * with the prefix optional ("ctrl" is key_ctrl) and case ignored.
+ *
+ * @param lookup Returns the key code of a key_ name, or -1 if there is none
+ * @return false with error set if a key is empty, unknown or repeated within a chord
+ */
+inline bool parseChordSequence(const std::string& text, const std::function<int(const std::string&)>& lookup,
+                               std::vector<KeyChord>& chords, std::string& error) {
+    chords.clear();
+    KeyChord chord;
+    size_t start = 0;
+
+    for (size_t i = 0; i <= text.size(); i++) {
+        if (i < text.size() && text[i] != '+' && text[i] != ',') continue;
+
+        std::string name = text.substr(start, i - start);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (name.empty()) {
+            error = "Empty key in chord '" + text + "'.";
+            return false;
+        }
+
+        int code = lookup(name.rfind("key_", 0) == 0 ? name : "key_" + name);
+        if (code < 0 || code >= static_cast<int>(KeyState().size())) {
+            error = "Unknown key '" + name + "' in chord '" + text + "'.";
+            return false;
+        }
+        if (std::find(chord.begin(), chord.end(), static_cast<uint16_t>(code)) != chord.end()) {
+            error = "Key '" + name + "' repeated in chord '" + text + "'.";
+            return false;
+        }
+        chord.push_back(static_cast<uint16_t>(code));
+
+        if (i == text.size() || text[i] == ',') {
+            chords.push_back(std::move(chord));
+            chord.clear();
+        }
+        start = i + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Compile a chord sequence into key events
+ *
+ * Events are stamped from deadline onwards, gap apart. Keys already held in state
+ * (e.g. by an earlier keydown) are not pressed again and are not released by a click,
+ * so the held state is preserved. A click on a chord whose keys are all held has nothing
+ * left to press, so it releases them in reverse and presses them again. On return, state is what it will be once the events
+ * have been injected and deadline is the deadline of the last event.
+ */
+inline void compileChords(const std::vector<KeyChord>& chords, ChordAction action, std::chrono::milliseconds gap,
+                          KeyState& state, InjectClock::time_point& deadline, std::vector<InputEvent>& events) {
+    bool first = true;
+    auto emit = [&](InputEventType type, uint16_t code) {
+        if (!first) deadline += gap;
+        first = false;
+
+        InputEvent event;
+        event.deadline = deadline;
+        event.type = type;
+        event.code = code;
+        events.push_back(event);
+        state[code] = (type == InputEventType::KeyDown);
+    };
+
+    auto click = [&] {
+        KeyChord pressed;
+        for (const KeyChord& chord : chords) {
+            pressed.clear();
+            for (uint16_t code : chord) {
+                if (state[code]) continue;
+                emit(InputEventType::KeyDown, code);
+                pressed.push_back(code);
+            }
+            for (auto it = pressed.rbegin(); it != pressed.rend(); ++it) {
+                emit(InputEventType::KeyUp, *it);
+            }
+            if (pressed.empty()) {
+                for (auto it = chord.rbegin(); it != chord.rend(); ++it) {
+                    emit(InputEventType::KeyUp, *it);
+                }
+                for (uint16_t code : chord) {
+                    emit(InputEventType::KeyDown, code);
+                }
+            }
+        }
+    };
+
+    switch (action) {
+        case ChordAction::Click:
+            click();
+            break;
+        case ChordAction::DoubleClick:
+            click();
+            deadline += std::chrono::milliseconds(10);
+            first = true;
+            click();
+            break;
+        case ChordAction::Press:
+            for (const KeyChord& chord : chords) {
+                for (uint16_t code : chord) {
+                    if (!state[code]) emit(InputEventType::KeyDown, code);
+                }
+            }
+            break;
+        case ChordAction::Release:
+            for (auto chord = chords.rbegin(); chord != chords.rend(); ++chord) {
+                for (auto it = chord->rbegin(); it != chord->rend(); ++it) {
+                    emit(InputEventType::KeyUp, *it);
+                }
+            }
+            break;
+    }
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "injector.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief One command of the shared-memory ring
+ *
+ * A primitive event with the executor's own opcodes (InputEventType, EventFlags), fixed
+ * size and free of pointers, so any process on the host can write it. The deadline is on
+ * the steady clock, which all processes of a host share.
+ */
+struct RingCommand {
+    int64_t deadlineNs = 0;  // Steady clock time to inject at, in ns since its epoch (0: as soon as possible)
+    int32_t x = 0;
+    int32_t y = 0;
+    uint16_t code = 0;       // Button, key code, contact or MarkerKind, as in InputEvent
+    uint8_t type = 0;        // InputEventType
+    uint8_t flags = 0;       // EventFlags; pushGroup sets EVENT_FLAG_GROUPED itself
+    uint32_t reserved = 0;
+};
+static_assert(sizeof(RingCommand) == 24, "RingCommand is part of the shared-memory layout");
+
+constexpr uint32_t kCommandRingMagic = 0x494e5352;  // Written once the ring is ready
+constexpr uint32_t kCommandRingVersion = 1;
+constexpr uint32_t kCommandRingCapacity = 4096;
+
+/**
+ * @brief Layout of the shared-memory region
+ *
+ * The cells form the same bounded multi-producer ring as EventRing: each carries a
+ * sequence number saying whose turn it is. Positions are 64-bit, so they never wrap.
+ * The consumer's read position is private to the server.
+ */
+struct CommandRingShared {
+    std::atomic<uint32_t> magic;  // kCommandRingMagic once the server has initialised everything else
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t commandSize;
+    alignas(64) std::atomic<uint64_t> head;      // Next position a producer claims
+    alignas(64) std::atomic<uint32_t> sleeping;  // Futex word: 1 while the server waits for the empty ring to fill
+    std::atomic<uint32_t> closing;               // Set by a client to stop the server once the ring is drained
+    std::atomic<uint64_t> wakeups;               // Wakeups producers had to issue
+
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        RingCommand command;
+    };
+    alignas(64) Cell cells[kCommandRingCapacity];
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "Atomics in shared memory must not need a lock");
+
+// Maps the region and its wakeup primitive: a futex on the sleeping word on Linux, a named event on Windows
+class CommandRingMapping {
+public:
+    CommandRingMapping() = default;
+    CommandRingMapping(const CommandRingMapping&) = delete;
+    CommandRingMapping& operator=(const CommandRingMapping&) = delete;
+
+protected:
+    bool map(const std::string& name, bool create) {
+#ifdef _WIN32
+        std::string object = "Local\\" + name;
+        if (create) {
+            mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(CommandRingShared), object.c_str());
+            if (mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+                CloseHandle(mapping);
+                mapping = NULL;
+            }
+            event = CreateEventA(NULL, FALSE, FALSE, (object + "_wake").c_str());
+        }
+        else {
+            mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, object.c_str());
+            event = OpenEventA(EVENT_MODIFY_STATE, FALSE, (object + "_wake").c_str());
+        }
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(CommandRingShared)) : nullptr;
+        if (!view || !event) {
+            unmap();
+            return false;
+        }
+#else
+        path = "/" + name;
+        int fd = create ? shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600) : shm_open(path.c_str(), O_RDWR, 0);
+        if (fd < 0) return false;
+        if (create && ftruncate(fd, sizeof(CommandRingShared)) != 0) {
+            ::close(fd);
+            shm_unlink(path.c_str());
+            return false;
+        }
+        // A region the server has not sized yet would fault on first access
+        struct stat info;
+        if (!create && (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(CommandRingShared)))) {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(nullptr, sizeof(CommandRingShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED) {
+            if (create) shm_unlink(path.c_str());
+            return false;
+        }
+#endif
+        shared = static_cast<CommandRingShared*>(view);
+        return true;
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        if (shared) UnmapViewOfFile(shared);
+        if (mapping) CloseHandle(mapping);
+        if (event) CloseHandle(event);
+        mapping = NULL;
+        event = NULL;
+#else
+        if (shared) munmap(shared, sizeof(CommandRingShared));
+#endif
+        shared = nullptr;
+    }
+
+    void wake() {
+        shared->wakeups.fetch_add(1, std::memory_order_relaxed);
+#ifdef _WIN32
+        SetEvent(event);
+#else
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&shared->sleeping), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#endif
+    }
+
+    // Block while the sleeping word is 1, until woken or the timeout passes
+    void sleep(std::chrono::milliseconds timeout) {
+#ifdef _WIN32
+        WaitForSingleObject(event, static_cast<DWORD>(timeout.count()));
+#else
+        timespec relative = {static_cast<time_t>(timeout.count() / 1000), static_cast<long>(timeout.count() % 1000) * 1000000};
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&shared->sleeping), FUTEX_WAIT, 1, &relative, nullptr, 0);
+#endif
+    }
+
+    static constexpr uint64_t kMask = kCommandRingCapacity - 1;
+
+    CommandRingShared* shared = nullptr;
+#ifdef _WIN32
+    HANDLE mapping = NULL;
+    HANDLE event = NULL;
+#else
+    std::string path;
+#endif
+};
+
+/**
+ * @brief Producer side, for clients on the same host
+ *
+ * Any number of threads and processes may push at once; pushing never takes a lock or
+ * makes a system call, except for the one push that finds the server asleep on the empty
+ * ring. A group claims consecutive cells in one step, so it is never interleaved with
+ * other producers' commands and reaches the backend in one call.
+ *
+ * A producer that dies between claiming cells and filling them stalls the ring, as
+ * with any sequence-numbered ring.
+ */
+class CommandRingClient : public CommandRingMapping {
+public:
+    ~CommandRingClient() { close(); }
+
+    // False if no server has created a ring by that name, or it is from another version
+    bool open(const std::string& name) {
+        if (!map(name, false)) return false;
+        if (shared->magic.load(std::memory_order_acquire) != kCommandRingMagic || shared->version != kCommandRingVersion ||
+            shared->capacity != kCommandRingCapacity || shared->commandSize != sizeof(RingCommand)) {
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    void close() { unmap(); }
+
+    // Returns false if the ring has no room
+    bool tryPush(const RingCommand& command) { return tryPushGroup(&command, 1); }
+
+    // Push commands that share a deadline into consecutive cells; false if the ring has no room for all of them
+    bool tryPushGroup(const RingCommand* commands, size_t count) {
+        if (count == 0 || count > kCommandRingCapacity) return false;
+
+        // Cells are freed in order, so when the group's last cell is free, all of them are
+        uint64_t pos = shared->head.load(std::memory_order_relaxed);
+        for (;;) {
+            uint64_t last = pos + count - 1;
+            uint64_t seq = shared->cells[last & kMask].sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(last);
+            if (diff == 0) {
+                if (shared->head.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = shared->head.load(std::memory_order_relaxed);
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            CommandRingShared::Cell& cell = shared->cells[(pos + i) & kMask];
+            cell.command = commands[i];
+            if (i + 1 < count) cell.command.flags |= EVENT_FLAG_GROUPED;
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+
+        // Pairs with the fence in CommandRingServer::wait: either the server sees these cells, or this sees it asleep
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (shared->sleeping.load(std::memory_order_relaxed) != 0 && shared->sleeping.exchange(0, std::memory_order_relaxed) != 0) {
+            wake();
+        }
+        return true;
+    }
+
+    // Push, yielding while the ring is full
+    void push(const RingCommand& command) {
+        while (!tryPush(command)) std::this_thread::yield();
+    }
+
+    void pushGroup(const RingCommand* commands, size_t count) {
+        while (!tryPushGroup(commands, count)) std::this_thread::yield();
+    }
+
+    // Ask the server to inject what is queued and then exit
+    void requestStop() {
+        shared->closing.store(1, std::memory_order_release);
+        shared->sleeping.store(0, std::memory_order_relaxed);
+        wake();
+    }
+};
+
+/**
+ * @brief Consumer side, run by the simulator with --shm
+ *
+ * The server creates the region, so a client can never open a half-initialised ring.
+ * It pops commands in ring order and sleeps on the futex or event only when the ring is
+ * empty, with a timeout so it notices a stop request even if a wakeup is lost. It polls
+ * for kSpin first, so producers streaming commands rarely find it asleep.
+ */
+class CommandRingServer : public CommandRingMapping {
+public:
+    ~CommandRingServer() { close(); }
+
+    // False if the region cannot be created, e.g. because another server uses the name
+    bool create(const std::string& name) {
+        if (!map(name, true)) return false;
+        new (shared) CommandRingShared;
+        shared->version = kCommandRingVersion;
+        shared->capacity = kCommandRingCapacity;
+        shared->commandSize = sizeof(RingCommand);
+        shared->head.store(0, std::memory_order_relaxed);
+        shared->sleeping.store(0, std::memory_order_relaxed);
+        shared->closing.store(0, std::memory_order_relaxed);
+        shared->wakeups.store(0, std::memory_order_relaxed);
+        for (uint64_t i = 0; i < kCommandRingCapacity; i++) {
+            shared->cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        tail = 0;
+        shared->magic.store(kCommandRingMagic, std::memory_order_release);
+        return true;
+    }
+
+    // Unmap the region and remove its name
+    void close() {
+        if (!shared) return;
+        unlinkName();
+        unmap();
+    }
+
+    // Remove the name so no new client finds the ring, leaving the mapping in place.
+    // Safe while another thread is still serving, e.g. from a signal thread before exiting.
+    void unlinkName() {
+#ifndef _WIN32
+        if (!path.empty()) shm_unlink(path.c_str());
+        path.clear();
+#endif
+    }
+
+    // Returns false if the ring is empty or its next command is not filled in yet
+    bool tryPop(RingCommand& command) {
+        if (!filled()) return false;
+        CommandRingShared::Cell& cell = shared->cells[tail & kMask];
+        command = cell.command;
+        cell.sequence.store(tail + kCommandRingCapacity, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+    static constexpr auto kSpin = std::chrono::microseconds(50);
+
+    // Sleep until a producer pushes, a client asks to stop, or the timeout passes
+    void wait(std::chrono::milliseconds timeout) {
+        auto spinEnd = std::chrono::steady_clock::now() + kSpin;
+        while (!filled() && !stopRequested()) {
+            if (std::chrono::steady_clock::now() >= spinEnd) break;
+            std::this_thread::yield();
+        }
+
+        shared->sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!filled() && !stopRequested()) sleep(timeout);
+        shared->sleeping.store(0, std::memory_order_relaxed);
+    }
+
+    // Whether the next command is there to pop
+    bool filled() const {
+        uint64_t seq = shared->cells[tail & kMask].sequence.load(std::memory_order_acquire);
+        return static_cast<int64_t>(seq) - static_cast<int64_t>(tail + 1) >= 0;
+    }
+
+    bool stopRequested() const { return shared->closing.load(std::memory_order_acquire) != 0; }
+
+    uint64_t wakeups() const { return shared->wakeups.load(std::memory_order_relaxed); }
+
+private:
+    uint64_t tail = 0;  // Next position to pop
+};
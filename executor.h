@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "injector.h"
+
+/**
+ * @brief Features an executor specialization is compiled with
+ *
+ * The executor's command handlers are templates over a mask of these bits, and every
+ * check of a feature is an `if constexpr`, so a disabled feature leaves no branch in the
+ * per-event path. The run-wide features are fixed once a run starts and pick the handler
+ * once; back mode is a per-command option, so it picks the mouse handler per command.
+ */
+enum ExecutorFeature : unsigned {
+    EXECUTOR_LOGGING = 1 << 0,     // Print each step (-v)
+    EXECUTOR_CONSISTENT = 1 << 1,  // Track the cursor instead of reading it back (-c)
+    EXECUTOR_TRACING = 1 << 2,     // Account each command to its source line (--profile)
+    EXECUTOR_BACK_MODE = 1 << 3,   // Move the cursor back after the command (-m back)
+};
+
+// Features chosen once per run; a specialization table has one entry per combination
+constexpr unsigned kExecutorRunFeatures = EXECUTOR_LOGGING | EXECUTOR_CONSISTENT | EXECUTOR_TRACING;
+
+// Easing curve of smooth moves, scrolls and touch gestures, resolved from -sm once per command
+enum class EasingMode : uint8_t {
+    Linear,
+    Ease,  // Cubic ease-in-out
+};
+
+// Unknown modes fall back to linear, as "none" does when a gesture has to move anyway
+inline EasingMode parseEasing(const std::string& mode) {
+    return (mode == "ease") ? EasingMode::Ease : EasingMode::Linear;
+}
+
+template <EasingMode Mode>
+constexpr double ease(double t) {
+    if constexpr (Mode == EasingMode::Ease) {
+        // Stronger ease-in-out using cubic easing: t^3 for in, 1-(1-t)^3 for out
+        if (t < 0.5) return 4 * t * t * t;
+        double f = t - 1;
+        return 1 + 4 * f * f * f;
+    }
+    else {
+        return t;
+    }
+}
+
+// For callers that ease only a handful of frames per command
+constexpr double ease(double t, EasingMode mode) {
+    return (mode == EasingMode::Ease) ? ease<EasingMode::Ease>(t) : ease<EasingMode::Linear>(t);
+}
+
+// Frame interval of a smooth move or scroll: 120 Hz, or 60 Hz for moves longer than 500 ms
+inline std::chrono::milliseconds smoothFrameTime(int duration) {
+    int targetFPS = (duration > 500) ? 60 : 120;
+    return std::chrono::milliseconds(1000 / targetFPS);
+}
+
+/**
+ * @brief Generate the frames of a smooth move
+ *
+ * Calls frame(x, y, offset, flags) for each frame from the start position towards the
+ * target, offset from the start of the move, then once more exactly at the target after
+ * duration. Every frame after the first is flagged EVENT_FLAG_FRAME.
+ */
+template <EasingMode Mode, typename Frame>
+void smoothMoveFrames(int startX, int startY, int targetX, int targetY, int duration, Frame&& frame) {
+    auto frameTime = smoothFrameTime(duration);
+    auto totalTime = std::chrono::milliseconds(duration);
+    for (auto elapsed = std::chrono::milliseconds(0); elapsed < totalTime; elapsed += frameTime) {
+        double easedT = ease<Mode>(static_cast<double>(elapsed.count()) / duration);
+        int x = startX + static_cast<int>((targetX - startX) * easedT);
+        int y = startY + static_cast<int>((targetY - startY) * easedT);
+        frame(x, y, elapsed, (elapsed.count() > 0) ? EVENT_FLAG_FRAME : 0);
+    }
+    frame(targetX, targetY, totalTime, EVENT_FLAG_FRAME);
+}
+
+// Handler<Features>::run for every mask up to kExecutorRunFeatures, indexed by the mask
+template <template <unsigned> typename Handler, size_t... Features>
+constexpr auto executorSpecializations(std::index_sequence<Features...>) {
+    return std::array{&Handler<static_cast<unsigned>(Features)>::run...};
+}
+
+template <template <unsigned> typename Handler>
+constexpr auto executorSpecializations() {
+    return executorSpecializations<Handler>(std::make_index_sequence<kExecutorRunFeatures + 1>());
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Waits for a file to be saved
+ *
+ * The file's directory is watched rather than the file itself, since many editors save
+ * by writing a new file and renaming it over the old one. Notifications may be spurious
+ * (on Windows any change in the directory wakes the watcher), so callers compare the
+ * contents before acting on them.
+ */
+class FileWatcher {
+public:
+    ~FileWatcher() { close(); }
+
+    bool open(const std::string& path) {
+        std::error_code error;
+        std::filesystem::path file = std::filesystem::absolute(path, error);
+        if (error) return false;
+        name = file.filename().string();
+
+#ifdef _WIN32
+        handle = FindFirstChangeNotificationW(file.parent_path().wstring().c_str(), FALSE,
+                                              FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+        return handle != INVALID_HANDLE_VALUE;
+#else
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) return false;
+        if (inotify_add_watch(fd, file.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            close();
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) FindCloseChangeNotification(handle);
+        handle = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+    }
+
+    // Wait up to timeout for the file to be written; true if it may have been
+    bool wait(std::chrono::milliseconds timeout) {
+#ifdef _WIN32
+        if (WaitForSingleObject(handle, static_cast<DWORD>(timeout.count())) != WAIT_OBJECT_0) return false;
+        FindNextChangeNotification(handle);
+        return true;
+#else
+        pollfd request = {fd, POLLIN, 0};
+        if (poll(&request, 1, static_cast<int>(timeout.count())) <= 0) return false;
+
+        // Drain every queued notification; only those naming the file count
+        bool written = false;
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+            for (char* position = buffer; position < buffer + length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(position);
+                if (event->len > 0 && name == event->name) written = true;
+                position += sizeof(inotify_event) + event->len;
+            }
+        }
+        return written;
+#endif
+    }
+
+private:
+    std::string name;
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+};
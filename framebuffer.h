@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FRAMEBUFFER_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX2 intrinsics anywhere; GCC and Clang need the function to opt in
+#if defined(FRAMEBUFFER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FRAMEBUFFER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FRAMEBUFFER_TARGET_AVX2
+#endif
+
+// Screen rectangle in physical pixels
+struct PixelRect {
+    int x = 0;
+    int y = 0;
+    int width = 1;
+    int height = 1;
+};
+
+// Captured pixels, row-major and tightly packed, each 0x00RRGGBB (BGRA byte order in memory)
+struct Frame {
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> pixels;
+};
+
+// Anything that can hand out the current contents of a screen rectangle
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    // Capture only the given rectangle into out. Returns false if it could not be captured.
+    virtual bool capture(const PixelRect& region, Frame& out) = 0;
+
+    // Everything that can be captured (empty if unavailable)
+    virtual PixelRect bounds() = 0;
+};
+
+/**
+ * @brief Load a binary (P6) or ASCII (P3) PPM image with 8-bit channels
+ * @return false if the file is missing or malformed
+ */
+inline bool loadPpm(const std::string& path, Frame& frame) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+
+    auto readToken = [&in](std::string& token) {
+        token.clear();
+        char c;
+        while (in.get(c)) {
+            if (c == '#') {
+                std::string comment;
+                std::getline(in, comment);
+            }
+            else if (!std::isspace(static_cast<unsigned char>(c))) {
+                token += c;
+                break;
+            }
+        }
+        while (in.get(c) && !std::isspace(static_cast<unsigned char>(c))) token += c;
+        return !token.empty();
+    };
+
+    std::string magic, width, height, maxValue;
+    if (!readToken(magic) || (magic != "P6" && magic != "P3")) return false;
+    if (!readToken(width) || !readToken(height) || !readToken(maxValue)) return false;
+
+    try {
+        frame.width = std::stoi(width);
+        frame.height = std::stoi(height);
+        if (frame.width <= 0 || frame.height <= 0 || std::stoi(maxValue) != 255) return false;
+    } catch (...) {
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(frame.width) * frame.height;
+    frame.pixels.resize(count);
+
+    if (magic == "P6") {
+        std::vector<unsigned char> rgb(count * 3);
+        if (!in.read(reinterpret_cast<char*>(rgb.data()), static_cast<std::streamsize>(rgb.size()))) return false;
+        for (size_t i = 0; i < count; i++) {
+            frame.pixels[i] = (uint32_t(rgb[i * 3]) << 16) | (uint32_t(rgb[i * 3 + 1]) << 8) | rgb[i * 3 + 2];
+        }
+    }
+    else {
+        for (size_t i = 0; i < count; i++) {
+            int r, g, b;
+            if (!(in >> r >> g >> b)) return false;
+            frame.pixels[i] = (uint32_t(r & 0xFF) << 16) | (uint32_t(g & 0xFF) << 8) | uint32_t(b & 0xFF);
+        }
+    }
+    return true;
+}
+
+// Save a frame as a binary PPM
+inline bool savePpm(const std::string& path, const Frame& frame) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) return false;
+    out << "P6\n" << frame.width << " " << frame.height << "\n255\n";
+    std::vector<char> rgb(frame.pixels.size() * 3);
+    for (size_t i = 0; i < frame.pixels.size(); i++) {
+        rgb[i * 3] = static_cast<char>(frame.pixels[i] >> 16);
+        rgb[i * 3 + 1] = static_cast<char>(frame.pixels[i] >> 8);
+        rgb[i * 3 + 2] = static_cast<char>(frame.pixels[i]);
+    }
+    out.write(rgb.data(), static_cast<std::streamsize>(rgb.size()));
+    return static_cast<bool>(out);
+}
+
+// Copy a rectangle out of a full frame, clipped to its bounds
+inline bool cropFrame(const Frame& source, const PixelRect& region, Frame& out) {
+    if (region.x < 0 || region.y < 0 || region.width <= 0 || region.height <= 0 ||
+        region.x + region.width > source.width || region.y + region.height > source.height) {
+        return false;
+    }
+
+    out.width = region.width;
+    out.height = region.height;
+    out.pixels.resize(static_cast<size_t>(region.width) * region.height);
+    for (int row = 0; row < region.height; row++) {
+        const uint32_t* src = source.pixels.data() + static_cast<size_t>(region.y + row) * source.width + region.x;
+        std::copy(src, src + region.width, out.pixels.data() + static_cast<size_t>(row) * region.width);
+    }
+    return true;
+}
+
+/**
+ * @brief Frame source backed by a PPM file, reloaded whenever the file changes
+ *
+ * Lets the comparison kernels and polling loops run without a screen: a test
+ * replaces the file to simulate the UI changing.
+ */
+class PpmFrameSource : public FrameSource {
+public:
+    explicit PpmFrameSource(std::string path) : path(std::move(path)) {}
+
+    bool capture(const PixelRect& region, Frame& out) override {
+        std::error_code error;
+        auto modified = std::filesystem::last_write_time(path, error);
+        if (error) return false;
+
+        if (!loaded || modified != loadedTime) {
+            Frame fresh;
+            if (!loadPpm(path, fresh)) return false;  // Possibly mid-write; keep polling
+            image = std::move(fresh);
+            loadedTime = modified;
+            loaded = true;
+        }
+        return cropFrame(image, region, out);
+    }
+
+    PixelRect bounds() override {
+        Frame probe;
+        if (!capture(PixelRect{0, 0, 1, 1}, probe)) return PixelRect{0, 0, 0, 0};
+        return PixelRect{0, 0, image.width, image.height};
+    }
+
+private:
+    std::string path;
+    Frame image;
+    std::filesystem::file_time_type loadedTime;
+    bool loaded = false;
+};
+
+// Instruction set used by the comparison kernels
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+// Best instruction set the CPU supports, detected once
+inline SimdLevel bestSimdLevel() {
+#ifdef FRAMEBUFFER_X86
+    static const SimdLevel level = [] {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool ymmEnabled = osxsave && (_xgetbv(0) & 0x6) == 0x6;
+        return (avx2 && ymmEnabled) ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#endif
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// Per-pixel test: does any of R, G, B differ by more than the tolerance?
+inline bool pixelDiffers(uint32_t a, uint32_t b, uint8_t tolerance) {
+    for (int shift = 0; shift < 24; shift += 8) {
+        int ca = (a >> shift) & 0xFF;
+        int cb = (b >> shift) & 0xFF;
+        if (std::abs(ca - cb) > tolerance) return true;
+    }
+    return false;
+}
+
+// Kernels count differing pixels between a and b. With Broadcast, b points to a single color.
+template <bool Broadcast>
+size_t countDifferentPixelsScalar(const uint32_t* a, const uint32_t* b, size_t count, uint8_t tolerance) {
+    size_t different = 0;
+    for (size_t i = 0; i < count; i++) {
+        different += pixelDiffers(a[i], Broadcast ? b[0] : b[i], tolerance);
+    }
+    return different;
+}
+
+#ifdef FRAMEBUFFER_X86
+template <bool Broadcast>
+size_t countDifferentPixelsSse2(const uint32_t* a, const uint32_t* b, size_t count, uint8_t tolerance) {
+    const __m128i tol = _mm_set1_epi8(static_cast<char>(tolerance));
+    const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color = _mm_set1_epi32(static_cast<int>(b[0]));
+
+    size_t different = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = Broadcast ? color : _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        // Saturating subtraction both ways gives the per-channel absolute difference
+        __m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        __m128i over = _mm_and_si128(_mm_subs_epu8(diff, tol), rgbMask);
+        int same = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(over, zero)));
+        different += 4 - std::popcount(static_cast<unsigned>(same));
+    }
+    return different + countDifferentPixelsScalar<Broadcast>(a + i, Broadcast ? b : b + i, count - i, tolerance);
+}
+
+template <bool Broadcast>
+FRAMEBUFFER_TARGET_AVX2 size_t countDifferentPixelsAvx2(const uint32_t* a, const uint32_t* b, size_t count, uint8_t tolerance) {
+    const __m256i tol = _mm256_set1_epi8(static_cast<char>(tolerance));
+    const __m256i rgbMask = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i color = _mm256_set1_epi32(static_cast<int>(b[0]));
+
+    size_t different = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = Broadcast ? color : _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i diff = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+        __m256i over = _mm256_and_si256(_mm256_subs_epu8(diff, tol), rgbMask);
+        int same = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(over, zero)));
+        different += 8 - std::popcount(static_cast<unsigned>(same));
+    }
+    return different + countDifferentPixelsScalar<Broadcast>(a + i, Broadcast ? b : b + i, count - i, tolerance);
+}
+#endif
+
+template <bool Broadcast>
+size_t countDifferentPixelsDispatch(const uint32_t* a, const uint32_t* b, size_t count, uint8_t tolerance, SimdLevel level) {
+#ifdef FRAMEBUFFER_X86
+    if (level == SimdLevel::AVX2 && bestSimdLevel() == SimdLevel::AVX2) {
+        return countDifferentPixelsAvx2<Broadcast>(a, b, count, tolerance);
+    }
+    if (level != SimdLevel::Scalar) {
+        return countDifferentPixelsSse2<Broadcast>(a, b, count, tolerance);
+    }
+#endif
+    return countDifferentPixelsScalar<Broadcast>(a, b, count, tolerance);
+}
+
+// Number of pixels in a and b whose R, G or B channel differs by more than the tolerance
+inline size_t countDifferentPixels(const uint32_t* a, const uint32_t* b, size_t count, uint8_t tolerance,
+                                   SimdLevel level = bestSimdLevel()) {
+    return countDifferentPixelsDispatch<false>(a, b, count, tolerance, level);
+}
+
+// Number of pixels whose R, G or B channel differs from the color by more than the tolerance
+inline size_t countPixelsNotMatching(const uint32_t* pixels, size_t count, uint32_t color, uint8_t tolerance,
+                                     SimdLevel level = bestSimdLevel()) {
+    return countDifferentPixelsDispatch<true>(pixels, &color, count, tolerance, level);
+}
+
+constexpr auto kPixelPollInterval = std::chrono::milliseconds(1);
+
+// Outcome of a screen wait
+enum class WaitResult {
+    Satisfied,
+    TimedOut,
+    CaptureFailed  // The region could never be captured, e.g. it lies off screen
+};
+
+/**
+ * @brief Poll until every pixel in the region is within tolerance of the color
+ * @return Satisfied if the color appeared, TimedOut if it did not, CaptureFailed if no capture succeeded
+ */
+inline WaitResult waitForColor(FrameSource& source, const PixelRect& region, uint32_t color, uint8_t tolerance,
+                               std::chrono::milliseconds timeout, std::chrono::microseconds interval = kPixelPollInterval) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    Frame frame;
+    bool captured = false;
+    for (;;) {
+        if (source.capture(region, frame)) {
+            captured = true;
+            if (countPixelsNotMatching(frame.pixels.data(), frame.pixels.size(), color, tolerance) == 0) return WaitResult::Satisfied;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) return captured ? WaitResult::TimedOut : WaitResult::CaptureFailed;
+        std::this_thread::sleep_for(interval);
+    }
+}
+
+/**
+ * @brief Capture the region once, then poll until any pixel moves beyond the tolerance
+ * @return Satisfied if the region changed, TimedOut if it did not, CaptureFailed if the first capture failed
+ */
+inline WaitResult waitForRegionChange(FrameSource& source, const PixelRect& region, uint8_t tolerance,
+                                      std::chrono::milliseconds timeout, std::chrono::microseconds interval = kPixelPollInterval) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    Frame baseline, frame;
+    if (!source.capture(region, baseline)) return WaitResult::CaptureFailed;
+
+    for (;;) {
+        std::this_thread::sleep_for(interval);
+        if (source.capture(region, frame) && frame.pixels.size() == baseline.pixels.size() &&
+            countDifferentPixels(baseline.pixels.data(), frame.pixels.data(), frame.pixels.size(), tolerance) > 0) {
+            return WaitResult::Satisfied;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) return WaitResult::TimedOut;
+    }
+}
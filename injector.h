@@ -0,0 +1,520 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "stats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using InjectClock = std::chrono::steady_clock;
+
+// Kind of primitive event handed to a backend
+enum class InputEventType : uint8_t {
+    MouseMove,  // Absolute cursor position (x, y)
+    MouseDown,  // Button press, code = MouseButton
+    MouseUp,    // Button release, code = MouseButton
+    Wheel,      // Wheel delta, y = vertical, x = horizontal
+    KeyDown,    // Key press, code = virtual key code
+    KeyUp,      // Key release, code = virtual key code
+    TouchDown,  // Contact code touches the screen at (x, y)
+    TouchMove,  // Contact code moves to (x, y)
+    TouchUp,    // Contact code lifts off
+    Marker,     // Timing marker handled by the injector itself, code = MarkerKind
+};
+
+enum MarkerKind : uint16_t {
+    MARKER_COMMAND_BEGIN = 0,  // x = 1-based command file line of the command, 0 if it has none
+    MARKER_COMMAND_END = 1,
+};
+
+enum EventFlags : uint8_t {
+    EVENT_FLAG_FRAME = 1 << 0,  // Continues a smooth movement; the previous event was its preceding frame
+    EVENT_FLAG_GROUPED = 1 << 1,  // The next event has the same deadline and must reach the backend in the same call
+};
+
+enum MouseButton : uint16_t {
+    MOUSE_BUTTON_LEFT = 0,
+    MOUSE_BUTTON_RIGHT = 1,
+    MOUSE_BUTTON_MIDDLE = 2,
+};
+
+// Fully resolved input event, stamped with the time it must be injected at
+struct InputEvent {
+    InjectClock::time_point deadline;
+    InputEventType type = InputEventType::MouseMove;
+    uint8_t flags = 0;
+    uint16_t code = 0;
+    int x = 0;
+    int y = 0;
+};
+
+// Platform specific sink for input events
+class InputBackend {
+public:
+    virtual ~InputBackend() = default;
+
+    // Inject the events in order. Only ever called from the injection thread.
+    virtual void submit(const InputEvent* events, size_t count) = 0;
+
+    // Current pointer position, for backends that own their connection to the screen
+    virtual bool queryPointer(int& /*x*/, int& /*y*/) { return false; }
+
+    // Size of the screen input lands on, for backends that know it
+    virtual bool screenSize(int& /*width*/, int& /*height*/) { return false; }
+
+    // Release keys and buttons still held down and drop all later events. Called from any thread when aborting.
+    virtual void releaseHeldInput() {}
+};
+
+// Told about every injected event of a command that came from a command file line, for --profile
+class InjectionObserver {
+public:
+    virtual ~InjectionObserver() = default;
+
+    // Called on the injection thread; lateness is the submission time minus the event's deadline
+    virtual void injected(uint32_t line, InjectClock::duration lateness) = 0;
+};
+
+// Decides when the injector may inject each command, e.g. to keep other processes' input out of it
+class InjectionArbiter {
+public:
+    virtual ~InjectionArbiter() = default;
+
+    // Called on the injection thread before a command's first event; may block
+    virtual void commandBegin() = 0;
+
+    // Called on the injection thread after a command's last event has been handed to the backend
+    virtual void commandEnd() = 0;
+};
+
+/**
+ * @brief Bounded lock-free multi-producer / single-consumer ring
+ *
+ * Every cell carries a sequence number telling producers and the consumer
+ * whose turn it is, so neither side ever takes a lock (Vyukov's bounded queue).
+ */
+template <typename T, size_t Capacity>
+class EventRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    EventRing() {
+        for (size_t i = 0; i < Capacity; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the ring is full
+    bool tryPush(const T& value) {
+        Cell* cell;
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & (Capacity - 1)];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the ring is empty. Must only be called by the consumer.
+    bool tryPop(T& value) {
+        Cell& cell = cells[tail & (Capacity - 1)];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(tail + 1) < 0) return false;
+        value = cell.value;
+        cell.sequence.store(tail + Capacity, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    alignas(64) Cell cells[Capacity];
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) size_t tail = 0;
+};
+
+// Counters reported by the injection thread
+struct InjectorStats {
+    uint64_t events = 0;          // Events submitted to the backend
+    uint64_t batches = 0;         // Backend submit calls
+    uint64_t deadlineMisses = 0;  // Events submitted later than the miss tolerance
+    double maxLatenessMs = 0;     // Worst lateness of any event
+    size_t depthHighWater = 0;    // Most events in flight at once
+};
+
+// Timing histograms filled by the injection thread
+struct InjectorTiming {
+    LatencyHistogram sleepRequested;  // How long the thread asked to wait for a deadline
+    LatencyHistogram sleepActual;     // How long that wait really took
+    LatencyHistogram lateness;        // Submission time minus deadline, per event
+    LatencyHistogram frameInterval;   // Time between consecutive smooth movement frames
+    LatencyHistogram submitCall;      // Duration of each backend submit call
+    LatencyHistogram commandWall;     // First deadline of a command until its last event was injected
+
+    void merge(const InjectorTiming& other) {
+        sleepRequested.merge(other.sleepRequested);
+        sleepActual.merge(other.sleepActual);
+        lateness.merge(other.lateness);
+        frameInterval.merge(other.frameInterval);
+        submitCall.merge(other.submitCall);
+        commandWall.merge(other.commandWall);
+    }
+};
+
+// Sleep until the deadline, spinning for the last stretch to beat timer granularity
+inline void sleepUntilPrecise(InjectClock::time_point deadline) {
+    constexpr auto spinMargin = std::chrono::milliseconds(1);
+
+    auto remaining = deadline - InjectClock::now();
+    if (remaining > spinMargin) {
+#ifdef _WIN32
+        // The default Windows timer only ticks every ~15.6 ms, so prefer a high resolution waitable timer
+        thread_local HANDLE timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (timer) {
+            LARGE_INTEGER due;
+            due.QuadPart = -std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - spinMargin).count() / 100;
+            if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+                WaitForSingleObject(timer, INFINITE);
+            }
+        }
+        else {
+            std::this_thread::sleep_until(deadline - std::chrono::milliseconds(16));
+        }
+#else
+        std::this_thread::sleep_until(deadline - spinMargin);
+#endif
+    }
+
+    while (InjectClock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
+
+// Raise the calling thread's priority and pin it to a core of its own: injection thread slot of
+// slots gets the slot-th core from the last it may run on. With fewer cores than slots, several
+// spinning threads would share one, so the thread is left to the scheduler instead.
+inline void configureInjectionThread(size_t slot = 0, size_t slots = 1) {
+    // On a single core a pinned, high priority spinning thread would only starve the producers
+    if (std::thread::hardware_concurrency() < 2) return;
+
+#ifdef _WIN32
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) || processMask == 0) return;
+    std::vector<DWORD_PTR> cores;  // Highest first
+    for (int bit = static_cast<int>(sizeof(DWORD_PTR) * 8) - 1; bit >= 0; bit--) {
+        if (processMask & (static_cast<DWORD_PTR>(1) << bit)) cores.push_back(static_cast<DWORD_PTR>(1) << bit);
+    }
+    if (cores.size() < 2 || slots > cores.size()) return;
+
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+    SetThreadAffinityMask(GetCurrentThread(), cores[slot]);
+#else
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    std::vector<int> cores;  // Highest first
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--) {
+        if (CPU_ISSET(cpu, &allowed)) cores.push_back(cpu);
+    }
+    if (cores.size() < 2 || slots > cores.size()) return;
+
+    // Real-time scheduling needs privileges; fall back silently to the default policy
+    sched_param param{};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    cpu_set_t pinned;
+    CPU_ZERO(&pinned);
+    CPU_SET(cores[slot], &pinned);
+    pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+#endif
+}
+
+/**
+ * @brief Dedicated injection thread fed by a lock-free event ring
+ *
+ * Producers push deadline-stamped events from any thread. The injection thread
+ * sleeps until the oldest event is due, then hands every event that is due to the
+ * backend in one batch. Events are injected in push order and never early.
+ * Marker events only feed the timing histograms and never reach the backend.
+ */
+class Injector {
+public:
+    static constexpr size_t kCapacity = 4096;
+    static constexpr size_t kMaxBatch = 64;
+    static constexpr auto kMissTolerance = std::chrono::milliseconds(1);
+    static constexpr auto kDiscardSlice = std::chrono::milliseconds(10);
+
+    explicit Injector(InputBackend& backend) : backend(&backend) {}
+    ~Injector() { stop(); }
+
+    Injector(const Injector&) = delete;
+    Injector& operator=(const Injector&) = delete;
+
+    void start() {
+        if (worker.joinable()) return;
+        stopping.store(false, std::memory_order_relaxed);
+        worker = std::thread([this] { run(); });
+    }
+
+    // Send events to another backend from now on. Only before start().
+    void setBackend(InputBackend& sink) { backend = &sink; }
+
+    // Report injected events to an observer, keyed by their command's line. Only before start().
+    void setObserver(InjectionObserver* sink) { observer = sink; }
+
+    // Ask an arbiter before injecting each command and tell it when the command is done. Only before start().
+    void setArbiter(InjectionArbiter* gate) { arbiter = gate; }
+
+    // Run as injection thread slot of slots, each pinned to a core of its own. Only before start().
+    void setThreadSlot(size_t slot, size_t slots) {
+        threadSlot = slot;
+        threadSlots = slots;
+    }
+
+    // Drain every queued event, then stop the injection thread
+    void stop() {
+        if (!worker.joinable()) return;
+        stopping.store(true, std::memory_order_release);
+        wakeups.fetch_add(1, std::memory_order_release);
+        wakeups.notify_one();
+        worker.join();
+    }
+
+    // Enqueue an event, blocking while the ring is full
+    void push(const InputEvent& event) {
+        while (!ring.tryPush(event)) {
+            std::this_thread::yield();
+        }
+
+        uint64_t pushed = enqueued.fetch_add(1, std::memory_order_acq_rel) + 1;
+        size_t depth = static_cast<size_t>(pushed - submitted.load(std::memory_order_relaxed));
+        size_t highWater = depthHighWater.load(std::memory_order_relaxed);
+        while (depth > highWater && !depthHighWater.compare_exchange_weak(highWater, depth, std::memory_order_relaxed)) {
+        }
+
+        wakeups.fetch_add(1, std::memory_order_release);
+        wakeups.notify_one();
+    }
+
+    // Enqueue events so that each run sharing a deadline is handed to the backend in one call
+    void pushGroup(std::vector<InputEvent>& events) {
+        for (size_t i = 0; i + 1 < events.size(); i++) {
+            if (events[i + 1].deadline == events[i].deadline) events[i].flags |= EVENT_FLAG_GROUPED;
+        }
+        for (const InputEvent& event : events) {
+            push(event);
+        }
+    }
+
+    // Drop every event pushed so far that has not been handed to the backend yet. Long waits for a
+    // deadline are slept in kDiscardSlice steps, so a discarded event stops being waited for soon.
+    void discard() {
+        discardBefore.store(enqueued.load(std::memory_order_acquire), std::memory_order_release);
+        wakeups.fetch_add(1, std::memory_order_release);
+        wakeups.notify_one();
+    }
+
+    // Block until every event pushed so far has been handed to the backend (or discarded)
+    void sync() {
+        uint64_t target = enqueued.load(std::memory_order_acquire);
+        uint64_t done = submitted.load(std::memory_order_acquire);
+        while (done < target) {
+            submitted.wait(done, std::memory_order_acquire);
+            done = submitted.load(std::memory_order_acquire);
+        }
+    }
+
+    // Hand every queued event to the backend right away, whatever its deadline; markers are dropped.
+    // Only while the injection thread is not running: benchmarks use it to time the producer alone.
+    void drainNow() {
+        InputEvent event;
+        std::vector<InputEvent> batch;
+        uint64_t drained = 0;
+        while (ring.tryPop(event)) {
+            drained++;
+            if (event.type != InputEventType::Marker) batch.push_back(event);
+            if (batch.size() == kMaxBatch) {
+                backend->submit(batch.data(), batch.size());
+                batch.clear();
+            }
+        }
+        if (!batch.empty()) backend->submit(batch.data(), batch.size());
+        submitted.fetch_add(drained, std::memory_order_release);
+    }
+
+    // Histograms can be read from any thread at any time
+    const InjectorTiming& timings() const { return timing; }
+
+    // Only meaningful once stop() has returned
+    InjectorStats stats() const {
+        InjectorStats result = counters;
+        result.depthHighWater = depthHighWater.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    void run() {
+        configureInjectionThread(threadSlot, threadSlots);
+
+        std::vector<InputEvent> batch;
+        batch.reserve(kMaxBatch);
+        InputEvent next;
+        bool haveNext = false;
+        uint64_t popped = 0;  // Events taken from the ring, next included
+
+        auto pop = [&] {
+            if (!ring.tryPop(next)) return false;
+            popped++;
+            return true;
+        };
+        auto discarded = [&] { return popped <= discardBefore.load(std::memory_order_acquire); };
+
+        for (;;) {
+            if (!haveNext) {
+                uint32_t seen = wakeups.load(std::memory_order_acquire);
+                bool finish = stopping.load(std::memory_order_acquire);
+                if (!pop()) {
+                    if (finish) break;
+                    wakeups.wait(seen, std::memory_order_acquire);
+                    continue;
+                }
+                haveNext = true;
+            }
+
+            auto sleepStart = InjectClock::now();
+            if (next.deadline > sleepStart) {
+                while (next.deadline - InjectClock::now() > 3 * kDiscardSlice && !discarded()) {
+                    std::this_thread::sleep_for(kDiscardSlice);
+                }
+                if (!discarded()) sleepUntilPrecise(next.deadline);
+                timing.sleepRequested.record(next.deadline - sleepStart);
+                timing.sleepActual.record(InjectClock::now() - sleepStart);
+            }
+
+            if (discarded()) {
+                haveNext = false;
+                submitted.fetch_add(1, std::memory_order_release);
+                submitted.notify_all();
+                continue;
+            }
+
+            // Gather every event that is already due into one batch. A group is never split,
+            // even past kMaxBatch, and its remaining events are waited for if not pushed yet.
+            auto now = InjectClock::now();
+            size_t processed = 0;
+            bool commandEnded = false;
+            batch.clear();
+            auto submitBatch = [&] {
+                if (batch.empty()) return;
+                auto submitStart = InjectClock::now();
+                backend->submit(batch.data(), batch.size());
+                timing.submitCall.record(InjectClock::now() - submitStart);
+                counters.batches++;
+                counters.events += batch.size();
+                batch.clear();
+            };
+            do {
+                // An abort may discard events while the batch is gathered; they are dropped at the top of the loop
+                if (discarded()) break;
+                bool grouped = (next.flags & EVENT_FLAG_GROUPED) != 0;
+                processed++;
+                if (next.type == InputEventType::Marker) {
+                    // The arbiter sees command boundaries exactly, so the events gathered so far go out first
+                    if (arbiter) {
+                        submitBatch();
+                        if (next.code == MARKER_COMMAND_BEGIN) arbiter->commandBegin();
+                        if (next.code == MARKER_COMMAND_END) arbiter->commandEnd();
+                        now = InjectClock::now();
+                    }
+                    if (next.code == MARKER_COMMAND_BEGIN) {
+                        commandStart = next.deadline;
+                        commandLine = static_cast<uint32_t>(next.x);
+                    }
+                    if (next.code == MARKER_COMMAND_END) {
+                        commandEnded = true;
+                        commandLine = 0;
+                    }
+                }
+                else {
+                    recordLateness(now - next.deadline);
+                    if (observer && commandLine > 0) observer->injected(commandLine, now - next.deadline);
+                    if (next.flags & EVENT_FLAG_FRAME) timing.frameInterval.record(now - lastInjected);
+                    lastInjected = now;
+                    batch.push_back(next);
+                }
+                if (grouped) {
+                    while (!pop()) std::this_thread::yield();
+                    haveNext = true;
+                }
+                else {
+                    haveNext = batch.size() < kMaxBatch && pop();
+                }
+            } while (haveNext && next.deadline <= now);
+
+            submitBatch();
+            if (commandEnded) {
+                timing.commandWall.record(InjectClock::now() - commandStart);
+            }
+
+            submitted.fetch_add(processed, std::memory_order_release);
+            submitted.notify_all();
+        }
+    }
+
+    void recordLateness(InjectClock::duration lateness) {
+        timing.lateness.record(lateness);
+        double lateMs = std::chrono::duration<double, std::milli>(lateness).count();
+        counters.maxLatenessMs = std::max(counters.maxLatenessMs, lateMs);
+        if (lateness > kMissTolerance) counters.deadlineMisses++;
+    }
+
+    InputBackend* backend;
+    InjectionObserver* observer = nullptr;
+    InjectionArbiter* arbiter = nullptr;
+    size_t threadSlot = 0;
+    size_t threadSlots = 1;
+    EventRing<InputEvent, kCapacity> ring;
+    std::thread worker;
+
+    std::atomic<bool> stopping{false};
+    std::atomic<uint32_t> wakeups{0};
+    std::atomic<uint64_t> enqueued{0};
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> discardBefore{0};  // Events up to this push count are dropped
+    std::atomic<size_t> depthHighWater{0};
+
+    // Written by the injection thread only
+    InjectorStats counters;
+    InjectorTiming timing;
+    InjectClock::time_point commandStart;
+    InjectClock::time_point lastInjected;
+    uint32_t commandLine = 0;  // Line of the command whose events are being injected, 0 if none
+};
@@ -0,0 +1,365 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "injector.h"
+#include "stats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+constexpr uint32_t kInputLockVersion = 2;
+constexpr uint32_t kInputLockSlots = 4096;  // Processes that can hold or wait for one lock at once
+
+/**
+ * @brief Layout of a shared-memory input lock
+ *
+ * A ticket lock: a process draws the next ticket and injects once serving reaches it, so
+ * the lock is granted in arrival order. Each ticket's slot records the process that drew
+ * it and when that process started, so waiters can tell a crashed holder from a slow one,
+ * even once the system has given its pid to a new process. The zero-filled region a new
+ * mapping gets is already a free lock, so whichever process maps it first needs no setup.
+ */
+struct InputLockShared {
+    std::atomic<uint32_t> version;             // 0 until the first process has mapped the region
+    alignas(64) std::atomic<uint32_t> next;    // Next ticket to draw
+    alignas(64) std::atomic<uint32_t> serving; // Ticket allowed to inject; futex word of the waiters
+    std::atomic<uint32_t> waiting;             // Processes asleep on serving
+
+    // Counters of every process using the lock, since the region was created
+    alignas(64) std::atomic<uint64_t> acquisitions;
+    std::atomic<uint64_t> contended;   // Acquisitions that found the lock taken
+    std::atomic<uint64_t> recoveries;  // Tickets skipped because the process holding them died
+    std::atomic<uint64_t> waitNs;      // Time spent waiting for the lock, added up
+    std::atomic<uint64_t> maxWaitNs;   // Longest single wait
+
+    alignas(64) std::atomic<uint32_t> owners[kInputLockSlots];  // Process id per ticket (slot ticket % kInputLockSlots), 0 if unknown
+    std::atomic<uint64_t> ownerStarts[kInputLockSlots];          // Start time of that process, 0 if unknown
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "Atomics in shared memory must not need a lock");
+
+// Whether the lock is held for each command or for the whole run
+enum class InputLockScope {
+    Command,
+    Script,
+};
+
+// Host-wide counters of one lock, see InputLockShared
+struct InputLockTotals {
+    uint64_t acquisitions = 0;
+    uint64_t contended = 0;
+    uint64_t recoveries = 0;
+    double waitMs = 0;
+    double maxWaitMs = 0;
+};
+
+/**
+ * @brief Cross-process lock that gives one process at a time the right to inject
+ *
+ * Processes that inject into the same desktop open the lock by the same name. As the
+ * injector's arbiter it is taken on the injection thread when a command's first event is
+ * due and released after its last (InputLockScope::Command), or held from the first
+ * command until the run ends (InputLockScope::Script), so the moves and clicks of one
+ * command are never interleaved with another process's.
+ *
+ * Taking a free lock costs two atomic operations; waiters spin for kSpin, then sleep on
+ * the serving word (a futex on Linux, short sleeps on Windows). A waiter whose turn has
+ * not come for kPoll checks the process holding the current ticket and skips the ticket if
+ * that process has died, or if no process claimed it within kOrphanGrace.
+ */
+class InputLock : public InjectionArbiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto kSpin = std::chrono::microseconds(50);
+    static constexpr auto kPoll = std::chrono::milliseconds(10);
+    static constexpr auto kOrphanGrace = std::chrono::milliseconds(100);
+
+    InputLock() = default;
+    ~InputLock() { close(); }
+
+    InputLock(const InputLock&) = delete;
+    InputLock& operator=(const InputLock&) = delete;
+
+    // Map the lock of this name, creating it if no process has yet; false if that fails or it is from another version
+    bool open(const std::string& name, InputLockScope lockScope) {
+        if (!map(name)) return false;
+        uint32_t version = 0;
+        if (!shared->version.compare_exchange_strong(version, kInputLockVersion) && version != kInputLockVersion) {
+            unmap();
+            return false;
+        }
+        scope = lockScope;
+#ifdef _WIN32
+        pid = GetCurrentProcessId();
+#else
+        pid = static_cast<uint32_t>(getpid());
+#endif
+        pidStart = processStart(pid);
+        return true;
+    }
+
+    // Release the lock if held and unmap it. The name stays, so later processes share the same lock.
+    void close() {
+        if (!shared) return;
+        release();
+        unmap();
+    }
+
+    bool isOpen() const { return shared != nullptr; }
+
+    // Block until this process may inject
+    void acquire() {
+        if (!shared || holding.load(std::memory_order_acquire)) return;
+
+        auto start = Clock::now();
+        uint32_t mine;
+        bool waited = false;
+        for (;;) {
+            mine = shared->next.fetch_add(1);
+            shared->ownerStarts[mine % kInputLockSlots].store(pidStart);
+            shared->owners[mine % kInputLockSlots].store(pid);
+            if (shared->serving.load() == mine) break;
+            waited = true;
+            if (waitForTurn(mine, start)) break;
+        }
+        if (waited) shared->contended.fetch_add(1, std::memory_order_relaxed);
+        ticket = mine;
+        holding.store(true, std::memory_order_release);
+
+        auto waitNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        waitTimes.recordNs(waitNs);
+        shared->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        shared->waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+        uint64_t longest = shared->maxWaitNs.load(std::memory_order_relaxed);
+        while (waitNs > longest && !shared->maxWaitNs.compare_exchange_weak(longest, waitNs, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Hand the lock to the next ticket. Safe to call when not holding it, and from another thread
+    // than the one that took it, e.g. when aborting.
+    void release() {
+        if (!shared || !holding.exchange(false, std::memory_order_acq_rel)) return;
+        // Only if still serving this ticket: a waiter that wrongly took this process for dead has moved on
+        uint32_t expected = ticket;
+        bool handedOn = shared->serving.compare_exchange_strong(expected, ticket + 1);
+        shared->owners[ticket % kInputLockSlots].store(0);
+        if (handedOn && shared->waiting.load() > 0) wakeAll();
+    }
+
+    void commandBegin() override { acquire(); }
+    void commandEnd() override {
+        if (scope == InputLockScope::Command) release();
+    }
+
+    // Time each acquisition of this process waited, including the free ones
+    const LatencyHistogram& waits() const { return waitTimes; }
+
+    // Counters of every process that used this lock
+    InputLockTotals totals() const {
+        InputLockTotals result;
+        if (!shared) return result;
+        result.acquisitions = shared->acquisitions.load(std::memory_order_relaxed);
+        result.contended = shared->contended.load(std::memory_order_relaxed);
+        result.recoveries = shared->recoveries.load(std::memory_order_relaxed);
+        result.waitMs = static_cast<double>(shared->waitNs.load(std::memory_order_relaxed)) / 1e6;
+        result.maxWaitMs = static_cast<double>(shared->maxWaitNs.load(std::memory_order_relaxed)) / 1e6;
+        return result;
+    }
+
+private:
+    // Wait until serving reaches mine; false if it went past, because this process stalled so long
+    // between drawing the ticket and claiming it that a waiter skipped it, and a new ticket is needed
+    bool waitForTurn(uint32_t mine, Clock::time_point start) {
+        uint32_t watched = shared->serving.load();
+        auto watchedSince = Clock::now();
+        for (;;) {
+            uint32_t current = shared->serving.load();
+            if (current == mine) return true;
+            if (static_cast<int32_t>(current - mine) > 0) {
+                shared->owners[mine % kInputLockSlots].store(0);
+                return false;
+            }
+
+            auto now = Clock::now();
+            if (current != watched) {
+                watched = current;
+                watchedSince = now;
+            }
+            else if (now - watchedSince >= kPoll && holderGone(current, now - watchedSince)) {
+                // Only one waiter's exchange succeeds; the others see serving move on
+                if (shared->serving.compare_exchange_strong(current, current + 1)) {
+                    shared->owners[current % kInputLockSlots].store(0);
+                    shared->recoveries.fetch_add(1, std::memory_order_relaxed);
+                    wakeAll();
+                }
+                continue;
+            }
+
+            if (now - start < kSpin) {
+                std::this_thread::yield();
+                continue;
+            }
+            sleep(current);
+        }
+    }
+
+    // Whether the process holding ticket has died, or never claimed it
+    bool holderGone(uint32_t current, Clock::duration stalled) const {
+        uint32_t owner = shared->owners[current % kInputLockSlots].load();
+        if (owner == 0) return stalled >= kOrphanGrace;
+        return !processAlive(owner, shared->ownerStarts[current % kInputLockSlots].load());
+    }
+
+    // Whether the process is running and is the one that started at start (0: any)
+    static bool processAlive(uint32_t process, uint64_t start) {
+#ifdef _WIN32
+        HANDLE handle = OpenProcess(SYNCHRONIZE, FALSE, process);
+        if (!handle) return GetLastError() == ERROR_ACCESS_DENIED;
+        bool alive = WaitForSingleObject(handle, 0) == WAIT_TIMEOUT;
+        CloseHandle(handle);
+        if (!alive || start == 0) return alive;
+        uint64_t current = processStart(process);
+        return current == 0 || current == start;
+#else
+        if (kill(static_cast<pid_t>(process), 0) != 0 && errno == ESRCH) return false;
+        // A crashed process its parent has not reaped yet still has a pid, as a zombie
+        char state = 0;
+        uint64_t current = 0;
+        if (!readProcessStat(process, state, current)) return true;
+        if (state == 'Z' || state == 'X') return false;
+        return start == 0 || current == 0 || current == start;
+#endif
+    }
+
+    // When the process started, in a unit of the system's own; 0 if unknown
+    static uint64_t processStart(uint32_t process) {
+#ifdef _WIN32
+        HANDLE handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, process);
+        if (!handle) return 0;
+        FILETIME created, exited, kernel, user;
+        uint64_t start = 0;
+        if (GetProcessTimes(handle, &created, &exited, &kernel, &user)) {
+            start = (static_cast<uint64_t>(created.dwHighDateTime) << 32) | created.dwLowDateTime;
+        }
+        CloseHandle(handle);
+        return start;
+#else
+        char state = 0;
+        uint64_t start = 0;
+        return readProcessStat(process, state, start) ? start : 0;
+#endif
+    }
+
+#ifndef _WIN32
+    // State (field 3) and start time in clock ticks since boot (field 22) from /proc/<pid>/stat
+    static bool readProcessStat(uint32_t process, char& state, uint64_t& start) {
+        std::ifstream stat("/proc/" + std::to_string(process) + "/stat");
+        std::string text;
+        if (!std::getline(stat, text)) return false;
+        // The command name in field 2 may hold spaces and parentheses, so fields are counted from its end
+        size_t end = text.rfind(')');
+        if (end == std::string::npos || end + 2 >= text.size()) return false;
+        std::istringstream fields(text.substr(end + 2));
+        std::string field;
+        for (int index = 3; index <= 22 && fields >> field; index++) {
+            if (index == 3) state = field[0];
+            if (index == 22) {
+                start = std::strtoull(field.c_str(), nullptr, 10);
+                return true;
+            }
+        }
+        return false;
+    }
+#endif
+
+    bool map(const std::string& name) {
+#ifdef _WIN32
+        std::string object = "Local\\" + name;
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(InputLockShared), object.c_str());
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(InputLockShared)) : nullptr;
+        if (!view) {
+            unmap();
+            return false;
+        }
+#else
+        std::string path = "/" + name;
+        int fd = shm_open(path.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0) return false;
+        // Every process sizes the region, so none maps it before it has its full size; growing keeps the contents
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (info.st_size < static_cast<off_t>(sizeof(InputLockShared)) && ftruncate(fd, sizeof(InputLockShared)) != 0)) {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(nullptr, sizeof(InputLockShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED) return false;
+#endif
+        shared = static_cast<InputLockShared*>(view);
+        return true;
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        if (shared) UnmapViewOfFile(shared);
+        if (mapping) CloseHandle(mapping);
+        mapping = NULL;
+#else
+        if (shared) munmap(shared, sizeof(InputLockShared));
+#endif
+        shared = nullptr;
+    }
+
+    // Sleep while serving is still current, for at most kPoll
+    void sleep(uint32_t current) {
+        shared->waiting.fetch_add(1);
+#ifdef _WIN32
+        // Windows has no futex across processes; a waiter checks again every millisecond
+        if (shared->serving.load() == current) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#else
+        timespec relative = {0, static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(kPoll).count())};
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&shared->serving), FUTEX_WAIT, current, &relative, nullptr, 0);
+#endif
+        shared->waiting.fetch_sub(1);
+    }
+
+    // Every sleeper checks whether its ticket is served now
+    void wakeAll() {
+#ifndef _WIN32
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&shared->serving), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    InputLockShared* shared = nullptr;
+#ifdef _WIN32
+    HANDLE mapping = NULL;
+#endif
+    InputLockScope scope = InputLockScope::Command;
+    uint32_t pid = 0;
+    uint64_t pidStart = 0;              // Start time of this process, see processStart
+    uint32_t ticket = 0;                // Ticket of the current hold
+    std::atomic<bool> holding{false};
+    LatencyHistogram waitTimes;
+};
@@ -1,25 +1,79 @@
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <csignal>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cctype>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
+#ifdef _WIN32
 // Declare DPI awareness related APIs
 #include <ShellScalingAPI.h>
 #pragma comment(lib, "Shcore.lib")
 #pragma comment(lib, "User32.lib")
+#endif
+
+#include "chord.h"
+#include "command_ring.h"
+#include "executor.h"
+#include "file_watcher.h"
+#include "framebuffer.h"
+#include "injector.h"
+#include "input_lock.h"
+#include "probe.h"
+#include "profile.h"
+#include "recording_backend.h"
+#include "recording_compiler.h"
+#include "script_cache.h"
+#include "script_check.h"
+#include "template_match.h"
+#include "touch.h"
+#include "win32_compat.h"
+
+#if !defined(_WIN32) && defined(INPUT_SIMULATOR_XTEST)
+#include "xtest_backend.h"
+#endif
+#if defined(_WIN32) || defined(INPUT_SIMULATOR_XTEST)
+#include "window_backend.h"
+#endif
 
 bool quiet = false;
 bool verbose = false;
 double dpiScaling = 1;
 bool consistent = false;  // Flag for consistent coordinates
+std::string statsFormat = "none";  // Timing statistics format
+std::string statsFile = "";        // Timing statistics output path
+std::string frameFile = "";        // PPM file standing in for the screen (empty: capture the screen)
+std::string recordFile = "";       // File events are written to instead of being injected (empty: inject)
+std::string touchDevice = "/dev/uinput";  // uinput node touch is injected through, or a stand-in file (Linux)
+std::string profileFile = "";       // Per-line profile output path (empty: no profile)
+std::string lockScope = "none";     // How long the desktop's input lock is held (none, command, script)
+
+// Keyboard virtual key codes by name. A constant table rather than a map, so startup builds nothing.
+struct KeyName {
+    std::string_view name;
+    WORD code;
+};
 
-// Map to store keyboard virtual key codes
-std::map<std::string, WORD> keyCodeMap = {
+constexpr KeyName kKeyNames[] = {
     // Function keys
     {"key_f1", VK_F1},
     {"key_f2", VK_F2},
@@ -118,14 +172,136 @@ struct CommandLineArgs {
     std::string mode = "none";    // Mode (none or back)
     std::string smooth = "none";  // Smooth movement (none, linear, ease)
     int smoothTime = 200;         // Smooth movement duration in milliseconds
+    int wheelX = 0;               // Horizontal scroll of a wheel command in WHEEL_DELTA units, positive to the right
+    int wheelY = 0;               // Vertical scroll of a wheel command in WHEEL_DELTA units, positive up
+    int fingers = 0;              // Contacts of a touch command (0: 1, or 2 for touch_pinch)
+    int toX = -1;                 // End X of a touch swipe or drag (-1: same as -x)
+    int toY = -1;                 // End Y of a touch swipe or drag (-1: same as -y)
+    int radius = 200;             // Start distance of pinch contacts from (x, y)
+    int toRadius = 50;            // End distance of pinch contacts from (x, y)
     int sleep = 0;                // Sleep time in milliseconds
+    std::vector<KeyChord> chords;  // Key codes of a key command, one chord per ',' separated part
+    int keyGap = 0;               // Delay between the presses and releases of a key command in milliseconds
+    int color = -1;               // Color 0xRRGGBB to wait for (-1: not set)
+    int tolerance = 0;            // Per-channel color tolerance for screen waits
+    int timeout = 10000;          // Screen wait timeout in milliseconds
+    int regionWidth = 1;          // Width of the screen region to watch
+    int regionHeight = 1;         // Height of the screen region to watch
+    std::string findTemplate = "";  // PPM image to locate on screen as the mouse target
+    double threshold = 0.9;       // Minimum match score for -find
     std::string file = "";        // Input file path
+    std::string from = "";        // Label or line number of the file to start at
+    int sourceLine = 0;           // 1-based line of the command file the command was read from (0: none)
+    bool watch = false;           // Run the file again whenever it is saved
+    std::string statsFormat = "none";  // Timing statistics format (none, json, prometheus)
+    std::string statsFile = "";   // Timing statistics output path (stdout if empty)
+    std::string profileFile = "";  // Per-line profile of the command file written at exit (empty: none)
+    std::string lockScope = "none";  // Hold the cross-process input lock per command or for the run (none, command, script)
+    std::vector<std::string> checkPaths;  // Command files or directories to validate instead of running
+    std::vector<std::string> displays;    // X displays to run the same commands on in parallel
+    int displayOffset = 0;        // Start delay between consecutive displays in milliseconds
+    std::vector<std::string> windows;     // Windows to send input to instead of the desktop, by id or title (-w)
+    int probeSamples = 0;         // Probe clicks to inject and time (0: no probe)
+    int probeRate = 100;          // Probe clicks per second
+    std::string shmName = "";     // Shared-memory command ring to serve (empty: none)
+    std::string compileInput = "";   // --record-file recording to turn into a command file
+    std::string compileOutput = "";  // Command file written from compileInput
+    double pathTolerance = 2.0;   // Pixels a compiled motion may deviate from the recorded one
     bool verbose = false;         // Verbose output flag
     bool quiet = false;           // Quiet mode flag
     bool help = false;            // Help flag
     bool validArgs = true;        // Flag to indicate if required args are provided
 };
 
+// Problem with one command line argument; index 0 refers to the command as a whole
+struct ArgumentDiagnostic {
+    int index;
+    std::string message;
+};
+
+#ifdef _WIN32
+// Set process DPI awareness level
+void setProcessDpiAwareness() {
+    // Try to set Per Monitor v2 DPI awareness (Windows 10 1703+)
+    auto setDpiAwarenessContext = [](DPI_AWARENESS_CONTEXT context) {
+        using SetDpiAwarenessContextFn = DPI_AWARENESS_CONTEXT(WINAPI*)(DPI_AWARENESS_CONTEXT);
+        static auto fn = reinterpret_cast<SetDpiAwarenessContextFn>(
+            GetProcAddress(GetModuleHandleW(L"user32.dll"), "SetProcessDpiAwarenessContext"));
+        return fn && fn(context);
+    };
+
+    // Try to set DPI awareness level (Windows 8.1+)
+    auto setDpiAwareness = [](PROCESS_DPI_AWARENESS value) {
+        using SetDpiAwarenessFn = HRESULT(WINAPI*)(PROCESS_DPI_AWARENESS);
+        static auto fn = reinterpret_cast<SetDpiAwarenessFn>(
+            GetProcAddress(GetModuleHandleW(L"shcore.dll"), "SetProcessDpiAwareness"));
+        return fn && SUCCEEDED(fn(value));
+    };
+
+    // Try to set DPI awareness (Vista+)
+    auto setDpiAware = []() {
+        using SetDpiAwareFn = BOOL(WINAPI*)();
+        static auto fn = reinterpret_cast<SetDpiAwareFn>(
+            GetProcAddress(GetModuleHandleW(L"user32.dll"), "SetProcessDPIAware"));
+        return fn && fn();
+    };
+
+    // Priority: Per Monitor v2 > Per Monitor > System > Legacy
+    if (!setDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2)) {
+        if (!setDpiAwareness(PROCESS_PER_MONITOR_DPI_AWARE)) {
+            if (!setDpiAwareness(PROCESS_SYSTEM_DPI_AWARE)) {
+                setDpiAware();
+            }
+        }
+    }
+}
+
+// Get the DPI scaling factor of the monitor where the current mouse position is located
+double getCurrentDpiScalingFactor() {
+    // Get current mouse position
+    POINT pt;
+    GetCursorPos(&pt);
+
+    // Get monitor handle
+    HMONITOR hMonitor = MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST);
+
+    // Try to use GetDpiForMonitor (Windows 8.1+)
+    using GetDpiForMonitorFn = HRESULT(WINAPI*)(HMONITOR, MONITOR_DPI_TYPE, UINT*, UINT*);
+    static auto getDpiForMonitor = reinterpret_cast<GetDpiForMonitorFn>(
+        GetProcAddress(GetModuleHandleW(L"shcore.dll"), "GetDpiForMonitor"));
+
+    if (getDpiForMonitor) {
+        UINT dpiX = 0, dpiY = 0;
+        if (SUCCEEDED(getDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY))) {
+            return static_cast<double>(dpiX) / 96.0;
+        }
+    }
+
+    // Fallback: get primary monitor DPI
+    HDC hdc = GetDC(NULL);
+    const int dpiX = GetDeviceCaps(hdc, LOGPIXELSX);
+    ReleaseDC(NULL, hdc);
+
+    return static_cast<double>(dpiX) / 96.0;
+}
+#else
+// X11 coordinates are physical pixels already
+void setProcessDpiAwareness() {
+}
+
+double getCurrentDpiScalingFactor() {
+    return 1.0;
+}
+#endif
+
+// Coordinates are physical pixels only once the process is DPI aware, so everything that reads or sets
+// positions or creates a window calls this first. Keyboard-only runs never pay for the lookups.
+void ensureDpiAware() {
+    static const bool aware = (setProcessDpiAwareness(), true);
+    (void)aware;
+}
+
+#ifdef _WIN32
 // Window procedure for the temporary window
 LRESULT CALLBACK TempWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
@@ -147,6 +323,8 @@ LRESULT CALLBACK TempWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
  * @return TRUE if successful, FALSE if any critical step failed
  */
 BOOL SwitchFocus(DWORD sleepTimeMs) {
+    ensureDpiAware();  // A window must not be created before the process is DPI aware
+
     // Get the current foreground window (the window that has focus)
     HWND originalForegroundWindow = GetForegroundWindow();
 
@@ -223,272 +401,1273 @@ BOOL SwitchFocus(DWORD sleepTimeMs) {
     return TRUE;
 }
 
-POINT lastPos = {0, 0};
+// Injects event batches with SendInput; cursor moves keep using SetCursorPos for exact pixels
+class SendInputBackend : public InputBackend {
+public:
+    void submit(const InputEvent* events, size_t count) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (aborted) return;
+
+        for (size_t i = 0; i < count; i++) {
+            const InputEvent& event = events[i];
+            INPUT input = {};
+
+            switch (event.type) {
+                case InputEventType::MouseMove:
+                    flush();
+                    SetCursorPos(event.x, event.y);
+                    continue;
+                case InputEventType::MouseDown:
+                case InputEventType::MouseUp: {
+                    static const DWORD downFlags[] = {MOUSEEVENTF_LEFTDOWN, MOUSEEVENTF_RIGHTDOWN, MOUSEEVENTF_MIDDLEDOWN};
+                    static const DWORD upFlags[] = {MOUSEEVENTF_LEFTUP, MOUSEEVENTF_RIGHTUP, MOUSEEVENTF_MIDDLEUP};
+                    input.type = INPUT_MOUSE;
+                    input.mi.dwFlags = (event.type == InputEventType::MouseDown) ? downFlags[event.code] : upFlags[event.code];
+                    heldButtons[event.code] = (event.type == InputEventType::MouseDown);
+                    break;
+                }
+                case InputEventType::Wheel:
+                    input.type = INPUT_MOUSE;
+                    input.mi.dwFlags = (event.x != 0) ? MOUSEEVENTF_HWHEEL : MOUSEEVENTF_WHEEL;
+                    input.mi.mouseData = static_cast<DWORD>((event.x != 0) ? event.x : event.y);
+                    break;
+                case InputEventType::KeyDown:
+                case InputEventType::KeyUp:
+                    input.type = INPUT_KEYBOARD;
+                    input.ki.wVk = event.code;
+                    input.ki.dwFlags = (event.type == InputEventType::KeyUp) ? KEYEVENTF_KEYUP : 0;
+                    if (event.code < heldKeys.size()) heldKeys[event.code] = (event.type == InputEventType::KeyDown);
+                    break;
+                case InputEventType::TouchDown:
+                case InputEventType::TouchMove:
+                case InputEventType::TouchUp:
+                    // Contacts of one frame share a deadline; the last one injects the frame
+                    flush();
+                    updateContact(event);
+                    if (!(event.flags & EVENT_FLAG_GROUPED)) injectTouchFrame();
+                    continue;
+                case InputEventType::Marker:
+                    continue;
+            }
+            pending.push_back(input);
+        }
+        flush();
+    }
 
-BOOL GetConsistentCursorPos(LPPOINT pt, BOOL reset = FALSE) {
-    BOOL result = TRUE;
+    // Release every key and button that was pressed and not released, and drop all later events
+    void releaseHeldInput() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+
+        static const DWORD upFlags[] = {MOUSEEVENTF_LEFTUP, MOUSEEVENTF_RIGHTUP, MOUSEEVENTF_MIDDLEUP};
+        for (size_t code = 0; code < heldKeys.size(); code++) {
+            if (!heldKeys[code]) continue;
+            INPUT input = {};
+            input.type = INPUT_KEYBOARD;
+            input.ki.wVk = static_cast<WORD>(code);
+            input.ki.dwFlags = KEYEVENTF_KEYUP;
+            pending.push_back(input);
+        }
+        for (size_t button = 0; button < heldButtons.size(); button++) {
+            if (!heldButtons[button]) continue;
+            INPUT input = {};
+            input.type = INPUT_MOUSE;
+            input.mi.dwFlags = upFlags[button];
+            pending.push_back(input);
+        }
+        flush();
+        heldKeys.reset();
+        heldButtons.reset();
 
-    // Reset last position to current
-    if (reset) result = GetCursorPos(&lastPos);
+        for (POINTER_TOUCH_INFO& contact : contacts) {
+            if (contact.pointerInfo.pointerFlags & POINTER_FLAG_INCONTACT) contact.pointerInfo.pointerFlags = POINTER_FLAG_UP;
+        }
+        injectTouchFrame();
+    }
 
-    if (!consistent) {
-        // If consistent mode is disabled, just get the current cursor position
-        if (reset)
-            *pt = lastPos;
-        else
-            result = result && GetCursorPos(pt);
+private:
+    void flush() {
+        if (pending.empty()) return;
+        SendInput(static_cast<UINT>(pending.size()), pending.data(), sizeof(INPUT));
+        pending.clear();
     }
-    else {
-        // Consistent mode: always return the last known position unless reset
-        *pt = lastPos;
+
+    void updateContact(const InputEvent& event) {
+        if (event.code >= kMaxTouchContacts) return;
+        POINTER_TOUCH_INFO& contact = contacts[event.code];
+        if (event.type == InputEventType::TouchUp) {
+            if (contact.pointerInfo.pointerFlags & POINTER_FLAG_INCONTACT) contact.pointerInfo.pointerFlags = POINTER_FLAG_UP;
+            return;
+        }
+
+        bool down = (event.type == InputEventType::TouchDown);
+        if (!down && !(contact.pointerInfo.pointerFlags & POINTER_FLAG_INCONTACT)) return;
+        contact.pointerInfo.pointerType = PT_TOUCH;
+        contact.pointerInfo.pointerId = event.code;
+        contact.pointerInfo.pointerFlags = (down ? POINTER_FLAG_DOWN : POINTER_FLAG_UPDATE) | POINTER_FLAG_INRANGE | POINTER_FLAG_INCONTACT;
+        contact.pointerInfo.ptPixelLocation = {event.x, event.y};
+        contact.touchFlags = TOUCH_FLAG_NONE;
+        contact.touchMask = TOUCH_MASK_CONTACTAREA | TOUCH_MASK_ORIENTATION | TOUCH_MASK_PRESSURE;
+        contact.rcContact = {event.x - 2, event.y - 2, event.x + 2, event.y + 2};
+        contact.orientation = 90;
+        contact.pressure = 32000;
     }
-    return result;
-}
 
-BOOL SetConsistentCursorPos(int x, int y) {
-    // If consistent mode is enabled, update the last position
-    if (consistent) {
-        lastPos.x = x;
-        lastPos.y = y;
+    // InjectTouchInput wants every contact that is down in each frame, moved or not
+    void injectTouchFrame() {
+        POINTER_TOUCH_INFO frame[kMaxTouchContacts];
+        UINT32 count = 0;
+        for (POINTER_TOUCH_INFO& contact : contacts) {
+            if (contact.pointerInfo.pointerFlags == 0) continue;
+            frame[count++] = contact;
+            // Afterwards a contact that went down is updated, and one that lifted is gone
+            if (contact.pointerInfo.pointerFlags & POINTER_FLAG_UP)
+                contact.pointerInfo.pointerFlags = 0;
+            else
+                contact.pointerInfo.pointerFlags = POINTER_FLAG_UPDATE | POINTER_FLAG_INRANGE | POINTER_FLAG_INCONTACT;
+        }
+        if (count > 0) InjectTouchInput(count, frame);
     }
-    // Set the cursor position
-    return SetCursorPos(x, y);
+
+    POINTER_TOUCH_INFO contacts[kMaxTouchContacts] = {};  // pointerFlags 0: not touching
+
+    std::vector<INPUT> pending;
+
+    // Submit runs on the injection thread, releaseHeldInput on a console control handler thread
+    std::mutex mutex;
+    bool aborted = false;
+    KeyState heldKeys;
+    std::bitset<3> heldButtons;
+};
+
+SendInputBackend inputBackend;
+
+// Windows needs no connection to inject input
+bool connectInputBackend() {
+    return true;
 }
 
+// Only X11 has separate displays to fan out to
+std::unique_ptr<InputBackend> connectDisplay(const std::string& /*name*/) {
+    if (!quiet) std::cout << "Error: --displays is only supported with the X11 backend.\n";
+    return nullptr;
+}
 
+// Post input to one window instead of injecting it into the desktop
+std::unique_ptr<InputBackend> connectWindow(const std::string& spec) {
+    auto backend = std::make_unique<WindowMessageBackend>();
+    if (!backend->attach(spec)) {
+        if (!quiet) std::cout << "Error: No window matches -w " << spec << ".\n";
+        return nullptr;
+    }
+    if (verbose) std::cout << "Window " << spec << ": 0x" << std::hex << reinterpret_cast<uintptr_t>(backend->handle()) << std::dec << "\n";
+    return backend;
+}
 
-// Set process DPI awareness level
-void setProcessDpiAwareness() {
-    // Try to set Per Monitor v2 DPI awareness (Windows 10 1703+)
-    auto setDpiAwarenessContext = [](DPI_AWARENESS_CONTEXT context) {
-        using SetDpiAwarenessContextFn = DPI_AWARENESS_CONTEXT(WINAPI*)(DPI_AWARENESS_CONTEXT);
-        static auto fn = reinterpret_cast<SetDpiAwarenessContextFn>(
-            GetProcAddress(GetModuleHandleW(L"user32.dll"), "SetProcessDpiAwarenessContext"));
-        return fn && fn(context);
-    };
+const char* const kBackendName = "SendInput";
+
+// Enable touch injection before the first touch command; Windows needs no new device, so created stays false
+bool openTouchDevice(bool& created) {
+    static std::once_flag once;
+    static bool ready = false;
+    created = false;
+    std::call_once(once, [] {
+        ready = InitializeTouchInjection(kMaxTouchContacts, TOUCH_FEEDBACK_DEFAULT) != FALSE;
+        if (!ready && !quiet) std::cout << "Error: Touch injection is not available on this system.\n";
+    });
+    return ready;
+}
 
-    // Try to set DPI awareness level (Windows 8.1+)
-    auto setDpiAwareness = [](PROCESS_DPI_AWARENESS value) {
-        using SetDpiAwarenessFn = HRESULT(WINAPI*)(PROCESS_DPI_AWARENESS);
-        static auto fn = reinterpret_cast<SetDpiAwarenessFn>(
-            GetProcAddress(GetModuleHandleW(L"shcore.dll"), "SetProcessDpiAwareness"));
-        return fn && SUCCEEDED(fn(value));
-    };
+/**
+ * @brief Receives latency probe clicks at two points
+ *
+ * A low-level mouse hook sees each injected click as it enters the system input queue,
+ * and a small topmost window over the probe square sees it as an application would.
+ * Both run on one thread with its own message loop.
+ */
+class ProbeListener {
+public:
+    ~ProbeListener() { stop(); }
+
+    bool start(LatencyProbe& probe) {
+        ensureDpiAware();
+        active = &probe;
+        std::atomic<int> ready{0};
+        listener = std::thread([this, &ready] { run(ready); });
+        while (ready.load() == 0) std::this_thread::yield();
+        return ready.load() > 0;
+    }
 
-    // Try to set DPI awareness (Vista+)
-    auto setDpiAware = []() {
-        using SetDpiAwareFn = BOOL(WINAPI*)();
-        static auto fn = reinterpret_cast<SetDpiAwareFn>(
-            GetProcAddress(GetModuleHandleW(L"user32.dll"), "SetProcessDPIAware"));
-        return fn && fn();
-    };
+    void stop() {
+        if (!listener.joinable()) return;
+        PostThreadMessage(threadId, WM_QUIT, 0, 0);
+        listener.join();
+    }
 
-    // Priority: Per Monitor v2 > Per Monitor > System > Legacy
-    if (!setDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2)) {
-        if (!setDpiAwareness(PROCESS_PER_MONITOR_DPI_AWARE)) {
-            if (!setDpiAwareness(PROCESS_SYSTEM_DPI_AWARE)) {
-                setDpiAware();
-            }
+private:
+    static LRESULT CALLBACK hookProc(int code, WPARAM wParam, LPARAM lParam) {
+        if (code == HC_ACTION && wParam == WM_LBUTTONDOWN) {
+            const MSLLHOOKSTRUCT* info = reinterpret_cast<const MSLLHOOKSTRUCT*>(lParam);
+            if (info->flags & LLMHF_INJECTED) active->deliver(ProbeStage::Hook, info->pt.x, info->pt.y, InjectClock::now());
         }
+        return CallNextHookEx(NULL, code, wParam, lParam);
     }
-}
 
-// Get the DPI scaling factor of the monitor where the current mouse position is located
-double getCurrentDpiScalingFactor() {
-    // Get current mouse position
-    POINT pt;
-    GetCursorPos(&pt);
+    static LRESULT CALLBACK windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+        if (msg == WM_LBUTTONDOWN) {
+            POINT pt = {static_cast<short>(LOWORD(lParam)), static_cast<short>(HIWORD(lParam))};
+            ClientToScreen(hwnd, &pt);
+            active->deliver(ProbeStage::Window, pt.x, pt.y, InjectClock::now());
+            return 0;
+        }
+        return DefWindowProc(hwnd, msg, wParam, lParam);
+    }
 
-    // Get monitor handle
-    HMONITOR hMonitor = MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST);
+    void run(std::atomic<int>& ready) {
+        threadId = GetCurrentThreadId();
+
+        WNDCLASSA wc = {};
+        wc.lpfnWndProc = windowProc;
+        wc.hInstance = GetModuleHandle(NULL);
+        wc.lpszClassName = "LatencyProbeWindow";
+        RegisterClassA(&wc);
+
+        // Does not take the focus when clicked, and stays out of the taskbar
+        HWND window = CreateWindowExA(WS_EX_TOPMOST | WS_EX_TOOLWINDOW | WS_EX_NOACTIVATE, wc.lpszClassName, "Latency Probe",
+                                      WS_POPUP, active->x(0), active->y(0), kProbeGrid, kProbeGrid, NULL, NULL, wc.hInstance, NULL);
+        HHOOK hook = window ? SetWindowsHookExA(WH_MOUSE_LL, hookProc, wc.hInstance, 0) : NULL;
+        if (!hook) {
+            if (window) DestroyWindow(window);
+            ready.store(-1);
+            return;
+        }
+        ShowWindow(window, SW_SHOWNOACTIVATE);
 
-    // Try to use GetDpiForMonitor (Windows 8.1+)
-    using GetDpiForMonitorFn = HRESULT(WINAPI*)(HMONITOR, MONITOR_DPI_TYPE, UINT*, UINT*);
-    static auto getDpiForMonitor = reinterpret_cast<GetDpiForMonitorFn>(
-        GetProcAddress(GetModuleHandleW(L"shcore.dll"), "GetDpiForMonitor"));
+        // Make sure the message queue exists before stop() can post to it
+        MSG msg = {};
+        PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE);
+        ready.store(1);
 
-    if (getDpiForMonitor) {
-        UINT dpiX = 0, dpiY = 0;
-        if (SUCCEEDED(getDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY))) {
-            return static_cast<double>(dpiX) / 96.0;
+        while (GetMessage(&msg, NULL, 0, 0) > 0) {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
         }
+        UnhookWindowsHookEx(hook);
+        DestroyWindow(window);
     }
 
-    // Fallback: get primary monitor DPI
-    HDC hdc = GetDC(NULL);
-    const int dpiX = GetDeviceCaps(hdc, LOGPIXELSX);
-    ReleaseDC(NULL, hdc);
+    static inline LatencyProbe* active = nullptr;
+    std::thread listener;
+    DWORD threadId = 0;
+};
+#else
+#ifdef INPUT_SIMULATOR_XTEST
+XTestBackend inputBackend;
+
+// Connect to $DISPLAY, once, before the first cursor query or event
+bool connectInputBackend() {
+    if (!inputBackend.connect()) {
+        if (!quiet) std::cout << "Error: Could not open the X display or it lacks the XTest extension.\n";
+        return false;
+    }
+    if (verbose && inputBackend.unmappedKeys() > 0) {
+        std::cout << inputBackend.unmappedKeys() << " keys have no keycode in the X keymap and will be ignored.\n";
+    }
+    return true;
+}
 
-    return static_cast<double>(dpiX) / 96.0;
+std::unique_ptr<InputBackend> connectDisplay(const std::string& name) {
+    auto backend = std::make_unique<XTestBackend>();
+    if (!backend->connect(name.c_str())) {
+        if (!quiet) std::cout << "Error: Could not open X display " << name << " or it lacks the XTest extension.\n";
+        return nullptr;
+    }
+    return backend;
 }
 
-// Function to display help information
-void displayHelp() {
-    std::cout << "Mouse and Keyboard Simulator - Simulates mouse and keyboard events at specified screen coordinates\n\n";
-    std::cout << "Usage: MouseClickSimulator [OPTIONS]\n\n";
-    std::cout << "Options:\n";
-    std::cout << "    -k, --key           Input type (none, mouse_left, mouse_right, mouse_middle,\n";
-    std::cout << "                        mouse_move, wheel_up, wheel_down, key_a, key_b, key_enter,\n";
-    std::cout << "                        switch_focus, etc.) [default: none]\n";
-    std::cout << "    -a, --action        Action to perform (click, doubleclick, keydown, keyup)\n";
-    std::cout << "                        [default: none for key=none, click for mouse_* types]\n";
-    std::cout << "    -x                  X coordinate (-1: keep current position)\n";
-    std::cout << "    -y                  Y coordinate (-1: keep current position)\n";
-    std::cout << "    -m, --mode          Mode of operation (none, back) [default: none]\n";
-    std::cout << "    -sm, --smooth       Smooth movement mode (none, linear, ease) [default: none]\n";
-    std::cout << "    -smt, --smooth_time Duration of smooth movement in milliseconds. If key is switch_focus,\n";
-    std::cout << "                        this is the time to hold focus [default: 200]\n";
-    std::cout << "    -s, --sleep         Sleep time in milliseconds after action [default: 0]\n";
-    std::cout << "    -f, --file          Path to a text file containing commands (one per line)\n";
-    std::cout << "    -c, --consistent    Use consistent coordinates, ignoring external mouse movement [default: true]\n";
-    std::cout << "    -q, --quiet         Suppress all output except errors\n";
-    std::cout << "    -v, --verbose       Enable verbose output\n";
-    std::cout << "    -h, --help          Display this help message and exit\n\n";
-    std::cout << "Examples:\n";
-    std::cout << "    MouseClickSimulator -k mouse_move -x 500 -y 500                (just move mouse)\n";
-    std::cout << "    MouseClickSimulator -k mouse_left -x 500 -y 500                (left click)\n";
-    std::cout << "    MouseClickSimulator -k key_enter -a click                      (press Enter key)\n";
-    std::cout << "    MouseClickSimulator -k none -s 1000                           (just sleep for 1 second)\n";
-    std::cout << "    MouseClickSimulator -k mouse_right -a doubleclick -x 800 -y 600 -m back -sm ease -smt 300\n";
+// Send input to one window of $DISPLAY on a connection of its own
+std::unique_ptr<InputBackend> connectWindow(const std::string& spec) {
+    auto backend = std::make_unique<XWindowBackend>();
+    if (!backend->connect()) {
+        if (!quiet) std::cout << "Error: Could not open the X display.\n";
+        return nullptr;
+    }
+    if (!backend->attach(spec)) {
+        if (!quiet) std::cout << "Error: No window matches -w " << spec << ".\n";
+        return nullptr;
+    }
+    if (verbose) std::cout << "Window " << spec << ": 0x" << std::hex << backend->handle() << std::dec << "\n";
+    return backend;
 }
 
-// Function to parse command line arguments
-CommandLineArgs parseCommandLine(int argc, char* argv[]) {
-    CommandLineArgs args;
-    bool xProvided = false;
-    bool yProvided = false;
+const char* const kBackendName = "XTest";
 
-    // If no arguments provided, show help
-    if (argc <= 1) {
-        args.help = true;
-        return args;
+using ProbeListener = XProbeListener;
+#else
+// Built without an input API to inject with (libXtst was missing): parsing and --check still work
+class NoInputBackend : public InputBackend {
+public:
+    void submit(const InputEvent*, size_t) override {}
+};
+
+NoInputBackend inputBackend;
+
+bool connectInputBackend() {
+    if (!quiet) std::cout << "Error: This build has no input backend. Install the XTest development files and rebuild.\n";
+    return false;
+}
+
+std::unique_ptr<InputBackend> connectDisplay(const std::string& /*name*/) {
+    connectInputBackend();
+    return nullptr;
+}
+
+std::unique_ptr<InputBackend> connectWindow(const std::string& /*spec*/) {
+    connectInputBackend();
+    return nullptr;
+}
+
+const char* const kBackendName = "none";
+
+class ProbeListener {
+public:
+    bool start(LatencyProbe&) { return false; }
+    void stop() {}
+};
+#endif
+
+BOOL SwitchFocus(DWORD /*sleepTimeMs*/) {
+    if (!quiet) std::cout << "Error: switch_focus is only supported on Windows.\n";
+    return FALSE;
+}
+
+// Touch contacts go to a uinput touchscreen of their own, everything else on to the input backend
+UinputTouchBackend touchBackend(inputBackend);
+
+// Create the touchscreen before the first touch command; created is true only for the call that did
+bool openTouchDevice(bool& created) {
+    static std::once_flag once;
+    static bool ready = false;
+    created = false;
+    std::call_once(once, [&] {
+        ready = touchBackend.open(touchDevice, created);
+        if (!ready && !quiet) std::cout << "Error: Could not open " << touchDevice << " for touch input.\n";
+    });
+    return ready;
+}
+#endif
+
+#ifdef _WIN32
+Injector defaultInjector(inputBackend);
+#else
+Injector defaultInjector(touchBackend);
+#endif
+
+// One --displays target, or one of several -w windows: its own connection, injection thread and executor thread
+struct DisplayTarget {
+    std::string name;
+    bool window = false;  // name is a -w window rather than an X display
+    std::unique_ptr<InputBackend> backend;
+    std::unique_ptr<Injector> injector;
+    InputLock lock;  // --lock of this display
+};
+
+// Filled before any executor starts and never changed afterwards
+std::vector<std::unique_ptr<DisplayTarget>> displayTargets;
+
+// Backend of the default injector with a single -w window, null otherwise
+std::unique_ptr<InputBackend> windowBackend;
+
+// The executor state below is per thread: the main thread drives the default backend,
+// and with --displays or several -w each target's executor thread drives its own
+thread_local InputBackend* activeBackend = &inputBackend;
+thread_local Injector* injector = &defaultInjector;
+
+// Deadline of the next event the executor enqueues. Sleeps advance it instead of blocking.
+thread_local InjectClock::time_point timeline = InjectClock::now();
+
+// Keys and mouse buttons that will be held down once every enqueued event has been injected
+thread_local KeyState heldKeys;
+thread_local std::bitset<3> heldButtons;
+thread_local std::bitset<kMaxTouchContacts> heldTouches;
+
+// Command file line of the command being run, passed to the injector in its begin marker
+thread_local uint32_t commandLine = 0;
+
+// Pointer position on the target this thread drives. A -w window and --record-file keep a pointer
+// of their own; otherwise it is the Windows cursor, or the pointer of the X display.
+BOOL readCursorPos(LPPOINT pt) {
+    int x = 0, y = 0;
+    if (activeBackend->queryPointer(x, y)) {
+        pt->x = x;
+        pt->y = y;
+        return TRUE;
     }
+#ifdef _WIN32
+    return GetCursorPos(pt);
+#else
+    return FALSE;
+#endif
+}
 
-    for (int i = 1; i < argc; i++) {
-        std::string arg = argv[i];
+RecordingBackend recordingBackend;
 
-        if (arg == "-k" || arg == "--key") {
-            if (i + 1 < argc) {
-                args.key = argv[++i];
-                // Validate key type
-                bool validKey =
-                    (args.key == "none") ||
-                    (args.key == "mouse_left") ||
-                    (args.key == "mouse_right") ||
-                    (args.key == "mouse_middle") ||
-                    (args.key == "mouse_move") ||
-                    (args.key == "wheel_up") ||
-                    (args.key == "wheel_down") ||
-                    (args.key == "switch_focus") ||
-                    (args.key.substr(0, 4) == "key_" && keyCodeMap.find(args.key) != keyCodeMap.end());
+// Send the default injector's events to --record-file, with no input system involved
+bool connectRecording() {
+    if (!recordingBackend.open(recordFile)) {
+        if (!quiet) std::cout << "Error: Could not open " << recordFile << " for writing.\n";
+        return false;
+    }
+    defaultInjector.setBackend(recordingBackend);
+    activeBackend = &recordingBackend;
+    return true;
+}
 
-                if (!validKey) {
-                    if (!quiet) std::cout << "Error: Invalid key type '" << args.key << "'.";
-                    args.help = true;
-                }
-            }
-        }
-        else if (arg == "-a" || arg == "--action") {
-            if (i + 1 < argc) {
-                args.action = argv[++i];
-                if (args.action != "click" && args.action != "doubleclick" &&
-                    args.action != "keydown" && args.action != "keyup" && args.action != "none") {
-                    if (!quiet) std::cout << "Error: Invalid action. Must be 'none', 'click', 'doubleclick', 'keydown', or 'keyup'.\n";
-                    args.help = true;
+// Connect the default backend, a single -w window in its place, or one backend per --displays entry or window
+bool connectTargets(const std::vector<std::string>& displays, const std::vector<std::string>& windows) {
+    if (!recordFile.empty()) return connectRecording();
+    if (windows.size() == 1) {
+        windowBackend = connectWindow(windows[0]);
+        if (!windowBackend) return false;
+        defaultInjector.setBackend(*windowBackend);
+        activeBackend = windowBackend.get();
+        return true;
+    }
+    if (displays.empty() && windows.empty()) return connectInputBackend();
+
+    bool toWindows = !windows.empty();
+    for (const std::string& name : toWindows ? windows : displays) {
+        auto target = std::make_unique<DisplayTarget>();
+        target->name = name;
+        target->window = toWindows;
+        target->backend = toWindows ? connectWindow(name) : connectDisplay(name);
+        if (!target->backend) return false;
+        target->injector = std::make_unique<Injector>(*target->backend);
+        displayTargets.push_back(std::move(target));
+    }
+    return true;
+}
+
+// Whether input goes to -w windows rather than a desktop
+bool targetsWindows() {
+    return windowBackend || (!displayTargets.empty() && displayTargets[0]->window);
+}
+
+// Cross-process lock of the desktop the default backend injects into
+InputLock inputLock;
+
+// Name of the input lock of a desktop: one per X display, one per session on Windows. A -w window
+// is not shared with the rest of the desktop, so it has a lock of its own, named "window.<id or title>".
+std::string inputLockName(std::string display) {
+    std::replace(display.begin(), display.end(), '/', '_');
+    std::replace(display.begin(), display.end(), '\\', '_');
+    return display.empty() ? "input_simulator_lock" : "input_simulator_lock." + display;
+}
+
+// With --lock, make every injector take its desktop's or window's input lock before each command
+bool openInputLocks(const std::vector<std::string>& windows) {
+    if (lockScope == "none") return true;
+    InputLockScope scope = (lockScope == "script") ? InputLockScope::Script : InputLockScope::Command;
+
+    auto open = [&](InputLock& lock, Injector& lockedInjector, const std::string& display) {
+        if (!lock.open(inputLockName(display), scope)) {
+            if (!quiet) std::cout << "Error: Could not open the input lock " << inputLockName(display) << ".\n";
+            return false;
+        }
+        lockedInjector.setArbiter(&lock);
+        return true;
+    };
+    if (windowBackend) return open(inputLock, defaultInjector, "window." + windows[0]);
+    if (displayTargets.empty()) {
+#ifdef _WIN32
+        return open(inputLock, defaultInjector, "");
+#else
+        const char* display = std::getenv("DISPLAY");
+        return open(inputLock, defaultInjector, display ? display : "");
+#endif
+    }
+    for (auto& target : displayTargets) {
+        if (!open(target->lock, *target->injector, target->window ? "window." + target->name : target->name)) return false;
+    }
+    return true;
+}
+
+// Let other instances inject, e.g. once a run holding the lock for the whole script has ended
+void releaseInputLocks() {
+    inputLock.release();
+    for (auto& target : displayTargets) {
+        target->lock.release();
+    }
+}
+
+// Counters of every target's injector added up; only meaningful once they have stopped
+InjectorStats totalInjectorStats() {
+    InjectorStats total = defaultInjector.stats();
+    for (auto& target : displayTargets) {
+        InjectorStats stats = target->injector->stats();
+        total.events += stats.events;
+        total.batches += stats.batches;
+        total.deadlineMisses += stats.deadlineMisses;
+        total.maxLatenessMs = std::max(total.maxLatenessMs, stats.maxLatenessMs);
+        total.depthHighWater = std::max(total.depthHighWater, stats.depthHighWater);
+    }
+    return total;
+}
+
+// Release held keys and buttons on every target, for an aborted run
+void releaseAllHeldInput() {
+    inputBackend.releaseHeldInput();
+    if (windowBackend) windowBackend->releaseHeldInput();
+    for (auto& target : displayTargets) {
+        target->backend->releaseHeldInput();
+    }
+}
+
+// Stamp an event with the current timeline position and hand it to the injection thread
+void enqueueEvent(InputEventType type, uint16_t code = 0, int x = 0, int y = 0, uint8_t flags = 0) {
+    InputEvent event;
+    event.deadline = timeline;
+    event.type = type;
+    event.flags = flags;
+    event.code = code;
+    event.x = x;
+    event.y = y;
+    injector->push(event);
+
+    if (type == InputEventType::MouseDown || type == InputEventType::MouseUp) heldButtons[code] = (type == InputEventType::MouseDown);
+}
+
+// Advance the timeline, as if the main thread had slept
+void advanceTimeline(int ms) {
+    timeline += std::chrono::milliseconds(ms);
+}
+
+// Block until every queued event has been injected and the timeline has been reached
+void waitForTimeline() {
+    injector->sync();
+    std::this_thread::sleep_until(timeline);
+    timeline = std::max(timeline, InjectClock::now());
+}
+
+#ifdef _WIN32
+// Captures screen rectangles with GDI into a reused DIB section, so polling only copies the watched region
+class GdiFrameSource : public FrameSource {
+public:
+    ~GdiFrameSource() {
+        if (bitmap) DeleteObject(bitmap);
+        if (memoryDc) DeleteDC(memoryDc);
+        if (screenDc) ReleaseDC(NULL, screenDc);
+    }
+
+    bool capture(const PixelRect& region, Frame& out) override {
+        if (!screenDc) {
+            screenDc = GetDC(NULL);
+            memoryDc = CreateCompatibleDC(screenDc);
+            if (!screenDc || !memoryDc) return false;
+        }
+
+        if (!bitmap || region.width != bitmapWidth || region.height != bitmapHeight) {
+            if (bitmap) DeleteObject(bitmap);
+
+            BITMAPINFO info = {};
+            info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+            info.bmiHeader.biWidth = region.width;
+            info.bmiHeader.biHeight = -region.height;  // Top-down rows
+            info.bmiHeader.biPlanes = 1;
+            info.bmiHeader.biBitCount = 32;
+            info.bmiHeader.biCompression = BI_RGB;
+
+            bitmap = CreateDIBSection(memoryDc, &info, DIB_RGB_COLORS, reinterpret_cast<void**>(&bits), NULL, 0);
+            if (!bitmap) return false;
+            SelectObject(memoryDc, bitmap);
+            bitmapWidth = region.width;
+            bitmapHeight = region.height;
+        }
+
+        if (!BitBlt(memoryDc, 0, 0, region.width, region.height, screenDc, region.x, region.y, SRCCOPY)) return false;
+        GdiFlush();
+
+        out.width = region.width;
+        out.height = region.height;
+        out.pixels.assign(bits, bits + static_cast<size_t>(region.width) * region.height);
+        return true;
+    }
+
+    PixelRect bounds() override {
+        return PixelRect{GetSystemMetrics(SM_XVIRTUALSCREEN), GetSystemMetrics(SM_YVIRTUALSCREEN),
+                         GetSystemMetrics(SM_CXVIRTUALSCREEN), GetSystemMetrics(SM_CYVIRTUALSCREEN)};
+    }
+
+private:
+    HDC screenDc = NULL;
+    HDC memoryDc = NULL;
+    HBITMAP bitmap = NULL;
+    uint32_t* bits = nullptr;
+    int bitmapWidth = 0;
+    int bitmapHeight = 0;
+};
+#else
+// Screen capture is only implemented with GDI; elsewhere screen waits and -find need --frame-file
+class GdiFrameSource : public FrameSource {
+public:
+    bool capture(const PixelRect&, Frame&) override { return false; }
+    PixelRect bounds() override { return PixelRect{0, 0, 0, 0}; }
+};
+#endif
+
+// Frame source for screen waits: the screen, or a PPM file when --frame-file is given
+FrameSource& getFrameSource() {
+    static thread_local std::unique_ptr<FrameSource> source;  // One per executor thread
+    if (!source) {
+        ensureDpiAware();
+        if (frameFile.empty())
+            source = std::make_unique<GdiFrameSource>();
+        else
+            source = std::make_unique<PpmFrameSource>(frameFile);
+    }
+    return *source;
+}
+
+/**
+ * @brief Locate a template image on screen and return its center
+ * @return false if the template could not be loaded or was not found
+ */
+bool findOnScreen(const std::string& templatePath, double threshold, int& centerX, int& centerY) {
+    static thread_local TemplateMatcher matcher;
+
+    FrameSource& source = getFrameSource();
+    PixelRect region = source.bounds();
+    Frame frame;
+    if (!source.capture(region, frame)) {
+        if (!quiet) std::cout << "Error: Could not capture the screen.\n";
+        return false;
+    }
+
+    MatchOptions options;
+    options.threshold = static_cast<float>(threshold);
+    matcher.setOptions(options);
+
+    MatchResult match;
+    int width = 0, height = 0;
+    if (!matcher.find(templatePath, frame, region, match) || !matcher.templateSize(templatePath, width, height)) {
+        if (!quiet) std::cout << "Error: Could not load template: " << templatePath << "\n";
+        return false;
+    }
+    if (verbose) std::cout << "    Best match for " << templatePath << " at (" << match.x << ", " << match.y << "), score " << match.score << "\n";
+    if (!match.found) return false;
+
+    centerX = match.x + width / 2;
+    centerY = match.y + height / 2;
+    return true;
+}
+
+thread_local POINT lastPos = {0, 0};
+thread_local bool lastPosKnown = false;  // Taken from the real cursor the first time it is needed
+
+// Cursor position a command starts from: with EXECUTOR_CONSISTENT the position the executor last
+// moved to, read from the real cursor only the first time; otherwise the real cursor.
+template <unsigned Features>
+BOOL GetConsistentCursorPos(LPPOINT pt, BOOL reset = FALSE) {
+    constexpr bool kConsistent = (Features & EXECUTOR_CONSISTENT) != 0;
+    BOOL result = TRUE;
+    ensureDpiAware();
+    if (kConsistent && !lastPosKnown) reset = TRUE;
+
+    // Reset last position to current
+    if (reset) {
+        result = readCursorPos(&lastPos);
+        lastPosKnown = true;
+    }
+
+    if constexpr (!kConsistent) {
+        // If consistent mode is disabled, just get the current cursor position.
+        // The real cursor lags the timeline, so let the injection thread catch up first.
+        if (reset)
+            *pt = lastPos;
+        else {
+            waitForTimeline();
+            result = result && readCursorPos(pt);
+        }
+    }
+    else {
+        // Consistent mode: always return the last known position unless reset
+        *pt = lastPos;
+    }
+    return result;
+}
+
+// Queue a cursor move. Runs once per smooth move frame, so it only does what Features ask for;
+// GetConsistentCursorPos has already made the process DPI aware.
+template <unsigned Features>
+BOOL SetConsistentCursorPos(int x, int y, uint8_t flags = 0) {
+    // If consistent mode is enabled, update the last position
+    if constexpr ((Features & EXECUTOR_CONSISTENT) != 0) {
+        lastPos.x = x;
+        lastPos.y = y;
+        lastPosKnown = true;
+    }
+    // Queue the cursor move
+    enqueueEvent(InputEventType::MouseMove, 0, x, y, flags);
+    return TRUE;
+}
+
+// Function to display help information
+void displayHelp() {
+    std::cout << "Mouse and Keyboard Simulator - Simulates mouse and keyboard events at specified screen coordinates\n\n";
+    std::cout << "Usage: MouseClickSimulator [OPTIONS]\n\n";
+    std::cout << "Options:\n";
+    std::cout << "    -k, --key           Input type (none, mouse_left, mouse_right, mouse_middle,\n";
+    std::cout << "                        mouse_move, wheel_up, wheel_down, wheel, key_a, key_b, key_enter,\n";
+    std::cout << "                        switch_focus, wait_pixel, wait_region_change, touch_tap, touch_swipe,\n";
+    std::cout << "                        touch_drag, touch_pinch, etc.) [default: none]\n";
+    std::cout << "                        Chords join keys with '+' and sequences with ',' (ctrl+k,ctrl+c)\n";
+    std::cout << "    -a, --action        Action to perform (click, doubleclick, keydown, keyup)\n";
+    std::cout << "                        [default: none for key=none, click for mouse_* types]\n";
+    std::cout << "    -x                  X coordinate (-1: keep current position)\n";
+    std::cout << "    -y                  Y coordinate (-1: keep current position)\n";
+    std::cout << "    -m, --mode          Mode of operation (none, back) [default: none]\n";
+    std::cout << "    -sm, --smooth       Smooth movement mode (none, linear, ease) [default: none]\n";
+    std::cout << "    -smt, --smooth_time Duration of smooth movement in milliseconds. If key is switch_focus,\n";
+    std::cout << "                        this is the time to hold focus [default: 200]\n";
+    std::cout << "    -dx, --delta-x      Notches to scroll right with key wheel, fractions allowed (negative: left)\n";
+    std::cout << "    -dy, --delta-y      Notches to scroll up with key wheel, fractions allowed (negative: down).\n";
+    std::cout << "                        With -sm, the scroll is spread over -smt in sub-notch steps\n";
+    std::cout << "    -tf, --fingers      Contacts of a touch command (1-10) [default: 1, 2 for touch_pinch]\n";
+    std::cout << "    -tx, --to-x         End X of touch_swipe and touch_drag, moving over -smt [default: -x]\n";
+    std::cout << "    -ty, --to-y         End Y of touch_swipe and touch_drag [default: -y]\n";
+    std::cout << "    --radius            Start distance of touch_pinch contacts from (x, y) [default: 200]\n";
+    std::cout << "    --to-radius         End distance of touch_pinch contacts from (x, y) [default: 50]\n";
+    std::cout << "    --touch-device      uinput node to create the touchscreen with, or a file that receives\n";
+    std::cout << "                        the raw events instead (Linux) [default: /dev/uinput]\n";
+    std::cout << "    -s, --sleep         Sleep time in milliseconds after action [default: 0]\n";
+    std::cout << "    -kg, --key-gap      Delay between the presses and releases of a chord in milliseconds [default: 0]\n";
+    std::cout << "    -rgb                Color to wait for with wait_pixel, as RRGGBB hex\n";
+    std::cout << "    -tol, --tolerance   Per-channel color tolerance for screen waits (0-255) [default: 0]\n";
+    std::cout << "    -t, --timeout       Screen wait timeout in milliseconds [default: 10000]\n";
+    std::cout << "    -r, --region        Size of the watched region at (x, y), as WxH [default: 1x1]\n";
+    std::cout << "    -find, --find       Target the center of this PPM template, located on screen\n";
+    std::cout << "    --threshold         Minimum normalized correlation for -find (-1 to 1) [default: 0.9]\n";
+    std::cout << "    --frame-file        Read the screen from this PPM file instead (for testing)\n";
+    std::cout << "    --record-file       Write events to this file instead of injecting them (for testing)\n";
+    std::cout << "    --compile-recording Turn a --record-file recording into a command file: IN OUT\n";
+    std::cout << "    --path-tolerance    Pixels a compiled motion may deviate from the recorded path [default: 2]\n";
+    std::cout << "    -f, --file          Path to a text file containing commands (one per line)\n";
+    std::cout << "    --from              Start the command file at this :label or line number\n";
+    std::cout << "    --watch             Run the command file again from --from every time it is saved\n";
+    std::cout << "    --check             Validate command files or directories of .txt files and report all errors\n";
+    std::cout << "    --displays          Run the command or file on several X displays at once, e.g. :1-:32\n";
+    std::cout << "    --display-offset    Start each display or window this many milliseconds after the previous one [default: 0]\n";
+    std::cout << "    -w, --window        Send input to this window (id or title) instead of the desktop, without moving\n";
+    std::cout << "                        the cursor or the focus; -x and -y are relative to it. Repeat to run the\n";
+    std::cout << "                        command or file on several windows at once\n";
+    std::cout << "    --probe             Inject this many tagged clicks at (x, y) and report their delivery latency\n";
+    std::cout << "    --probe-rate        Probe clicks per second [default: 100]\n";
+    std::cout << "    --shm               Serve binary commands from a shared-memory ring of this name until a client\n";
+    std::cout << "                        stops it (see command_ring.h)\n";
+    std::cout << "    --lock              Take turns with other instances on this desktop, holding a shared lock\n";
+    std::cout << "                        for each command or the whole run (none, command, script) [default: none]\n";
+    std::cout << "    --profile           Write the command file annotated with per-line calls, wall, sleep and wait\n";
+    std::cout << "                        time, events and lateness to this file at exit, with the hottest lines\n";
+    std::cout << "    --stats             Report timing histograms at exit and on Ctrl+Break (none, json,\n";
+    std::cout << "                        prometheus) [default: none]\n";
+    std::cout << "    --stats-file        Write the timing report to this file instead of stdout\n";
+    std::cout << "    -c, --consistent    Use consistent coordinates, ignoring external mouse movement [default: true]\n";
+    std::cout << "    -q, --quiet         Suppress all output except errors\n";
+    std::cout << "    -v, --verbose       Enable verbose output\n";
+    std::cout << "    -h, --help          Display this help message and exit\n\n";
+    std::cout << "Examples:\n";
+    std::cout << "    MouseClickSimulator -k mouse_move -x 500 -y 500                (just move mouse)\n";
+    std::cout << "    MouseClickSimulator -k mouse_left -x 500 -y 500                (left click)\n";
+    std::cout << "    MouseClickSimulator -k key_enter -a click                      (press Enter key)\n";
+    std::cout << "    MouseClickSimulator -k ctrl+shift+key_s                        (press a shortcut)\n";
+    std::cout << "    MouseClickSimulator -k ctrl+k,ctrl+c -kg 20                    (press a chord sequence)\n";
+    std::cout << "    MouseClickSimulator -k wheel -dy -10 -sm ease -smt 500         (scroll down 10 notches smoothly)\n";
+    std::cout << "    MouseClickSimulator -k touch_swipe -x 200 -y 600 -tx 1000 -tf 2 (two-finger swipe right)\n";
+    std::cout << "    MouseClickSimulator -k none -s 1000                           (just sleep for 1 second)\n";
+    std::cout << "    MouseClickSimulator -k mouse_right -a doubleclick -x 800 -y 600 -m back -sm ease -smt 300\n";
+}
+
+// Each display gets an executor and an injection thread, so a list is capped well below anything a typo could ask for
+constexpr size_t kMaxDisplays = 256;
+
+// Expand a display list such as ":1-:32,:40,remote:0" into display names; false if an entry is malformed,
+// a range is reversed or does not fit an int, or the list names more than kMaxDisplays displays
+bool parseDisplayList(const std::string& text, std::vector<std::string>& displays) {
+    displays.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t dash = item.find('-');
+        if (item.empty()) return false;
+        if (item[0] != ':' || dash == std::string::npos) {
+            if (displays.size() == kMaxDisplays) return false;
+            displays.push_back(item);
+            continue;
+        }
+
+        // Range of local displays, ":1-:32" or ":1-32"
+        std::string last = item.substr(dash + 1);
+        if (!last.empty() && last[0] == ':') last = last.substr(1);
+        try {
+            size_t usedFirst = 0, usedLast = 0;
+            int first = std::stoi(item.substr(1, dash - 1), &usedFirst);
+            int end = std::stoi(last, &usedLast);
+            if (usedFirst != dash - 1 || usedLast != last.size() || first < 0 || end < first) return false;
+            if (static_cast<size_t>(end - first) >= kMaxDisplays - displays.size()) return false;
+            for (int display = first; display <= end; display++) {
+                std::string name = ":";
+                name += std::to_string(display);
+                displays.push_back(name);
+            }
+        } catch (...) {
+            return false;
+        }
+    }
+    return !displays.empty();
+}
+
+// Key code of a key_ name, or -1
+int lookupKeyCode(const std::string& name) {
+    for (const KeyName& key : kKeyNames) {
+        if (key.name == name) return key.code;
+    }
+    return -1;
+}
+
+// Function to parse command line arguments. With diagnostics, errors are collected instead of printed
+// and global settings are left untouched, so lines can be validated from several threads
+CommandLineArgs parseCommandLine(int argc, char* argv[], std::vector<ArgumentDiagnostic>* diagnostics = nullptr) {
+    CommandLineArgs args;
+    bool xProvided = false;
+    bool yProvided = false;
+    bool touchOption = false;
+
+    auto reportError = [&](int index, const std::string& message) {
+        if (diagnostics)
+            diagnostics->push_back({index, message});
+        else if (!quiet)
+            std::cout << "Error: " << message << "\n";
+        args.help = true;
+    };
+
+    auto hasValue = [&](int index) {
+        if (index + 1 < argc) return true;
+        reportError(index, "Missing value for " + std::string(argv[index]) + ".");
+        return false;
+    };
+
+    // If no arguments provided, show help
+    if (argc <= 1) {
+        args.help = true;
+        return args;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "-k" || arg == "--key") {
+            if (hasValue(i)) {
+                args.key = argv[++i];
+                // Validate key type
+                bool validKey =
+                    (args.key == "none") ||
+                    (args.key == "mouse_left") ||
+                    (args.key == "mouse_right") ||
+                    (args.key == "mouse_middle") ||
+                    (args.key == "mouse_move") ||
+                    (args.key == "wheel_up") ||
+                    (args.key == "wheel_down") ||
+                    (args.key == "wheel") ||
+                    (args.key == "switch_focus") ||
+                    (args.key == "wait_pixel") ||
+                    (args.key == "wait_region_change") ||
+                    (args.key == "touch_tap") ||
+                    (args.key == "touch_swipe") ||
+                    (args.key == "touch_drag") ||
+                    (args.key == "touch_pinch");
+
+                if (validKey) {
+                    args.chords.clear();
+                }
+                else if (args.key.substr(0, 4) == "key_" || isChordSyntax(args.key)) {
+                    // Key names and chords are resolved to key codes once, here
+                    std::string chordError;
+                    if (!parseChordSequence(args.key, lookupKeyCode, args.chords, chordError)) {
+                        reportError(i, isChordSyntax(args.key) ? chordError : "Invalid key type '" + args.key + "'.");
+                    }
+                }
+                else {
+                    reportError(i, "Invalid key type '" + args.key + "'.");
+                }
+            }
+        }
+        else if (arg == "-a" || arg == "--action") {
+            if (hasValue(i)) {
+                args.action = argv[++i];
+                if (args.action != "click" && args.action != "doubleclick" &&
+                    args.action != "keydown" && args.action != "keyup" && args.action != "none") {
+                    reportError(i, "Invalid action. Must be 'none', 'click', 'doubleclick', 'keydown', or 'keyup'.");
                 }
             }
         }
         else if (arg == "-x") {
-            if (i + 1 < argc) {
+            if (hasValue(i)) {
                 try {
                     args.x = std::stoi(argv[++i]);
                     xProvided = true;
                 } catch (...) {
-                    if (!quiet) std::cout << "Error: Invalid X coordinate.\n";
-                    args.help = true;
+                    reportError(i, "Invalid X coordinate.");
                 }
             }
         }
         else if (arg == "-y") {
-            if (i + 1 < argc) {
+            if (hasValue(i)) {
                 try {
                     args.y = std::stoi(argv[++i]);
                     yProvided = true;
                 } catch (...) {
-                    if (!quiet) std::cout << "Error: Invalid Y coordinate.\n";
-                    args.help = true;
+                    reportError(i, "Invalid Y coordinate.");
                 }
             }
         }
         else if (arg == "-m" || arg == "--mode") {
-            if (i + 1 < argc) {
+            if (hasValue(i)) {
                 args.mode = argv[++i];
                 if (args.mode != "none" && args.mode != "back") {
-                    if (!quiet) std::cout << "Error: Invalid mode. Must be 'none' or 'back'.\n";
-                    args.help = true;
+                    reportError(i, "Invalid mode. Must be 'none' or 'back'.");
                 }
             }
         }
         else if (arg == "-sm" || arg == "--smooth") {
-            if (i + 1 < argc) {
+            if (hasValue(i)) {
                 args.smooth = argv[++i];
                 if (args.smooth != "none" && args.smooth != "linear" && args.smooth != "ease") {
-                    if (!quiet) std::cout << "Error: Invalid smooth mode. Must be 'none', 'linear' or 'ease'.\n";
-                    args.help = true;
+                    reportError(i, "Invalid smooth mode. Must be 'none', 'linear' or 'ease'.");
                 }
             }
         }
         else if (arg == "-smt" || arg == "--smooth_time") {
-            if (i + 1 < argc) {
+            if (hasValue(i)) {
                 try {
                     args.smoothTime = std::stoi(argv[++i]);
                     if (args.smoothTime < 0) {
-                        if (!quiet) std::cout << "Error: Smooth time must be non-negative.\n";
-                        args.help = true;
+                        reportError(i, "Smooth time must be non-negative.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid smooth time value.");
+                }
+            }
+        }
+        else if (arg == "-dx" || arg == "-dy" || arg == "--delta-x" || arg == "--delta-y") {
+            if (hasValue(i)) {
+                bool horizontal = (arg == "-dx" || arg == "--delta-x");
+                try {
+                    // Notches, fractions allowed; kept in WHEEL_DELTA units, the resolution of high-resolution wheels
+                    double notches = std::stod(argv[++i]);
+                    if (notches < -10000 || notches > 10000) {
+                        reportError(i, "Wheel amount must be between -10000 and 10000 notches.");
+                    }
+                    else {
+                        (horizontal ? args.wheelX : args.wheelY) = static_cast<int>(std::lround(notches * WHEEL_DELTA));
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid wheel amount.");
+                }
+            }
+        }
+        else if (arg == "-tf" || arg == "--fingers") {
+            if (hasValue(i)) {
+                try {
+                    args.fingers = std::stoi(argv[++i]);
+                    touchOption = true;
+                    if (args.fingers < 1 || args.fingers > kMaxTouchContacts) {
+                        reportError(i, "Fingers must be between 1 and " + std::to_string(kMaxTouchContacts) + ".");
                     }
                 } catch (...) {
-                    if (!quiet) std::cout << "Error: Invalid smooth time value.\n";
-                    args.help = true;
+                    reportError(i, "Invalid finger count.");
+                }
+            }
+        }
+        else if (arg == "-tx" || arg == "-ty" || arg == "--to-x" || arg == "--to-y") {
+            if (hasValue(i)) {
+                bool horizontal = (arg == "-tx" || arg == "--to-x");
+                try {
+                    (horizontal ? args.toX : args.toY) = std::stoi(argv[++i]);
+                    touchOption = true;
+                } catch (...) {
+                    reportError(i, horizontal ? "Invalid end X coordinate." : "Invalid end Y coordinate.");
+                }
+            }
+        }
+        else if (arg == "--radius" || arg == "--to-radius") {
+            if (hasValue(i)) {
+                try {
+                    (arg == "--radius" ? args.radius : args.toRadius) = std::stoi(argv[++i]);
+                    touchOption = true;
+                    if ((arg == "--radius" ? args.radius : args.toRadius) < 0) {
+                        reportError(i, "Pinch radius must be non-negative.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid pinch radius.");
                 }
             }
         }
         else if (arg == "-s" || arg == "--sleep") {
-            if (i + 1 < argc) {
+            if (hasValue(i)) {
                 try {
                     args.sleep = std::stoi(argv[++i]);
                     if (args.sleep < 0) {
-                        if (!quiet) std::cout << "Error: Sleep time must be non-negative.\n";
-                        args.help = true;
+                        reportError(i, "Sleep time must be non-negative.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid sleep time value.");
+                }
+            }
+        }
+        else if (arg == "-kg" || arg == "--key-gap") {
+            if (hasValue(i)) {
+                try {
+                    args.keyGap = std::stoi(argv[++i]);
+                    if (args.keyGap < 0) {
+                        reportError(i, "Key gap must be non-negative.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid key gap value.");
+                }
+            }
+        }
+        else if (arg == "-rgb") {
+            if (hasValue(i)) {
+                std::string hex = argv[++i];
+                if (!hex.empty() && hex[0] == '#') hex = hex.substr(1);
+                try {
+                    size_t used = 0;
+                    args.color = static_cast<int>(std::stoul(hex, &used, 16));
+                    if (hex.size() != 6 || used != 6) throw std::invalid_argument(hex);
+                } catch (...) {
+                    reportError(i, "Invalid color. Must be RRGGBB hex.");
+                }
+            }
+        }
+        else if (arg == "-tol" || arg == "--tolerance") {
+            if (hasValue(i)) {
+                try {
+                    args.tolerance = std::stoi(argv[++i]);
+                    if (args.tolerance < 0 || args.tolerance > 255) {
+                        reportError(i, "Tolerance must be between 0 and 255.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid tolerance value.");
+                }
+            }
+        }
+        else if (arg == "-t" || arg == "--timeout") {
+            if (hasValue(i)) {
+                try {
+                    args.timeout = std::stoi(argv[++i]);
+                    if (args.timeout < 0) {
+                        reportError(i, "Timeout must be non-negative.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid timeout value.");
+                }
+            }
+        }
+        else if (arg == "-r" || arg == "--region") {
+            if (hasValue(i)) {
+                std::string size = argv[++i];
+                size_t separator = size.find('x');
+                try {
+                    if (separator == std::string::npos) throw std::invalid_argument(size);
+                    args.regionWidth = std::stoi(size.substr(0, separator));
+                    args.regionHeight = std::stoi(size.substr(separator + 1));
+                    if (args.regionWidth <= 0 || args.regionHeight <= 0) throw std::invalid_argument(size);
+                } catch (...) {
+                    reportError(i, "Invalid region. Must be WxH with positive sizes.");
+                }
+            }
+        }
+        else if (arg == "-find" || arg == "--find") {
+            if (hasValue(i)) {
+                args.findTemplate = argv[++i];
+            }
+        }
+        else if (arg == "--threshold") {
+            if (hasValue(i)) {
+                try {
+                    args.threshold = std::stod(argv[++i]);
+                    if (args.threshold < -1 || args.threshold > 1) {
+                        reportError(i, "Threshold must be between -1 and 1.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid threshold value.");
+                }
+            }
+        }
+        else if (arg == "--frame-file") {
+            if (hasValue(i)) {
+                ++i;
+                if (!diagnostics) frameFile = argv[i];
+            }
+        }
+        else if (arg == "--touch-device") {
+            if (hasValue(i)) {
+                ++i;
+                if (!diagnostics) touchDevice = argv[i];
+            }
+        }
+        else if (arg == "--shm") {
+            if (hasValue(i)) {
+                args.shmName = argv[++i];
+                if (args.shmName.empty() || args.shmName.find_first_of("/\\") != std::string::npos) {
+                    reportError(i, "Shared memory name must be non-empty and contain no slashes.");
+                }
+            }
+        }
+        else if (arg == "--compile-recording") {
+            if (hasValue(i) && hasValue(i + 1)) {
+                args.compileInput = argv[++i];
+                args.compileOutput = argv[++i];
+            }
+        }
+        else if (arg == "--path-tolerance") {
+            if (hasValue(i)) {
+                try {
+                    args.pathTolerance = std::stod(argv[++i]);
+                    if (args.pathTolerance < 0) {
+                        reportError(i, "Path tolerance must be non-negative.");
                     }
                 } catch (...) {
-                    if (!quiet) std::cout << "Error: Invalid sleep time value.\n";
-                    args.help = true;
+                    reportError(i, "Invalid path tolerance.");
                 }
             }
         }
+        else if (arg == "--record-file") {
+            if (hasValue(i)) {
+                ++i;
+                if (!diagnostics) recordFile = argv[i];
+            }
+        }
         else if (arg == "-f" || arg == "--file") {
-            if (i + 1 < argc) {
+            if (hasValue(i)) {
                 args.file = argv[++i];
             }
         }
+        else if (arg == "--from") {
+            if (hasValue(i)) {
+                args.from = argv[++i];
+            }
+        }
+        else if (arg == "--watch") {
+            args.watch = true;
+        }
+        else if (arg == "--stats") {
+            if (hasValue(i)) {
+                args.statsFormat = argv[++i];
+                if (args.statsFormat != "none" && args.statsFormat != "json" && args.statsFormat != "prometheus") {
+                    reportError(i, "Invalid stats format. Must be 'none', 'json' or 'prometheus'.");
+                }
+                if (!diagnostics) statsFormat = args.statsFormat;
+            }
+        }
+        else if (arg == "--stats-file") {
+            if (hasValue(i)) {
+                args.statsFile = argv[++i];
+                if (!diagnostics) statsFile = args.statsFile;
+            }
+        }
+        else if (arg == "--lock") {
+            if (hasValue(i)) {
+                args.lockScope = argv[++i];
+                if (args.lockScope != "none" && args.lockScope != "command" && args.lockScope != "script") {
+                    reportError(i, "Invalid lock scope. Must be 'none', 'command' or 'script'.");
+                }
+                if (!diagnostics) lockScope = args.lockScope;
+            }
+        }
+        else if (arg == "--profile") {
+            if (hasValue(i)) {
+                args.profileFile = argv[++i];
+                if (!diagnostics) profileFile = args.profileFile;
+            }
+        }
         else if (arg == "-c" || arg == "--consistent") {
             // Consistent coordinates flag
-            consistent = true;  // Always true in this implementation
+            if (!diagnostics) consistent = true;  // Always true in this implementation
         }
         else if (arg == "-v" || arg == "--verbose") {
             args.verbose = true;
-            verbose = true;
+            if (!diagnostics) verbose = true;
         }
         else if (arg == "-h" || arg == "--help") {
             args.help = true;
         }
         else if (arg == "-q" || arg == "--quiet") {
             args.quiet = true;
-            quiet = true;
+            if (!diagnostics) quiet = true;
+        }
+        else if (arg == "--displays") {
+            if (hasValue(i)) {
+                if (!parseDisplayList(argv[++i], args.displays)) {
+                    reportError(i, "Invalid display list. Must be at most " + std::to_string(kMaxDisplays) +
+                                   " names or ascending ranges such as :1-:32, separated by ','.");
+                }
+            }
+        }
+        else if (arg == "-w" || arg == "--window") {
+            if (hasValue(i)) {
+                args.windows.push_back(argv[++i]);
+                if (args.windows.back().empty()) {
+                    reportError(i, "Window must be an id or a title.");
+                }
+            }
+        }
+        else if (arg == "--display-offset") {
+            if (hasValue(i)) {
+                try {
+                    args.displayOffset = std::stoi(argv[++i]);
+                    if (args.displayOffset < 0) {
+                        reportError(i, "Display offset must be non-negative.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid display offset value.");
+                }
+            }
+        }
+        else if (arg == "--probe") {
+            if (hasValue(i)) {
+                try {
+                    args.probeSamples = std::stoi(argv[++i]);
+                    if (args.probeSamples <= 0) {
+                        reportError(i, "Probe sample count must be positive.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid probe sample count.");
+                }
+            }
+        }
+        else if (arg == "--probe-rate") {
+            if (hasValue(i)) {
+                try {
+                    args.probeRate = std::stoi(argv[++i]);
+                    if (args.probeRate <= 0 || args.probeRate > 10000) {
+                        reportError(i, "Probe rate must be between 1 and 10000 clicks per second.");
+                    }
+                } catch (...) {
+                    reportError(i, "Invalid probe rate.");
+                }
+            }
+        }
+        else if (arg == "--check") {
+            // Every following argument up to the next option is a file or directory
+            int option = i;
+            while (i + 1 < argc && argv[i + 1][0] != '-') {
+                args.checkPaths.push_back(argv[++i]);
+            }
+            if (args.checkPaths.empty()) reportError(option, "Missing value for --check.");
         }
         else {
-            if (!quiet) std::cout << "Warning: Unknown option: " << arg << "\n";
-            args.help = true;
+            reportError(i, "Unknown option: " + arg);
         }
     }
 
@@ -503,15 +1682,83 @@ CommandLineArgs parseCommandLine(int argc, char* argv[]) {
     //     }
     // }
 
+    // Only mouse commands have a target to find
+    if (!args.findTemplate.empty() && args.key.substr(0, 6) != "mouse_" && args.key.substr(0, 5) != "wheel" && !args.help) {
+        reportError(0, "-find requires a mouse or wheel key.");
+    }
+
+    // A wheel command scrolls by its deltas and nothing else does
+    if (args.key == "wheel" && args.wheelX == 0 && args.wheelY == 0 && !args.help) {
+        reportError(0, "wheel requires a nonzero -dx or -dy.");
+    }
+    if (args.key != "wheel" && (args.wheelX != 0 || args.wheelY != 0) && !args.help) {
+        reportError(0, "-dx and -dy require -k wheel.");
+    }
+
+    // Touch has no cursor to start from, so every contact needs explicit coordinates
+    bool touchKey = (args.key.substr(0, 6) == "touch_");
+    if (touchKey && (!xProvided || !yProvided) && !args.help) {
+        reportError(0, args.key + " requires -x and -y.");
+    }
+    if ((args.key == "touch_swipe" || args.key == "touch_drag") && args.toX == -1 && args.toY == -1 && !args.help) {
+        reportError(0, args.key + " requires -tx or -ty.");
+    }
+    if (args.key == "touch_pinch" && args.fingers == 1 && !args.help) {
+        reportError(0, "touch_pinch requires at least 2 fingers.");
+    }
+    if (!touchKey && touchOption && !args.help) {
+        reportError(0, "-tf, -tx, -ty, --radius and --to-radius require a touch key.");
+    }
+
+    // wait_pixel has nothing to wait for without a color
+    if (args.key == "wait_pixel" && args.color < 0 && !args.help) {
+        reportError(0, "wait_pixel requires -rgb.");
+    }
+
+    // Only a command file can be watched or started part way through
+    if ((args.watch || !args.from.empty()) && args.file.empty() && !args.help) {
+        reportError(0, std::string(args.watch ? "--watch" : "--from") + " requires -f.");
+    }
+    if (!args.profileFile.empty() && args.file.empty() && !args.help) {
+        reportError(0, "--profile requires -f.");
+    }
+    if (args.watch && (!args.displays.empty() || args.windows.size() > 1) && !args.help) {
+        reportError(0, "--watch cannot be combined with --displays or several -w.");
+    }
+    if (!args.windows.empty() && !args.displays.empty() && !args.help) {
+        reportError(0, "-w cannot be combined with --displays.");
+    }
+    // These look at the screen or move the focus, which a window target must leave alone
+    if (!args.windows.empty() && (!args.findTemplate.empty() || args.key == "wait_pixel" || args.key == "wait_region_change" || args.key == "switch_focus") &&
+        !args.help) {
+        reportError(0, "-find, wait_pixel, wait_region_change and switch_focus cannot be combined with -w.");
+    }
+
+    // A probe injects its own clicks and nothing else
+    if (args.probeSamples > 0 && (args.key != "none" || !args.file.empty() || !args.displays.empty() || !args.windows.empty()) && !args.help) {
+        reportError(0, "--probe cannot be combined with -k, -f, --displays or -w.");
+    }
+    // Clients send no command boundaries, so there is nothing for --lock to hold the lock around
+    if (!args.shmName.empty() &&
+        (args.key != "none" || !args.file.empty() || !args.displays.empty() || args.windows.size() > 1 || args.probeSamples > 0 ||
+         args.lockScope != "none") &&
+        !args.help) {
+        reportError(0, "--shm cannot be combined with -k, -f, --displays, several -w, --probe or --lock.");
+    }
+    if (!recordFile.empty() && (!args.displays.empty() || !args.windows.empty() || args.probeSamples > 0) && !args.help) {
+        reportError(0, "--record-file cannot be combined with --displays, -w or --probe.");
+    }
+
     // Set default action based on key type if not provided
     if (args.action == "none" && args.key != "none") {
-        if (args.key.substr(0, 6) == "mouse_" || args.key.substr(0, 6) == "wheel_" || args.key.substr(0, 4) == "key_") {
+        if (args.key.substr(0, 6) == "mouse_" || args.key.substr(0, 5) == "wheel" || !args.chords.empty()) {
             args.action = "click";  // Default to click
         }
     }
 
     // Mark arguments as valid
-    args.validArgs = !args.help && (args.sleep > 0 || args.key != "none" || !args.file.empty());
+    args.validArgs = !args.help && (args.sleep > 0 || args.key != "none" || !args.file.empty() || !args.checkPaths.empty() ||
+                                    args.probeSamples > 0 || !args.compileInput.empty() || !args.shmName.empty());
 
     // If quiet mode is enabled, verbose output is suppressed
     if (args.quiet) args.verbose = false;
@@ -519,29 +1766,11 @@ CommandLineArgs parseCommandLine(int argc, char* argv[]) {
     return args;
 }
 
-// Function to calculate easing for smooth movement
-double calculateEasing(double t, const std::string& mode) {
-    if (mode == "linear") {
-        return t;
-    }
-    else if (mode == "ease") {
-        // Stronger ease-in-out using cubic easing: t^3 for in, 1-(1-t)^3 for out
-        if (t < 0.5) {
-            return 4 * t * t * t;
-        }
-        else {
-            double f = (t - 1);
-            return 1 + 4 * f * f * f;
-        }
-    }
-    // Fallback to linear if mode is not recognized
-    return t;
-}
-
 // Function to move the mouse cursor smoothly with improved timing
-void smoothMoveMouse(int targetX, int targetY, int duration, const std::string& mode) {
+template <unsigned Features>
+void smoothMoveMouse(int targetX, int targetY, int duration, EasingMode easing) {
     POINT currentPos;
-    GetConsistentCursorPos(&currentPos);
+    GetConsistentCursorPos<Features>(&currentPos);
 
     int startX = currentPos.x;
     int startY = currentPos.y;
@@ -554,49 +1783,242 @@ void smoothMoveMouse(int targetX, int targetY, int duration, const std::string&
     if (startX == targetX && startY == targetY) {
         return;
     }
-
-    // Use high precision timer
-    auto startTime = std::chrono::high_resolution_clock::now();
-    auto endTime = startTime + std::chrono::milliseconds(duration);
-
-    // Target frame rate - adaptive based on duration
-    int targetFPS = (duration > 500) ? 60 : 120;  // Higher frame rate for shorter durations
-    auto frameTime = std::chrono::milliseconds(1000 / targetFPS);
-
-    while (true) {
-        auto currentTime = std::chrono::high_resolution_clock::now();
-
-        // Check if we've exceeded the duration
-        if (currentTime >= endTime) {
-            break;
+
+    // Frames are stamped on the timeline; the injection thread does the waiting. The last one lands exactly on the target.
+    auto startTime = timeline;
+    auto frame = [startTime](int x, int y, std::chrono::milliseconds offset, uint8_t flags) {
+        timeline = startTime + offset;
+        SetConsistentCursorPos<Features>(x, y, flags);
+    };
+    if (easing == EasingMode::Ease)
+        smoothMoveFrames<EasingMode::Ease>(startX, startY, targetX, targetY, duration, frame);
+    else
+        smoothMoveFrames<EasingMode::Linear>(startX, startY, targetX, targetY, duration, frame);
+}
+
+// Scroll by (totalX, totalY) WHEEL_DELTA units over duration, easing like a smooth move.
+// Each frame sends what the eased total has grown by since the last one, so rounding never
+// accumulates and the frames add up to exactly the requested amount.
+void smoothScroll(int totalX, int totalY, int duration, EasingMode easing) {
+    auto frameTime = smoothFrameTime(duration);
+    auto totalTime = std::chrono::milliseconds(duration);
+
+    int sentX = 0;
+    int sentY = 0;
+    auto scrollTo = [&](double progress, uint8_t flags) {
+        int x = static_cast<int>(std::lround(totalX * progress));
+        int y = static_cast<int>(std::lround(totalY * progress));
+        if (y != sentY) enqueueEvent(InputEventType::Wheel, 0, 0, y - sentY, flags);
+        if (x != sentX) enqueueEvent(InputEventType::Wheel, 0, x - sentX, 0, flags);
+        sentX = x;
+        sentY = y;
+    };
+
+    // The first frame is one step in, as scrolling by nothing at t = 0 would be a wasted event
+    auto startTime = timeline;
+    for (auto elapsed = frameTime; elapsed < totalTime; elapsed += frameTime) {
+        timeline = startTime + elapsed;
+        scrollTo(ease(static_cast<double>(elapsed.count()) / duration, easing), EVENT_FLAG_FRAME);
+    }
+    timeline = startTime + totalTime;
+    scrollTo(1.0, EVENT_FLAG_FRAME);
+}
+
+constexpr int kTouchFingerSpacing = 60;  // Pixels between neighbouring fingers of a tap, swipe or drag
+constexpr int kTouchTapHold = 50;        // Milliseconds a tap stays down
+constexpr int kTouchDragHold = 150;      // Milliseconds a drag rests before and after moving, so it does not fling
+constexpr int kTouchDeviceSettle = 250;  // Milliseconds for the desktop to pick up a newly created touchscreen
+
+// Inject a tap, swipe, drag or pinch. Every frame moves all contacts at one deadline and is
+// pushed as one group, so the backend injects the whole frame with a single call.
+template <unsigned Features>
+void simulateTouch(const CommandLineArgs& args) {
+    bool created = false;
+    if (recordFile.empty() && !openTouchDevice(created)) return;
+    if (injector != &defaultInjector || windowBackend) {
+        if (!quiet) std::cout << "Warning: Touch commands are not supported with --displays or -w. Skipping command.\n";
+        return;
+    }
+    ensureDpiAware();
+    if (created) advanceTimeline(kTouchDeviceSettle);
+
+    // Start and end of each finger: a row centred on (x, y) moving as one, or a circle shrinking or growing
+    struct Path {
+        double fromX, fromY, toX, toY;
+    };
+    bool pinch = (args.key == "touch_pinch");
+    int fingers = (args.fingers > 0) ? args.fingers : (pinch ? 2 : 1);
+    std::vector<Path> paths;
+    for (int i = 0; i < fingers; i++) {
+        if (pinch) {
+            double angle = 2 * std::numbers::pi * i / fingers;
+            double dx = std::cos(angle);
+            double dy = std::sin(angle);
+            paths.push_back({args.x + args.radius * dx, args.y + args.radius * dy, args.x + args.toRadius * dx, args.y + args.toRadius * dy});
+        }
+        else {
+            double offset = (i - (fingers - 1) / 2.0) * kTouchFingerSpacing;
+            int toX = (args.toX != -1) ? args.toX : args.x;
+            int toY = (args.toY != -1) ? args.toY : args.y;
+            paths.push_back({args.x + offset, static_cast<double>(args.y), toX + offset, static_cast<double>(toY)});
+        }
+    }
+    if constexpr ((Features & EXECUTOR_LOGGING) != 0) std::cout << "    " << args.key << " with " << fingers << " finger(s)\n";
+
+    std::vector<InputEvent> frame;
+    auto pushFrame = [&](InputEventType type, double progress, uint8_t flags) {
+        frame.clear();
+        for (int i = 0; i < fingers; i++) {
+            InputEvent event;
+            event.deadline = timeline;
+            event.type = type;
+            event.code = static_cast<uint16_t>(i);
+            event.x = static_cast<int>(std::lround(paths[i].fromX + (paths[i].toX - paths[i].fromX) * progress));
+            event.y = static_cast<int>(std::lround(paths[i].fromY + (paths[i].toY - paths[i].fromY) * progress));
+            event.flags = (i == 0) ? flags : 0;  // One frame interval per frame, not per contact
+            frame.push_back(event);
+            heldTouches[i] = (type != InputEventType::TouchUp);
+        }
+        injector->pushGroup(frame);
+    };
+
+    pushFrame(InputEventType::TouchDown, 0.0, 0);
+    if (args.key == "touch_tap") {
+        advanceTimeline(kTouchTapHold);
+        pushFrame(InputEventType::TouchUp, 0.0, 0);
+        return;
+    }
+
+    bool drag = (args.key == "touch_drag");
+    if (drag) advanceTimeline(kTouchDragHold);
+
+    // Frames at the digitizer rate, eased like a smooth mouse move; the first is one step in
+    EasingMode easing = parseEasing(args.smooth);
+    auto frameTime = std::chrono::nanoseconds(1000000000 / kTouchFrameRate);
+    auto totalTime = std::chrono::milliseconds(args.smoothTime);
+    auto startTime = timeline;
+    for (auto elapsed = frameTime; elapsed < totalTime; elapsed += frameTime) {
+        timeline = startTime + elapsed;
+        pushFrame(InputEventType::TouchMove, ease(std::chrono::duration<double>(elapsed) / totalTime, easing), EVENT_FLAG_FRAME);
+    }
+    timeline = startTime + totalTime;
+    pushFrame(InputEventType::TouchMove, 1.0, EVENT_FLAG_FRAME);
+
+    if (drag) advanceTimeline(kTouchDragHold);
+    pushFrame(InputEventType::TouchUp, 1.0, 0);
+}
+
+// Move, click or scroll for a mouse or wheel command, starting from originalPos
+template <unsigned Features>
+void simulateMouse(const CommandLineArgs& args, int argX, int argY, POINT originalPos) {
+    constexpr bool kLogging = (Features & EXECUTOR_LOGGING) != 0;
+    EasingMode easing = parseEasing(args.smooth);
+
+    int targetX = argX;
+    int targetY = argY;
+
+    // If -1 was specified, keep the current coordinate
+    targetX = (targetX != -1) ? targetX : originalPos.x;
+    targetY = (targetY != -1) ? targetY : originalPos.y;
+
+    // Move mouse to target position, either smoothly or instantly; a wheel command smooths its scroll instead
+    if (args.smooth != "none" && args.key != "wheel") {
+        if constexpr (kLogging) std::cout << "    Smoothly moving mouse: (" << originalPos.x << ", " << originalPos.y << ") -> (" << targetX << ", " << targetY << ")\n";
+        smoothMoveMouse<Features>(targetX, targetY, args.smoothTime, easing);
+    }
+    else {
+        if constexpr (kLogging) std::cout << "    Moving mouse: (" << originalPos.x << ", " << originalPos.y << ") -> (" << targetX << ", " << targetY << ")\n";
+        SetConsistentCursorPos<Features>(targetX, targetY);
+    }
+
+    // Handle mouse button actions
+    if (args.key == "mouse_left" || args.key == "mouse_right" || args.key == "mouse_middle") {
+        // Determine the mouse button
+        uint16_t button = MOUSE_BUTTON_LEFT;
+
+        if (args.key == "mouse_right") {
+            button = MOUSE_BUTTON_RIGHT;
+        }
+        else if (args.key == "mouse_middle") {
+            button = MOUSE_BUTTON_MIDDLE;
+        }
+
+        // Perform the requested action
+        if (args.action == "click") {
+            if constexpr (kLogging) {
+                std::cout << "    Mouse button " << (args.key == "mouse_left" ? "left" : args.key == "mouse_right" ? "right"
+                                                                                                                   : "middle")
+                          << " clicked\n";
+            }
+            enqueueEvent(InputEventType::MouseDown, button);
+            enqueueEvent(InputEventType::MouseUp, button);
+        }
+        else if (args.action == "doubleclick") {
+            if constexpr (kLogging) {
+                std::cout << "    Mouse button " << (args.key == "mouse_left" ? "left" : args.key == "mouse_right" ? "right"
+                                                                                                                   : "middle")
+                          << " double-clicked\n";
+            }
+            enqueueEvent(InputEventType::MouseDown, button);
+            enqueueEvent(InputEventType::MouseUp, button);
+            advanceTimeline(10);  // Short delay between clicks
+            enqueueEvent(InputEventType::MouseDown, button);
+            enqueueEvent(InputEventType::MouseUp, button);
+        }
+        else if (args.action == "keydown") {
+            if constexpr (kLogging) {
+                std::cout << "    Mouse button " << (args.key == "mouse_left" ? "left" : args.key == "mouse_right" ? "right"
+                                                                                                                   : "middle")
+                          << " key pressed\n";
+            }
+            enqueueEvent(InputEventType::MouseDown, button);
+        }
+        else if (args.action == "keyup") {
+            if constexpr (kLogging) {
+                std::cout << "    Mouse button " << (args.key == "mouse_left" ? "left" : args.key == "mouse_right" ? "right"
+                                                                                                                   : "middle")
+                          << " key released\n";
+            }
+            enqueueEvent(InputEventType::MouseUp, button);
+        }
+    }
+    // Handle wheel actions
+    else if (args.key == "wheel_up" || args.key == "wheel_down") {
+        if constexpr (kLogging) std::cout << "    Mouse wheel " << (args.key == "wheel_up" ? "up" : "down") << "\n";
+        int wheelDelta = (args.key == "wheel_up") ? WHEEL_DELTA : -WHEEL_DELTA;
+        enqueueEvent(InputEventType::Wheel, 0, 0, wheelDelta);
+    }
+    else if (args.key == "wheel") {
+        if constexpr (kLogging) std::cout << "    Mouse wheel by (" << static_cast<double>(args.wheelX) / WHEEL_DELTA << ", " << static_cast<double>(args.wheelY) / WHEEL_DELTA << ") notches\n";
+        if (args.smooth != "none" && args.smoothTime > 0) {
+            smoothScroll(args.wheelX, args.wheelY, args.smoothTime, easing);
+        }
+        else {
+            if (args.wheelY != 0) enqueueEvent(InputEventType::Wheel, 0, 0, args.wheelY);
+            if (args.wheelX != 0) enqueueEvent(InputEventType::Wheel, 0, args.wheelX, 0);
         }
-
-        // Calculate progress (0.0 to 1.0)
-        double elapsedMs = std::chrono::duration<double, std::milli>(currentTime - startTime).count();
-        double t = elapsedMs / duration;
-        if (t > 1.0) t = 1.0;
-
-        // Apply easing function
-        double easedT = calculateEasing(t, mode);
-
-        // Calculate new position
-        int x = startX + static_cast<int>((targetX - startX) * easedT);
-        int y = startY + static_cast<int>((targetY - startY) * easedT);
-
-        // Move the cursor
-        SetConsistentCursorPos(x, y);
-
-        // Sleep for next frame, but account for processing time
-        std::this_thread::sleep_for(frameTime);
     }
 
-    // Ensure we end up exactly at the target position
-    SetConsistentCursorPos(targetX, targetY);
+    // Return to original position if requested
+    if constexpr ((Features & EXECUTOR_BACK_MODE) != 0) {
+        if (args.smooth != "none" && args.key != "wheel") {
+            if constexpr (kLogging) std::cout << "    Smoothly moving mouse back: (" << targetX << ", " << targetY << ") -> (" << originalPos.x << ", " << originalPos.y << ")\n";
+            advanceTimeline(50);  // Small delay before moving back
+            smoothMoveMouse<Features>(originalPos.x, originalPos.y, args.smoothTime, easing);
+        }
+        else {
+            if constexpr (kLogging) std::cout << "    Moving mouse back: (" << targetX << ", " << targetY << ") -> (" << originalPos.x << ", " << originalPos.y << ")\n";
+            SetConsistentCursorPos<Features>(originalPos.x, originalPos.y);
+        }
+    }
 }
 
-// Function to simulate a mouse event
+// Function to simulate a mouse event, specialized over the run's ExecutorFeatures
+template <unsigned Features>
 void simulateEvent(const CommandLineArgs& args) {
-    if (verbose) {
+    constexpr bool kLogging = (Features & EXECUTOR_LOGGING) != 0;
+
+    if constexpr (kLogging) {
         std::cout << "Execute: ";
         std::cout << "(" << args.key << ", " << args.action << ") @ (" << args.x << ", " << args.y << ") | ";
         std::cout << "Mode: " << args.mode << " | ";
@@ -604,209 +2026,177 @@ void simulateEvent(const CommandLineArgs& args) {
         std::cout << "Smooth: (" << args.smooth << ", " << args.smoothTime << ")\n";
     }
 
-    POINT originalPos;
-    GetConsistentCursorPos(&originalPos);
+    // Never stamp events in the past if parsing or logging fell behind
+    timeline = std::max(timeline, InjectClock::now());
 
-    // Handle mouse operations
-    if (args.key.substr(0, 6) == "mouse_" || args.key.substr(0, 6) == "wheel_") {
-        int targetX = args.x;
-        int targetY = args.y;
-
-        // If -1 was specified, keep the current coordinate
-        targetX = (targetX != -1) ? targetX : originalPos.x;
-        targetY = (targetY != -1) ? targetY : originalPos.y;
+    // Screen searches and waits work in screen coordinates, and switch_focus takes the focus
+    if ((!args.findTemplate.empty() || args.key == "wait_pixel" || args.key == "wait_region_change" || args.key == "switch_focus") && targetsWindows()) {
+        if (!quiet) std::cout << "Warning: -find, screen waits and switch_focus are not supported with -w. Skipping command.\n";
+        return;
+    }
 
-        // Move mouse to target position, either smoothly or instantly
-        if (args.smooth != "none") {
-            if (verbose) std::cout << "    Smoothly moving mouse: (" << originalPos.x << ", " << originalPos.y << ") -> (" << targetX << ", " << targetY << ")\n";
-            smoothMoveMouse(targetX, targetY, args.smoothTime, args.smooth);
-        }
-        else {
-            if (verbose) std::cout << "    Moving mouse: (" << originalPos.x << ", " << originalPos.y << ") -> (" << targetX << ", " << targetY << ")\n";
-            SetConsistentCursorPos(targetX, targetY);
+    // Resolve a template search into target coordinates before anything moves
+    int argX = args.x;
+    int argY = args.y;
+    if (!args.findTemplate.empty()) {
+        waitForTimeline();  // The screen has to show the effect of earlier input
+        if (!findOnScreen(args.findTemplate, args.threshold, argX, argY)) {
+            if (!quiet) std::cout << "Warning: Template " << args.findTemplate << " not found on screen. Skipping command.\n";
+            return;
         }
+    }
 
-        // Handle mouse button actions
-        if (args.key == "mouse_left" || args.key == "mouse_right" || args.key == "mouse_middle") {
-            // Determine the appropriate mouse event constants
-            DWORD mouseDownFlag = 0;
-            DWORD mouseUpFlag = 0;
-
-            if (args.key == "mouse_left") {
-                mouseDownFlag = MOUSEEVENTF_LEFTDOWN;
-                mouseUpFlag = MOUSEEVENTF_LEFTUP;
-            }
-            else if (args.key == "mouse_right") {
-                mouseDownFlag = MOUSEEVENTF_RIGHTDOWN;
-                mouseUpFlag = MOUSEEVENTF_RIGHTUP;
-            }
-            else if (args.key == "mouse_middle") {
-                mouseDownFlag = MOUSEEVENTF_MIDDLEDOWN;
-                mouseUpFlag = MOUSEEVENTF_MIDDLEUP;
-            }
+    enqueueEvent(InputEventType::Marker, MARKER_COMMAND_BEGIN, static_cast<int>(commandLine));
+    // With --lock the injection thread may wait for the lock at this marker. The rest of the command is
+    // stamped once it holds the lock; stamped before, it would all be due at once and go out in one burst.
+    if (lockScope != "none") waitForTimeline();
 
-            // Perform the requested action
-            if (args.action == "click") {
-                if (verbose) {
-                    std::cout << "    Mouse button " << (args.key == "mouse_left" ? "left" : args.key == "mouse_right" ? "right"
-                                                                                                                       : "middle")
-                              << " clicked\n";
-                }
-                mouse_event(mouseDownFlag, 0, 0, 0, 0);
-                mouse_event(mouseUpFlag, 0, 0, 0, 0);
-            }
-            else if (args.action == "doubleclick") {
-                if (verbose) {
-                    std::cout << "    Mouse button " << (args.key == "mouse_left" ? "left" : args.key == "mouse_right" ? "right"
-                                                                                                                       : "middle")
-                              << " double-clicked\n";
-                }
-                mouse_event(mouseDownFlag, 0, 0, 0, 0);
-                mouse_event(mouseUpFlag, 0, 0, 0, 0);
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));  // Short delay between clicks
-                mouse_event(mouseDownFlag, 0, 0, 0, 0);
-                mouse_event(mouseUpFlag, 0, 0, 0, 0);
-            }
-            else if (args.action == "keydown") {
-                if (verbose) {
-                    std::cout << "    Mouse button " << (args.key == "mouse_left" ? "left" : args.key == "mouse_right" ? "right"
-                                                                                                                       : "middle")
-                              << " key pressed\n";
-                }
-                mouse_event(mouseDownFlag, 0, 0, 0, 0);
-            }
-            else if (args.action == "keyup") {
-                if (verbose) {
-                    std::cout << "    Mouse button " << (args.key == "mouse_left" ? "left" : args.key == "mouse_right" ? "right"
-                                                                                                                       : "middle")
-                              << " key released\n";
-                }
-                mouse_event(mouseUpFlag, 0, 0, 0, 0);
-            }
-        }
-        // Handle wheel actions
-        else if (args.key == "wheel_up" || args.key == "wheel_down") {
-            if (verbose) std::cout << "    Mouse wheel " << (args.key == "wheel_up" ? "up" : "down") << "\n";
-            int wheelDelta = (args.key == "wheel_up") ? WHEEL_DELTA : -WHEEL_DELTA;
-            mouse_event(MOUSEEVENTF_WHEEL, 0, 0, wheelDelta, 0);
-        }
+    // Only mouse commands and screen waits start from the cursor position; key commands never query it
+    POINT originalPos = {0, 0};
+    if (args.key.substr(0, 6) == "mouse_" || args.key.substr(0, 5) == "wheel" || args.key.substr(0, 5) == "wait_") {
+        GetConsistentCursorPos<Features>(&originalPos);
+    }
 
-        // Return to original position if requested
-        if (args.mode == "back") {
-            if (args.smooth != "none") {
-                if (verbose) std::cout << "    Smoothly moving mouse back: (" << targetX << ", " << targetY << ") -> (" << originalPos.x << ", " << originalPos.y << ")\n";
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));  // Small delay before moving back
-                smoothMoveMouse(originalPos.x, originalPos.y, args.smoothTime, args.smooth);
-            }
-            else {
-                if (verbose) std::cout << "    Moving mouse back: (" << targetX << ", " << targetY << ") -> (" << originalPos.x << ", " << originalPos.y << ")\n";
-                SetConsistentCursorPos(originalPos.x, originalPos.y);
-            }
-        }
+    // Handle mouse operations; back mode picks its own specialization
+    if (args.key.substr(0, 6) == "mouse_" || args.key.substr(0, 5) == "wheel") {
+        if (args.mode == "back")
+            simulateMouse<Features | EXECUTOR_BACK_MODE>(args, argX, argY, originalPos);
+        else
+            simulateMouse<Features>(args, argX, argY, originalPos);
     }
-    // Handle keyboard operations
-    else if (args.key.substr(0, 4) == "key_" && keyCodeMap.find(args.key) != keyCodeMap.end()) {
-        WORD keyCode = keyCodeMap[args.key];
+    // Handle keyboard operations; single keys and chords compile into one batch the injector submits together
+    else if (!args.chords.empty()) {
+        std::string keyName = (args.key.substr(0, 4) == "key_") ? args.key.substr(4) : args.key;
+        ChordAction action = ChordAction::Click;
 
         if (args.action == "click") {
-            // Press and release
-            if (verbose) std::cout << "    Key " << args.key.substr(4) << " clicked\n";
-            keybd_event(static_cast<BYTE>(keyCode), 0, 0, 0);
-            keybd_event(static_cast<BYTE>(keyCode), 0, KEYEVENTF_KEYUP, 0);
+            // Press in order, release in reverse
+            if constexpr (kLogging) std::cout << "    Key " << keyName << " clicked\n";
         }
         else if (args.action == "doubleclick") {
             // Press and release twice
-            if (verbose) std::cout << "    Key " << args.key.substr(4) << " double-clicked\n";
-            keybd_event(static_cast<BYTE>(keyCode), 0, 0, 0);
-            keybd_event(static_cast<BYTE>(keyCode), 0, KEYEVENTF_KEYUP, 0);
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            keybd_event(static_cast<BYTE>(keyCode), 0, 0, 0);
-            keybd_event(static_cast<BYTE>(keyCode), 0, KEYEVENTF_KEYUP, 0);
+            if constexpr (kLogging) std::cout << "    Key " << keyName << " double-clicked\n";
+            action = ChordAction::DoubleClick;
         }
         else if (args.action == "keydown") {
             // Only press
-            if (verbose) std::cout << "    Key " << args.key.substr(4) << " pressed down\n";
-            keybd_event(static_cast<BYTE>(keyCode), 0, 0, 0);
+            if constexpr (kLogging) std::cout << "    Key " << keyName << " pressed down\n";
+            action = ChordAction::Press;
         }
         else if (args.action == "keyup") {
             // Only release
-            if (verbose) std::cout << "    Key " << args.key.substr(4) << " released\n";
-            keybd_event(static_cast<BYTE>(keyCode), 0, KEYEVENTF_KEYUP, 0);
+            if constexpr (kLogging) std::cout << "    Key " << keyName << " released\n";
+            action = ChordAction::Release;
+        }
+
+        std::vector<InputEvent> events;
+        compileChords(args.chords, action, std::chrono::milliseconds(args.keyGap), heldKeys, timeline, events);
+        injector->pushGroup(events);
+    }
+    // Handle touch gestures
+    else if (args.key.substr(0, 6) == "touch_") {
+        simulateTouch<Features>(args);
+    }
+    // Handle screen waits
+    else if (args.key == "wait_pixel" || args.key == "wait_region_change") {
+        PixelRect region;
+        region.x = (args.x != -1) ? args.x : originalPos.x;
+        region.y = (args.y != -1) ? args.y : originalPos.y;
+        region.width = args.regionWidth;
+        region.height = args.regionHeight;
+
+        // The screen only reflects input that has already been injected
+        waitForTimeline();
+
+        WaitResult result;
+        if (args.key == "wait_pixel") {
+            if constexpr (kLogging) std::cout << "    Waiting up to " << args.timeout << " ms for color " << std::hex << args.color << std::dec << " at (" << region.x << ", " << region.y << ") " << region.width << "x" << region.height << "\n";
+            result = waitForColor(getFrameSource(), region, static_cast<uint32_t>(args.color), static_cast<uint8_t>(args.tolerance), std::chrono::milliseconds(args.timeout));
+        }
+        else {
+            if constexpr (kLogging) std::cout << "    Waiting up to " << args.timeout << " ms for a change at (" << region.x << ", " << region.y << ") " << region.width << "x" << region.height << "\n";
+            result = waitForRegionChange(getFrameSource(), region, static_cast<uint8_t>(args.tolerance), std::chrono::milliseconds(args.timeout));
         }
+        if (result == WaitResult::CaptureFailed && !quiet) std::cout << "Error: Could not capture the screen for " << args.key << ".\n";
+        if (result == WaitResult::TimedOut && !quiet) std::cout << "Warning: " << args.key << " timed out after " << args.timeout << " ms.\n";
+
+        timeline = InjectClock::now();
     }
     // Handle switch focus operation
     else if (args.key == "switch_focus") {
         DWORD sleepTime = (args.smoothTime > 0) ? args.smoothTime : 0;  // Default to 0 ms if no sleep specified
-        if (verbose) std::cout << "    Switching focus to the temporary window for " << sleepTime << " ms\n";
+        if constexpr (kLogging) std::cout << "    Switching focus to the temporary window for " << sleepTime << " ms\n";
+        // Focus switching runs on this thread, so let queued input land first
+        waitForTimeline();
         if (!SwitchFocus(sleepTime)) {
             if (!quiet) std::cout << "Error: Failed to switch focus.\n";
         }
+        timeline = InjectClock::now();
     }
 
+    // The command ends with its last event, so --lock command does not hold the lock through the sleep after it
+    enqueueEvent(InputEventType::Marker, MARKER_COMMAND_END);
+
     // Sleep if requested
     if (args.sleep > 0) {
-        if (verbose) std::cout << "    Sleeping for " << args.sleep << " ms\n";
-        std::this_thread::sleep_for(std::chrono::milliseconds(args.sleep));
-        if (args.key == "none") return;  // If only sleep was requested, exit early
+        if constexpr (kLogging) std::cout << "    Sleeping for " << args.sleep << " ms\n";
+        advanceTimeline(args.sleep);
     }
 
     // If key is "none", only sleep was needed, so we're done
-    if (args.key == "none") {
-        if (verbose) std::cout << "    No key specified. Exiting.\n";
+    if (args.key == "none" && args.sleep == 0) {
+        if constexpr (kLogging) std::cout << "    No key specified. Exiting.\n";
         return;
     }
 }
 
-// Function to process a file with commands
-void processCommandFile(const std::string& filePath) {
+// Line number a --from value names, or 0 if it names a label
+int parseStartLine(const std::string& from) {
+    if (from.empty() || !std::all_of(from.begin(), from.end(), [](unsigned char c) { return std::isdigit(c); })) return 0;
+    try {
+        return std::stoi(from);
+    } catch (...) {
+        return 0;
+    }
+}
+
+// Function to parse a file with commands, keeping those from the --from label or line on;
+// false if it cannot be read or a line is invalid
+bool loadCommandFile(const std::string& filePath, std::vector<CommandLineArgs>& commands, const std::string& from = "") {
     if (verbose) std::cout << "Processing command file: " << filePath << "\n";
 
     std::ifstream inputFile(filePath);
     if (!inputFile.is_open()) {
         if (!quiet) std::cout << "Error: Could not open file: " << filePath << "\n";
-        return;
+        return false;
     }
 
-    std::vector<CommandLineArgs> commands;
-
     std::string line;
     int lineNumber = 0;
+    int startLine = parseStartLine(from);
+    bool started = from.empty();
 
     while (std::getline(inputFile, line)) {
         lineNumber++;
+        if (startLine > 0 && lineNumber >= startLine) started = true;
         if (line.empty() || line[0] == '#') {
             // Skip empty lines and comments
             continue;
         }
 
+        // Labels only mark where a run can start
+        std::string label;
+        if (parseScriptLabel(line, label)) {
+            if (label == from) started = true;
+            continue;
+        }
+
         if (verbose) std::cout << "Processing line " << lineNumber << ": " << line << "\n";
 
         // Split line into arguments
         std::vector<std::string> args = {"program_name"};  // First arg is program name
-        std::string currentArg;
-        bool inQuotes = false;
-
-        for (size_t i = 0; i < line.size(); i++) {
-            char c = line[i];
-
-            if (c == '"') {
-                inQuotes = !inQuotes;
-                continue;
-            }
-
-            if (c == ' ' && !inQuotes) {
-                if (!currentArg.empty()) {
-                    args.push_back(currentArg);
-                    currentArg.clear();
-                }
-            }
-            else {
-                currentArg += c;
-            }
-        }
-
-        if (!currentArg.empty()) {
-            args.push_back(currentArg);
+        for (std::string& arg : splitScriptLine(line)) {
+            args.push_back(std::move(arg));
         }
 
         if (args.size() > 1) {
@@ -818,26 +2208,558 @@ void processCommandFile(const std::string& filePath) {
 
             // Parse and execute the command
             CommandLineArgs cmdArgs = parseCommandLine(static_cast<int>(cArgs.size()), cArgs.data());
+            cmdArgs.sourceLine = lineNumber;
             if (cmdArgs.validArgs) {
-                commands.push_back(cmdArgs);
+                if (started) commands.push_back(cmdArgs);
             }
             else {
                 if (!quiet) std::cout << "Invalid arguments in line " << lineNumber << ".\n";
-                return;
+                return false;
             }
         }
     }
 
     inputFile.close();
+    if (!started) {
+        if (!quiet) std::cout << "Error: No label or line '" << from << "' in " << filePath << ".\n";
+        return false;
+    }
     if (commands.empty()) {
         if (!quiet) std::cout << "No valid commands found in file.\n";
+        return false;
+    }
+    return true;
+}
+
+// Per-line counters of the --profile run and the command file they belong to, null without --profile
+std::unique_ptr<ScriptProfile> scriptProfile;
+std::string profiledFile;
+
+// Runs a command read from a command file line; with EXECUTOR_TRACING it adds what the command
+// cost to that line's --profile counters
+template <unsigned Features>
+struct CommandRunner {
+    static void run(const CommandLineArgs& args, int line) {
+        commandLine = static_cast<uint32_t>(line);
+        if constexpr ((Features & EXECUTOR_TRACING) != 0) {
+            auto begin = timeline;
+            auto start = InjectClock::now();
+            simulateEvent<Features>(args);
+            scriptProfile->command(commandLine, timeline - begin, std::chrono::milliseconds(args.sleep), InjectClock::now() - start);
+        }
+        else {
+            simulateEvent<Features>(args);
+        }
+    }
+};
+
+using CommandHandler = void (*)(const CommandLineArgs&, int);
+
+// One command handler per combination of -v, -c and --profile
+constexpr auto kCommandHandlers = executorSpecializations<CommandRunner>();
+
+// The handler compiled for this run's options; they are fixed once the command line is parsed
+CommandHandler selectCommandHandler() {
+    unsigned features = 0;
+    if (verbose) features |= EXECUTOR_LOGGING;
+    if (consistent) features |= EXECUTOR_CONSISTENT;
+    if (scriptProfile) features |= EXECUTOR_TRACING;
+    return kCommandHandlers[features];
+}
+
+// Write the --profile report: the command file as it is now, annotated, then the hot lines
+void writeProfile() {
+    if (!scriptProfile) return;
+
+    std::vector<std::string> source;
+    std::ifstream script(profiledFile);
+    std::string line;
+    while (std::getline(script, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        source.push_back(line);
+    }
+
+    std::ofstream out(profileFile, std::ios::trunc);
+    if (!out.is_open()) {
+        if (!quiet) std::cout << "Error: Could not open profile file: " << profileFile << "\n";
         return;
     }
+    scriptProfile->write(out, profiledFile, source);
+}
+
+// Function to process a file with commands
+void processCommandFile(const std::string& filePath, const std::string& from) {
+    std::vector<CommandLineArgs> commands;
+    if (!loadCommandFile(filePath, commands, from)) return;
 
     // Execute all commands from the file
     if (verbose) std::cout << "Executing commands from file...\n";
+    CommandHandler runCommand = selectCommandHandler();
     for (const auto& cmdArgs : commands) {
-        simulateEvent(cmdArgs);
+        runCommand(cmdArgs, cmdArgs.sourceLine);
+    }
+}
+
+// Parse one command file line the way processCommandFile does, without printing or touching globals.
+// Problems are appended to diagnostics; labels and lines with problems yield an invalid command.
+CommandLineArgs parseScriptLine(const std::string& line, std::vector<ScriptDiagnostic>& diagnostics) {
+    CommandLineArgs none;
+    none.validArgs = false;
+
+    std::string label;
+    if (parseScriptLabel(line, label)) {
+        if (label.empty() || label.find_first_of(" \t") != std::string::npos) {
+            diagnostics.push_back({"", 0, 1, "Label names must be a single word."});
+        }
+        return none;
+    }
+
+    std::vector<int> columns;
+    std::vector<std::string> args = splitScriptLine(line, &columns);
+
+    // An odd number of quotes silently swallows the rest of the line when run
+    size_t quotes = std::count(line.begin(), line.end(), '"');
+    if (quotes % 2 != 0) {
+        diagnostics.push_back({"", 0, static_cast<int>(line.rfind('"')) + 1, "Unterminated quote."});
+    }
+    if (args.empty()) return none;
+
+    std::string programName = "program_name";
+    std::vector<char*> cArgs = {&programName[0]};
+    for (auto& arg : args) {
+        cArgs.push_back(&arg[0]);
+    }
+
+    std::vector<ArgumentDiagnostic> problems;
+    CommandLineArgs cmdArgs = parseCommandLine(static_cast<int>(cArgs.size()), cArgs.data(), &problems);
+    for (const ArgumentDiagnostic& problem : problems) {
+        int column = (problem.index > 0) ? columns[problem.index - 1] : 1;
+        diagnostics.push_back({"", 0, column, problem.message});
+    }
+    if (problems.empty() && !cmdArgs.validArgs) {
+        diagnostics.push_back({"", 0, 1, "Command does nothing: it needs a key, a sleep or a file."});
+    }
+    if (!cmdArgs.checkPaths.empty()) {
+        diagnostics.push_back({"", 0, 1, "--check cannot be used inside a command file."});
+    }
+    if (!cmdArgs.displays.empty()) {
+        diagnostics.push_back({"", 0, 1, "--displays cannot be used inside a command file."});
+    }
+    if (!cmdArgs.windows.empty()) {
+        diagnostics.push_back({"", 0, 1, "-w cannot be used inside a command file."});
+    }
+    if (cmdArgs.watch) {
+        diagnostics.push_back({"", 0, 1, "--watch cannot be used inside a command file."});
+    }
+    if (cmdArgs.probeSamples > 0) {
+        diagnostics.push_back({"", 0, 1, "--probe cannot be used inside a command file."});
+    }
+    if (!cmdArgs.profileFile.empty()) {
+        diagnostics.push_back({"", 0, 1, "--profile cannot be used inside a command file."});
+    }
+    if (cmdArgs.lockScope != "none") {
+        diagnostics.push_back({"", 0, 1, "--lock cannot be used inside a command file."});
+    }
+    return cmdArgs;
+}
+
+// Validate one command file line without printing or touching globals
+void validateScriptLine(const std::string& line, std::vector<ScriptDiagnostic>& diagnostics) {
+    parseScriptLine(line, diagnostics);
+}
+
+// Validate command files across all cores and print every problem; returns the process exit code
+int checkCommandFiles(const std::vector<std::string>& paths) {
+    auto start = std::chrono::steady_clock::now();
+    ScriptCheckResult result = checkScripts(paths, validateScriptLine);
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    for (const ScriptDiagnostic& diagnostic : result.diagnostics) {
+        std::cout << formatDiagnostic(diagnostic) << "\n";
+    }
+    if (!quiet) {
+        std::cout << "Checked " << result.files << " files (" << result.lines << " lines) in " << elapsedMs << " ms: ";
+        std::cout << result.diagnostics.size() << " errors\n";
+    }
+    return result.diagnostics.empty() ? 0 : 1;
+}
+
+// How long the ring server sleeps at most before looking for a stop request again
+constexpr auto kRingIdleTimeout = std::chrono::milliseconds(100);
+
+CommandRingServer commandRing;
+
+// Check a command from a client before it reaches a backend, which trusts codes to be in range
+bool toInputEvent(const RingCommand& command, InputEvent& event) {
+    auto type = static_cast<InputEventType>(command.type);
+    switch (type) {
+        case InputEventType::MouseDown:
+        case InputEventType::MouseUp:
+            if (command.code > MOUSE_BUTTON_MIDDLE) return false;
+            break;
+        case InputEventType::KeyDown:
+        case InputEventType::KeyUp:
+            if (command.code >= KeyState().size()) return false;
+            break;
+        case InputEventType::TouchDown:
+        case InputEventType::TouchMove:
+        case InputEventType::TouchUp:
+            if (command.code >= kMaxTouchContacts) return false;
+            break;
+        case InputEventType::MouseMove:
+        case InputEventType::Wheel:
+            break;
+        default:
+            // Markers included: command boundaries take and release the input lock, which is not a client's to hold
+            return false;
+    }
+
+    event.type = type;
+    event.flags = command.flags & (EVENT_FLAG_FRAME | EVENT_FLAG_GROUPED);
+    event.code = command.code;
+    event.x = command.x;
+    event.y = command.y;
+    event.deadline = (command.deadlineNs != 0)
+                         ? InjectClock::time_point(std::chrono::duration_cast<InjectClock::duration>(std::chrono::nanoseconds(command.deadlineNs)))
+                         : InjectClock::now();
+    return true;
+}
+
+// Inject commands that clients on this host push into the shared-memory ring, until one asks to stop.
+// Commands go to the injection thread in ring order, so a deadline in the future holds back those behind it.
+// A group is held back until its last command arrives: the injection thread waits for the rest of a group
+// it has started, and a client may stop before finishing one. A group with a rejected command is dropped whole.
+void serveCommandRing(const std::string& name) {
+    if (!commandRing.create(name)) {
+        if (!quiet) std::cout << "Error: Could not create shared memory " << name << "; is another server using it?\n";
+        return;
+    }
+    if (verbose) std::cout << "Serving commands on shared memory " << name << "\n";
+
+    uint64_t served = 0;
+    uint64_t rejected = 0;
+    RingCommand command;
+    InputEvent event;
+    std::vector<InputEvent> group;
+    bool dropping = false;  // The rest of a group with a rejected command is still to come
+    auto reject = [&] {
+        rejected += group.size() + 1;
+        group.clear();
+        dropping = (command.flags & EVENT_FLAG_GROUPED) != 0;
+    };
+    for (;;) {
+        if (commandRing.tryPop(command)) {
+            if (dropping || !toInputEvent(command, event)) {
+                reject();
+                continue;
+            }
+            if (event.type == InputEventType::TouchDown || event.type == InputEventType::TouchMove || event.type == InputEventType::TouchUp) {
+                // The touch device is opened on the first touch command, as a script would
+                bool created = false;
+                if (windowBackend || (recordFile.empty() && !openTouchDevice(created))) {
+                    reject();
+                    continue;
+                }
+                if (created) event.deadline = std::max(event.deadline, InjectClock::now() + std::chrono::milliseconds(kTouchDeviceSettle));
+            }
+            group.push_back(event);
+            if (event.flags & EVENT_FLAG_GROUPED) continue;
+            for (const InputEvent& grouped : group) injector->push(grouped);
+            served += group.size();
+            group.clear();
+            continue;
+        }
+        if (commandRing.stopRequested()) break;
+        commandRing.wait(kRingIdleTimeout);
+    }
+
+    // A group the client never finished ends with its last command
+    if (!group.empty()) {
+        group.back().flags &= ~EVENT_FLAG_GROUPED;
+        for (const InputEvent& grouped : group) injector->push(grouped);
+        served += group.size();
+    }
+
+    if (verbose) {
+        std::cout << "Served " << served << " commands (" << rejected << " rejected) with " << commandRing.wakeups() << " wakeups\n";
+    }
+    commandRing.close();
+}
+
+// Name of a virtual key code for compiled scripts; "" if it has none
+std::string keyNameOf(uint16_t code) {
+    for (const KeyName& key : kKeyNames) {
+        if (key.code == code) return std::string(key.name);
+    }
+    return "";
+}
+
+// Compile a --record-file recording into a command file and report how much smaller it got; returns the exit code
+int compileRecordingFile(const CommandLineArgs& args) {
+    std::ifstream input(args.compileInput);
+    if (!input.is_open()) {
+        if (!quiet) std::cout << "Error: Could not open recording: " << args.compileInput << "\n";
+        return 1;
+    }
+    std::vector<RecordedEvent> events;
+    int line = 0;
+    if (!readRecording(input, events, line)) {
+        if (!quiet) std::cout << "Error: " << args.compileInput << ":" << line << ": Not a recorded event.\n";
+        return 1;
+    }
+
+    RecordingCompileOptions options;
+    options.tolerance = args.pathTolerance;
+    RecordingCompiler compiler(options, keyNameOf);
+    compiler.compile(events);
+
+    std::ofstream output(args.compileOutput, std::ios::trunc);
+    if (!output.is_open()) {
+        if (!quiet) std::cout << "Error: Could not write command file: " << args.compileOutput << "\n";
+        return 1;
+    }
+    output << "# Compiled from " << args.compileInput << " with a path tolerance of " << args.pathTolerance << " px\n";
+    compiler.write(output);
+
+    const RecordingCompileStats& stats = compiler.result();
+    if (!quiet) {
+        double ratio = static_cast<double>(stats.events) / static_cast<double>(std::max<size_t>(stats.commands, 1));
+        std::ios::fmtflags flags = std::cout.flags();
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "Compiled " << stats.events << " events into " << stats.commands << " commands (" << ratio << "x fewer)\n";
+        std::cout << "    Motion: " << stats.pathPoints << " positions simplified to " << stats.waypoints << " waypoints, max deviation "
+                  << stats.maxDeviation << " px\n";
+        if (stats.skipped > 0) std::cout << "    Skipped " << stats.skipped << " events with no command equivalent (touch, unnamed keys)\n";
+        std::cout.flags(flags);
+    }
+    return 0;
+}
+
+// How far ahead of its deadline a watched run enqueues the next command
+constexpr auto kWatchLookahead = std::chrono::milliseconds(50);
+
+// Compile one line of a watched command file
+void compileScriptLine(const std::string& line, CompiledLine<CommandLineArgs>& compiled) {
+    if (line.empty() || line[0] == '#') return;
+    parseScriptLabel(line, compiled.label);
+    CommandLineArgs cmdArgs = parseScriptLine(line, compiled.diagnostics);
+    if (compiled.diagnostics.empty() && cmdArgs.validArgs) compiled.command = std::move(cmdArgs);
+}
+
+// Read the watched file into buffer and bring the compiled script up to date; false if it could not be
+// read or did not change. The buffer is handed back and forth with the script, so reloads do not allocate.
+bool reloadWatchedScript(const std::string& filePath, IncrementalScript<CommandLineArgs>& script, std::string& buffer) {
+    std::ifstream input(filePath, std::ios::binary | std::ios::ate);
+    if (!input.is_open()) {
+        if (!quiet) std::cout << "Error: Could not open file: " << filePath << "\n";
+        return false;
+    }
+    buffer.resize(static_cast<size_t>(std::max<std::streamoff>(0, input.tellg())));
+    input.seekg(0);
+    input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    buffer.resize(static_cast<size_t>(input.gcount()));
+
+    auto start = std::chrono::steady_clock::now();
+    ScriptUpdate update = script.update(buffer);
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!update.changed) return false;
+
+    if (!quiet) {
+        std::cout << filePath << ": lines " << update.firstLine + 1 << "-" << update.firstLine + update.lineCount << " changed, ";
+        std::cout << update.compiled << " compiled in " << elapsedMs << " ms\n";
+    }
+    for (const ScriptDiagnostic& diagnostic : script.diagnostics(filePath, update.firstLine, update.lineCount)) {
+        std::cout << formatDiagnostic(diagnostic) << "\n";
+    }
+    if (script.errorCount() > 0 && !quiet) std::cout << script.errorCount() << " errors; waiting for the next save\n";
+    return true;
+}
+
+// First line to run, from a --from label or line number; lineCount() if there is none
+size_t findStartLine(const IncrementalScript<CommandLineArgs>& script, const std::string& from) {
+    if (from.empty()) return 0;
+    int startLine = parseStartLine(from);
+    size_t index = (startLine > 0) ? static_cast<size_t>(startLine - 1) : script.findLabel(from);
+    if (index >= script.lineCount() && !quiet) std::cout << "Error: No label or line '" << from << "' in the command file.\n";
+    return index;
+}
+
+// Stop a watched run: drop the events it queued, then release what it left held
+void stopWatchedRun() {
+    injector->discard();
+    timeline = InjectClock::now();
+    for (size_t code = 0; code < heldKeys.size(); code++) {
+        if (heldKeys[code]) enqueueEvent(InputEventType::KeyUp, static_cast<uint16_t>(code));
+    }
+    heldKeys.reset();
+    for (uint16_t button = 0; button < heldButtons.size(); button++) {
+        if (heldButtons[button]) enqueueEvent(InputEventType::MouseUp, button);
+    }
+    for (uint16_t contact = 0; contact < heldTouches.size(); contact++) {
+        if (heldTouches[contact]) enqueueEvent(InputEventType::TouchUp, contact);
+    }
+    heldTouches.reset();
+    waitForTimeline();
+    lastPosKnown = false;
+}
+
+/**
+ * @brief Run a command file and run it again every time it is saved, until interrupted
+ *
+ * The file is compiled once into an IncrementalScript; each save only recompiles the
+ * edited lines. A save stops the current run and restarts it from --from (or the first
+ * line) on the same connection and injection thread, so nothing of startup is repeated.
+ * A script with errors is not run until a later save fixes them.
+ */
+void watchCommandFile(const CommandLineArgs& args) {
+    FileWatcher watcher;
+    if (!watcher.open(args.file)) {
+        if (!quiet) std::cout << "Error: Could not watch file: " << args.file << "\n";
+        return;
+    }
+
+    IncrementalScript<CommandLineArgs> script(compileScriptLine);
+    std::string buffer;
+    reloadWatchedScript(args.file, script, buffer);
+    size_t next = (script.errorCount() == 0) ? findStartLine(script, args.from) : script.lineCount();
+    if (verbose) std::cout << "Watching " << args.file << " for changes\n";
+
+    CommandHandler runCommand = selectCommandHandler();
+    for (;;) {
+        // Sleeps become waits for the next save, so an edit interrupts them
+        bool changed = false;
+        bool running = next < script.lineCount();
+        do {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(timeline - kWatchLookahead - InjectClock::now());
+            if (running && remaining.count() <= 0) break;
+            auto timeout = running ? std::min(remaining, std::chrono::milliseconds(1000)) : std::chrono::milliseconds(1000);
+            changed = watcher.wait(timeout) && reloadWatchedScript(args.file, script, buffer);
+        } while (!changed);
+
+        if (changed) {
+            stopWatchedRun();
+            next = (script.errorCount() == 0) ? findStartLine(script, args.from) : script.lineCount();
+            if (verbose && next < script.lineCount()) std::cout << "Restarting at line " << next + 1 << "\n";
+            continue;
+        }
+
+        const CompiledLine<CommandLineArgs>& line = script.line(next++);
+        if (line.command) runCommand(*line.command, static_cast<int>(next));
+    }
+}
+
+// Time before the first probe click, for the listener to settle
+constexpr auto kProbeLeadIn = std::chrono::milliseconds(200);
+
+// Time after the last probe click to wait for late deliveries
+constexpr auto kProbeDrain = std::chrono::milliseconds(1000);
+
+// Results of the --probe run, also reported by --stats
+std::unique_ptr<LatencyProbe> latencyProbe;
+
+// Name of this machine, to tell probe reports from different hosts apart
+std::string hostName() {
+    char name[256] = {};
+#ifdef _WIN32
+    DWORD size = sizeof(name);
+    if (!GetComputerNameA(name, &size)) return "unknown";
+#else
+    if (gethostname(name, sizeof(name) - 1) != 0) return "unknown";
+#endif
+    return name;
+}
+
+/**
+ * @brief Inject --probe tagged clicks at --probe-rate and report how long each took to arrive
+ *
+ * Clicks are scheduled on the timeline like any command, so the latency covers the whole
+ * path: injection thread wake-up, backend call, the system and delivery to a window.
+ */
+void runProbe(const CommandLineArgs& args) {
+    POINT cursor;
+    if (consistent)
+        GetConsistentCursorPos<EXECUTOR_CONSISTENT>(&cursor);
+    else
+        GetConsistentCursorPos<0>(&cursor);
+    int x = (args.x != -1) ? args.x : cursor.x;
+    int y = (args.y != -1) ? args.y : cursor.y;
+
+    latencyProbe = std::make_unique<LatencyProbe>(static_cast<size_t>(args.probeSamples), args.probeRate, x, y);
+    LatencyProbe& probe = *latencyProbe;
+    probe.begin(InjectClock::now() + kProbeLeadIn);
+
+    ProbeListener listener;
+    if (!listener.start(probe)) {
+        if (!quiet) std::cout << "Error: Could not start the probe listener.\n";
+        return;
+    }
+    if (verbose) std::cout << "Probing with " << probe.count() << " clicks at " << args.probeRate << "/s at (" << x << ", " << y << ")\n";
+
+    std::vector<InputEvent> click(3);
+    click[0].type = InputEventType::MouseMove;
+    click[1].type = InputEventType::MouseDown;
+    click[2].type = InputEventType::MouseUp;
+    for (size_t i = 0; i < probe.count(); i++) {
+        for (InputEvent& event : click) {
+            event.deadline = probe.deadline(i);
+            event.flags = 0;
+        }
+        click[0].x = probe.x(i);
+        click[0].y = probe.y(i);
+        injector->pushGroup(click);
+    }
+
+    timeline = probe.deadline(probe.count() - 1) + kProbeDrain;
+    waitForTimeline();
+    listener.stop();
+
+    if (!quiet) {
+        std::ostringstream title;
+        title << "Probe: " << probe.count() << " clicks at " << args.probeRate << "/s on " << hostName() << " (" << kBackendName << " backend)";
+        probe.writeReport(std::cout, title.str());
+    }
+}
+
+/**
+ * @brief Run the command (or command file) against every --displays or -w target at once
+ *
+ * The commands are parsed once and shared read-only. Each target, display or window alike, gets
+ * an executor thread with its own timeline, cursor state and injection thread, the latter on a
+ * core of its own while there are enough; target i starts i * offsetMs later.
+ */
+void runOnDisplays(const CommandLineArgs& args) {
+    std::vector<CommandLineArgs> commands;
+    if (args.file.empty())
+        commands.push_back(args);
+    else if (!loadCommandFile(args.file, commands, args.from))
+        return;
+
+    if (verbose)
+        std::cout << "Running " << commands.size() << " commands on " << displayTargets.size() << (displayTargets[0]->window ? " windows\n" : " displays\n");
+
+    auto start = InjectClock::now();
+    CommandHandler runCommand = selectCommandHandler();
+    std::vector<std::thread> executors;
+    for (size_t i = 0; i < displayTargets.size(); i++) {
+        executors.emplace_back([&commands, &args, start, runCommand, i] {
+            DisplayTarget& target = *displayTargets[i];
+            activeBackend = target.backend.get();
+            injector = target.injector.get();
+
+            injector->setObserver(scriptProfile.get());
+            injector->setThreadSlot(i, displayTargets.size());
+            injector->start();
+            timeline = start + std::chrono::milliseconds(static_cast<int64_t>(args.displayOffset) * static_cast<int64_t>(i));
+            for (const auto& cmdArgs : commands) {
+                runCommand(cmdArgs, cmdArgs.sourceLine);
+            }
+            waitForTimeline();
+            injector->stop();
+            target.lock.release();
+        });
+    }
+    for (std::thread& executor : executors) {
+        executor.join();
     }
 }
 
@@ -851,35 +2773,199 @@ void execute(const CommandLineArgs& args) {
 
     // Only simulate event if all required arguments are valid
     if (args.validArgs) {
+        // Measure delivery latency instead of running commands
+        if (args.probeSamples > 0) {
+            runProbe(args);
+        }
+        // Inject what clients on this host push into shared memory
+        else if (!args.shmName.empty()) {
+            serveCommandRing(args.shmName);
+        }
+        // Keep rerunning the file as it is edited
+        else if (args.watch) {
+            watchCommandFile(args);
+        }
+        // Fan out to every display if requested
+        else if (!displayTargets.empty()) {
+            runOnDisplays(args);
+        }
         // Process file if provided
-        if (args.file.empty()) {
-            simulateEvent(args);
+        else if (args.file.empty()) {
+            selectCommandHandler()(args, 0);
         }
         else {
-            processCommandFile(args.file);
+            processCommandFile(args.file, args.from);
         }
     }
 }
 
-// Console application entry point
-int main(int argc, char* argv[]) {
-    // Set DPI awareness
-    setProcessDpiAwareness();
+// Write the timing histograms in the requested format
+void dumpStats() {
+    if (statsFormat == "none") return;
+
+    // Every target's injector contributes to one report
+    auto merged = std::make_unique<InjectorTiming>();
+    merged->merge(defaultInjector.timings());
+    for (auto& target : displayTargets) {
+        merged->merge(target->injector->timings());
+    }
+    const InjectorTiming& timing = *merged;
+
+    std::vector<NamedHistogram> histograms = {
+        {"sleep_requested", "Time the injection thread asked to wait for a deadline", &timing.sleepRequested},
+        {"sleep_actual", "Time the injection thread actually waited for a deadline", &timing.sleepActual},
+        {"event_lateness", "Injection time minus scheduled deadline per event", &timing.lateness},
+        {"frame_interval", "Interval between consecutive smooth movement frames", &timing.frameInterval},
+        {"inject_call", "Duration of one batched injection call", &timing.submitCall},
+        {"command_wall", "Wall time from a command's start until its last event was injected", &timing.commandWall},
+    };
+    auto lockWaits = std::make_unique<LatencyHistogram>();
+    if (lockScope != "none") {
+        lockWaits->merge(inputLock.waits());
+        for (auto& target : displayTargets) {
+            lockWaits->merge(target->lock.waits());
+        }
+        histograms.push_back({"lock_wait", "Time a command waited for the cross-process input lock", lockWaits.get()});
+    }
+    if (latencyProbe) {
+        histograms.push_back({"probe_hook", "Probe click deadline until the low-level mouse hook saw it", &latencyProbe->histogram(ProbeStage::Hook)});
+        histograms.push_back({"probe_window", "Probe click deadline until the probe window received it", &latencyProbe->histogram(ProbeStage::Window)});
+    }
+
+    std::ofstream file;
+    if (!statsFile.empty()) {
+        file.open(statsFile, std::ios::trunc);
+        if (!file.is_open()) {
+            if (!quiet) std::cout << "Error: Could not open stats file: " << statsFile << "\n";
+            return;
+        }
+    }
+    std::ostream& out = statsFile.empty() ? std::cout : file;
+
+    if (statsFormat == "json")
+        writeHistogramsJson(out, histograms);
+    else
+        writeHistogramsPrometheus(out, histograms);
+    out.flush();
+}
+
+#ifdef _WIN32
+// Dump the statistics on Ctrl+Break so long runs can be inspected without stopping them
+BOOL WINAPI StatsCtrlHandler(DWORD ctrlType) {
+    if (ctrlType != CTRL_BREAK_EVENT) return FALSE;
+    dumpStats();
+    return TRUE;
+}
+
+// Release held keys and buttons when the run is aborted, then let the default handler end the process
+BOOL WINAPI AbortCtrlHandler(DWORD ctrlType) {
+    if (ctrlType == CTRL_C_EVENT || ctrlType == CTRL_CLOSE_EVENT || ctrlType == CTRL_LOGOFF_EVENT || ctrlType == CTRL_SHUTDOWN_EVENT) {
+        releaseAllHeldInput();
+        releaseInputLocks();
+        writeProfile();
+    }
+    return FALSE;
+}
 
-    GetConsistentCursorPos(&lastPos, TRUE);  // Initialize last position
+void installConsoleHandlers() {
+    SetConsoleCtrlHandler(AbortCtrlHandler, TRUE);
+    if (statsFormat != "none") SetConsoleCtrlHandler(StatsCtrlHandler, TRUE);
+}
+#else
+// SIGINT, SIGTERM and SIGHUP abort the run like Ctrl+C, and SIGQUIT (Ctrl+\) dumps the statistics like
+// Ctrl+Break. A dedicated thread takes the signals with sigwait, so handling them may lock and call into Xlib.
+void installConsoleHandlers() {
+    static sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    if (statsFormat != "none") sigaddset(&signals, SIGQUIT);
+
+    // Threads started afterwards, such as the injection thread, inherit the mask
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::thread([] {
+        for (;;) {
+            int signal = 0;
+            if (sigwait(&signals, &signal) != 0) continue;
+            if (signal == SIGQUIT) {
+                dumpStats();
+                continue;
+            }
+            releaseAllHeldInput();
+            releaseInputLocks();
+            commandRing.unlinkName();
+            writeProfile();
+            std::_Exit(128 + signal);
+        }
+    }).detach();
+}
+#endif
 
+// Console application entry point
+int main(int argc, char* argv[]) {
     // Parse command line arguments
     CommandLineArgs args = parseCommandLine(argc, argv);
 
     // Set global verbose flag
     verbose = args.verbose;
 
-    // Get DPI scaling
-    dpiScaling = getCurrentDpiScalingFactor();
-    if (verbose) std::cout << "DPI Scaling Factor: " << dpiScaling << "\n";
+    // Validation only reads files; it never injects input
+    if (!args.checkPaths.empty() && !args.help) {
+        return checkCommandFiles(args.checkPaths);
+    }
+
+    // Neither does compiling a recording
+    if (!args.compileInput.empty() && !args.help) {
+        return compileRecordingFile(args);
+    }
+
+    // Showing the help needs no connection to the input system
+    if (args.validArgs && !args.help && (!connectTargets(args.displays, args.windows) || !openInputLocks(args.windows))) {
+        return 1;
+    }
+
+    // DPI awareness, the cursor position and screen capture are set up when a command first needs them
+    if (verbose) {
+        ensureDpiAware();
+        dpiScaling = getCurrentDpiScalingFactor();
+        std::cout << "DPI Scaling Factor: " << dpiScaling << "\n";
+    }
 
-    // Execute the command
+    // Lines are profiled as they run, from the executor and injection threads
+    if (!profileFile.empty() && args.validArgs && !args.help) {
+        scriptProfile = std::make_unique<ScriptProfile>();
+        profiledFile = args.file;
+        injector->setObserver(scriptProfile.get());
+    }
+
+    installConsoleHandlers();
+
+    // Execute the command on the injection thread's timeline
+    injector->start();
+    timeline = InjectClock::now();
     execute(args);
 
+    // Trailing sleeps still delay the exit, as callers rely on them for pacing
+    waitForTimeline();
+    injector->stop();
+    releaseInputLocks();
+
+    if (verbose) {
+        InjectorStats stats = totalInjectorStats();
+        std::cout << "Injected " << stats.events << " events in " << stats.batches << " batches | ";
+        std::cout << "Queue high-water: " << stats.depthHighWater << " | ";
+        std::cout << "Deadline misses: " << stats.deadlineMisses << " (worst " << stats.maxLatenessMs << " ms late)\n";
+        if (inputLock.isOpen()) {
+            InputLockTotals lock = inputLock.totals();
+            std::cout << "Input lock: waited " << static_cast<double>(inputLock.waits().sumNs()) / 1e6 << " ms in " << inputLock.waits().count()
+                      << " acquisitions | All instances: " << lock.acquisitions << " acquisitions, " << lock.contended << " contended, "
+                      << lock.waitMs << " ms waited (longest " << lock.maxWaitMs << " ms), " << lock.recoveries << " crashed holders skipped\n";
+        }
+    }
+    dumpStats();
+    writeProfile();
+
     return 0;
 }
\ No newline at end of file
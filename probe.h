@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "injector.h"
+#include "stats.h"
+
+// Probe clicks cycle through a kProbeGrid x kProbeGrid pixel square; the position tags the click
+constexpr int kProbeGrid = 16;
+constexpr int kProbeTags = kProbeGrid * kProbeGrid;
+
+// Where a probe click was seen
+enum class ProbeStage {
+    Hook,    // System-wide low-level hook, before any application (Windows only)
+    Window,  // Button press message received by the probe window
+};
+
+/**
+ * @brief Measures the time from a click's scheduled deadline until it is delivered
+ *
+ * Click i is scheduled at start + i * period at a position inside the probe square
+ * that encodes i modulo kProbeTags. A delivered click is matched to the newest click
+ * with its tag whose deadline has passed, so a lost click never shifts the matching of
+ * later ones. Clicks with the same tag are kProbeTags periods apart, which bounds the
+ * latency that can be measured unambiguously.
+ */
+class LatencyProbe {
+public:
+    LatencyProbe(size_t samples, int rate, int originX, int originY)
+        : samples(samples), originX(originX), originY(originY),
+          period(std::chrono::nanoseconds(1000000000LL / rate)), seen{std::vector<uint8_t>(samples), std::vector<uint8_t>(samples)} {}
+
+    void begin(InjectClock::time_point at) { start = at; }
+
+    InjectClock::time_point deadline(size_t index) const { return start + period * static_cast<int64_t>(index); }
+    int x(size_t index) const { return originX + static_cast<int>(index % kProbeGrid); }
+    int y(size_t index) const { return originY + static_cast<int>(index / kProbeGrid % kProbeGrid); }
+
+    // Record a probe click seen at (x, y). Called from one listener thread per stage.
+    void deliver(ProbeStage stage, int atX, int atY, InjectClock::time_point at) {
+        int column = atX - originX;
+        int row = atY - originY;
+        if (column < 0 || column >= kProbeGrid || row < 0 || row >= kProbeGrid || at < start) return;
+        size_t tag = static_cast<size_t>(row * kProbeGrid + column);
+
+        // Newest click with this tag that was already due
+        size_t due = static_cast<size_t>((at - start) / period);
+        if (due >= samples) due = samples - 1;
+        if (due < tag) return;
+        size_t index = due - (due - tag) % kProbeTags;
+
+        std::vector<uint8_t>& flags = seen[static_cast<int>(stage)];
+        if (flags[index]) return;
+        flags[index] = 1;
+        latency[static_cast<int>(stage)].record(at - deadline(index));
+    }
+
+    size_t count() const { return samples; }
+    const LatencyHistogram& histogram(ProbeStage stage) const { return latency[static_cast<int>(stage)]; }
+
+    // Plain-text summary in milliseconds, one line per stage that saw any click
+    void writeReport(std::ostream& out, const std::string& title) const {
+        auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+        const char* names[] = {"hook", "window"};
+
+        out << title << "\n";
+        out << "  stage   received   lost      min      p50      p90      p99    p99.9      max     mean (ms)\n";
+        std::ios::fmtflags flags = out.flags();
+        out << std::fixed << std::setprecision(3);
+        for (int stage = 0; stage < 2; stage++) {
+            const LatencyHistogram& h = latency[stage];
+            uint64_t n = h.count();
+            if (stage == static_cast<int>(ProbeStage::Hook) && n == 0) continue;
+
+            out << "  " << std::left << std::setw(6) << names[stage] << std::right << std::setw(10) << n << std::setw(7) << samples - n;
+            out << std::setw(9) << ms(h.minNs());
+            for (double percentile : {50.0, 90.0, 99.0, 99.9}) {
+                out << std::setw(9) << ms(h.percentileNs(percentile));
+            }
+            out << std::setw(9) << ms(h.maxNs()) << std::setw(9) << (n ? ms(h.sumNs()) / static_cast<double>(n) : 0.0) << "\n";
+        }
+        out.flags(flags);
+    }
+
+private:
+    size_t samples;
+    int originX;
+    int originY;
+    InjectClock::duration period;
+    InjectClock::time_point start;
+    std::vector<uint8_t> seen[2];  // Per stage, whether click i was already matched
+    LatencyHistogram latency[2];
+};
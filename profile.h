@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "injector.h"
+
+// Counters of one command file line. Relaxed atomics, so every executor and injection thread
+// can add to them at once and a report can be written while they still run.
+struct LineProfile {
+    std::atomic<uint64_t> invocations{0};
+    std::atomic<uint64_t> wallNs{0};     // Timeline the line took: its sleeps, smooth moves, waits and focus switches
+    std::atomic<uint64_t> sleepNs{0};    // Part of wallNs asked for with -s
+    std::atomic<uint64_t> blockedNs{0};  // Time the executor was blocked in the line: screen waits, focus switches, searches
+    std::atomic<uint64_t> events{0};     // Events injected for the line
+    std::atomic<uint64_t> lateNs{0};     // Lateness of those events added up: where injection stalled
+};
+
+/**
+ * @brief Per-line counters of a command file run, for --profile
+ *
+ * Every run of a line adds to the counters of its source line, so reruns of a watched
+ * file and the same file on several displays aggregate. The executor reports each command
+ * once; the injection threads report each event as observers of their injector. Lines are
+ * kept in chunks allocated the first time one of their lines is counted, so an edited
+ * file can grow while it is watched without anything being moved.
+ */
+class ScriptProfile : public InjectionObserver {
+public:
+    static constexpr size_t kChunkLines = 1024;
+    static constexpr size_t kMaxChunks = 1024;  // Lines past about a million are not counted
+
+    ScriptProfile() = default;
+    ~ScriptProfile() {
+        for (auto& chunk : chunks) delete chunk.load(std::memory_order_relaxed);
+    }
+
+    ScriptProfile(const ScriptProfile&) = delete;
+    ScriptProfile& operator=(const ScriptProfile&) = delete;
+
+    // One run of the command on a 1-based line
+    void command(uint32_t line, InjectClock::duration wall, InjectClock::duration sleep, InjectClock::duration blocked) {
+        LineProfile* counters = at(line);
+        if (!counters) return;
+        counters->invocations.fetch_add(1, std::memory_order_relaxed);
+        counters->wallNs.fetch_add(toNs(wall), std::memory_order_relaxed);
+        counters->sleepNs.fetch_add(toNs(sleep), std::memory_order_relaxed);
+        counters->blockedNs.fetch_add(toNs(blocked), std::memory_order_relaxed);
+    }
+
+    void injected(uint32_t line, InjectClock::duration lateness) override {
+        LineProfile* counters = at(line);
+        if (!counters) return;
+        counters->events.fetch_add(1, std::memory_order_relaxed);
+        counters->lateNs.fetch_add(toNs(lateness), std::memory_order_relaxed);
+    }
+
+    // Write the source with every line's counters in front of it, then the lines that took the most wall time
+    void write(std::ostream& out, const std::string& name, const std::vector<std::string>& source, size_t hotLines = 20) const {
+        struct Row {
+            uint32_t line;
+            uint64_t invocations, wallNs, sleepNs, blockedNs, events, lateNs;
+        };
+        std::vector<Row> rows;
+        Row total = {};
+        size_t lineCount = std::max(source.size(), countedLines());
+        for (size_t i = 1; i <= lineCount; i++) {
+            const LineProfile* counters = find(static_cast<uint32_t>(i));
+            Row row = {static_cast<uint32_t>(i), 0, 0, 0, 0, 0, 0};
+            if (counters) {
+                row.invocations = counters->invocations.load(std::memory_order_relaxed);
+                row.wallNs = counters->wallNs.load(std::memory_order_relaxed);
+                row.sleepNs = counters->sleepNs.load(std::memory_order_relaxed);
+                row.blockedNs = counters->blockedNs.load(std::memory_order_relaxed);
+                row.events = counters->events.load(std::memory_order_relaxed);
+                row.lateNs = counters->lateNs.load(std::memory_order_relaxed);
+            }
+            if (i > source.size() && row.invocations == 0 && row.events == 0) continue;  // Past the end and never run
+            total.invocations += row.invocations;
+            total.wallNs += row.wallNs;
+            total.sleepNs += row.sleepNs;
+            total.blockedNs += row.blockedNs;
+            total.events += row.events;
+            total.lateNs += row.lateNs;
+            rows.push_back(row);
+        }
+
+        auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+        auto columns = [&](const Row& row) {
+            out << std::setw(7) << row.invocations << std::setw(12) << ms(row.wallNs) << std::setw(12) << ms(row.sleepNs)
+                << std::setw(11) << ms(row.blockedNs) << std::setw(8) << row.events << std::setw(10) << ms(row.lateNs);
+        };
+        const char* header = "  calls     wall ms    sleep ms    wait ms  events   late ms";
+
+        std::ios::fmtflags flags = out.flags();
+        std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(1);
+        out << "Profile of " << name << ": " << total.invocations << " commands, " << ms(total.wallNs) << " ms wall, "
+            << ms(total.sleepNs) << " ms sleeping, " << ms(total.blockedNs) << " ms waiting, " << total.events << " events, "
+            << ms(total.lateNs) << " ms late\n\n";
+
+        out << "  line" << header << " | source\n";
+        for (const Row& row : rows) {
+            out << std::setw(6) << row.line;
+            if (row.invocations > 0 || row.events > 0)
+                columns(row);
+            else
+                out << std::string(60, ' ');
+            out << " | " << (row.line <= source.size() ? source[row.line - 1] : "") << "\n";
+        }
+
+        std::vector<Row> hot;
+        for (const Row& row : rows) {
+            if (row.invocations > 0) hot.push_back(row);
+        }
+        std::stable_sort(hot.begin(), hot.end(), [](const Row& a, const Row& b) { return a.wallNs > b.wallNs; });
+        if (hot.size() > hotLines) hot.resize(hotLines);
+
+        out << "\nHot lines by wall time\n  line  share" << header << " | source\n";
+        for (const Row& row : hot) {
+            double share = total.wallNs > 0 ? 100.0 * static_cast<double>(row.wallNs) / static_cast<double>(total.wallNs) : 0;
+            out << std::setw(6) << row.line << std::setw(6) << std::setprecision(1) << share << "%";
+            columns(row);
+            out << " | " << (row.line <= source.size() ? source[row.line - 1] : "") << "\n";
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    struct Chunk {
+        LineProfile lines[kChunkLines];
+    };
+
+    static uint64_t toNs(InjectClock::duration duration) {
+        return static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0));
+    }
+
+    // Counters of a line, allocating its chunk on first use; nullptr for line 0 or past the last chunk
+    LineProfile* at(uint32_t line) {
+        if (line == 0 || (line - 1) / kChunkLines >= kMaxChunks) return nullptr;
+        std::atomic<Chunk*>& slot = chunks[(line - 1) / kChunkLines];
+        Chunk* chunk = slot.load(std::memory_order_acquire);
+        if (!chunk) {
+            Chunk* fresh = new Chunk;
+            if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel))
+                chunk = fresh;
+            else
+                delete fresh;
+        }
+        return &chunk->lines[(line - 1) % kChunkLines];
+    }
+
+    // Counters of a line if its chunk exists
+    const LineProfile* find(uint32_t line) const {
+        if (line == 0 || (line - 1) / kChunkLines >= kMaxChunks) return nullptr;
+        const Chunk* chunk = chunks[(line - 1) / kChunkLines].load(std::memory_order_acquire);
+        return chunk ? &chunk->lines[(line - 1) % kChunkLines] : nullptr;
+    }
+
+    // Lines up to the end of the last allocated chunk, to cover lines an edit has since removed
+    size_t countedLines() const {
+        for (size_t i = kMaxChunks; i > 0; i--) {
+            if (chunks[i - 1].load(std::memory_order_acquire)) return i * kChunkLines;
+        }
+        return 0;
+    }
+
+    std::array<std::atomic<Chunk*>, kMaxChunks> chunks{};
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include "injector.h"
+
+// Recorded name of each event type, in InputEventType order up to Marker, which is never recorded
+inline constexpr const char* kRecordedEventNames[] = {"move", "down", "up", "wheel", "keydown", "keyup", "touchdown", "touchmove", "touchup"};
+
+/**
+ * @brief Writes events to a file instead of injecting them
+ *
+ * For tests and benchmarks on machines without a usable input system. Each event
+ * becomes one line "<ns> <type> <code> <x> <y>", where ns is the steady clock at the
+ * moment the injection thread submitted it, comparable across processes on Linux.
+ * The pointer follows the recorded moves, starting at (0, 0).
+ */
+class RecordingBackend : public InputBackend {
+public:
+    bool open(const std::string& path) {
+        out.open(path, std::ios::trunc);
+        return out.is_open();
+    }
+
+    void submit(const InputEvent* events, size_t count) override {
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(InjectClock::now().time_since_epoch()).count();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < count; i++) {
+            const InputEvent& event = events[i];
+            if (event.type == InputEventType::Marker) continue;
+            if (event.type == InputEventType::MouseMove) {
+                pointerX = event.x;
+                pointerY = event.y;
+            }
+            out << now << " " << kRecordedEventNames[static_cast<int>(event.type)] << " " << event.code << " " << event.x << " " << event.y << "\n";
+        }
+        out.flush();
+    }
+
+    bool queryPointer(int& x, int& y) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        x = pointerX;
+        y = pointerY;
+        return true;
+    }
+
+private:
+    std::ofstream out;
+    std::mutex mutex;  // Submit runs on the injection thread, queryPointer on the executor
+    int pointerX = 0;
+    int pointerY = 0;
+};
@@ -0,0 +1,451 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "injector.h"
+#include "recording_backend.h"
+#include "win32_compat.h"
+
+// One line of a --record-file recording
+struct RecordedEvent {
+    int64_t ns = 0;
+    InputEventType type = InputEventType::MouseMove;
+    int code = 0;
+    int x = 0;
+    int y = 0;
+};
+
+// Read a recording; false with line set to the 1-based line that is not a recorded event
+inline bool readRecording(std::istream& in, std::vector<RecordedEvent>& events, int& line) {
+    std::string text;
+    line = 0;
+    while (std::getline(in, text)) {
+        line++;
+        if (text.empty()) continue;
+
+        std::istringstream fields(text);
+        RecordedEvent event;
+        std::string name;
+        if (!(fields >> event.ns >> name >> event.code >> event.x >> event.y)) return false;
+
+        auto known = std::find_if(std::begin(kRecordedEventNames), std::end(kRecordedEventNames),
+                                  [&](const char* recorded) { return name == recorded; });
+        if (known == std::end(kRecordedEventNames)) return false;
+        event.type = static_cast<InputEventType>(known - std::begin(kRecordedEventNames));
+        events.push_back(event);
+    }
+    return true;
+}
+
+// A recorded pointer position
+struct PathPoint {
+    int x;
+    int y;
+    int64_t ns;
+};
+
+// Distance from p to the segment from a to b
+inline double segmentDistance(const PathPoint& p, const PathPoint& a, const PathPoint& b) {
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double lengthSquared = dx * dx + dy * dy;
+    double t = (lengthSquared > 0) ? std::clamp(((p.x - a.x) * dx + (p.y - a.y) * dy) / lengthSquared, 0.0, 1.0) : 0.0;
+    return std::hypot(p.x - (a.x + t * dx), p.y - (a.y + t * dy));
+}
+
+/**
+ * @brief Simplify a path with the Ramer-Douglas-Peucker algorithm
+ *
+ * Keeps the first and last point and, recursively, the point farthest from the segment
+ * between two kept points while it is farther than tolerance. Iterative, so paths of any
+ * length are safe. The segment distance is clamped to the segment, so a path that doubles
+ * back on itself keeps its turning point.
+ *
+ * @param kept Receives the indices of the points to keep, in order
+ * @return The largest distance of a dropped point from the simplified path
+ */
+inline double simplifyPath(const std::vector<PathPoint>& points, double tolerance, std::vector<size_t>& kept) {
+    kept.clear();
+    if (points.empty()) return 0;
+
+    std::vector<uint8_t> keep(points.size(), 0);
+    keep.front() = 1;
+    keep.back() = 1;
+    std::vector<std::pair<size_t, size_t>> ranges = {{0, points.size() - 1}};
+    double deviation = 0;
+
+    while (!ranges.empty()) {
+        auto [first, last] = ranges.back();
+        ranges.pop_back();
+
+        size_t farthest = first;
+        double distance = 0;
+        for (size_t i = first + 1; i < last; i++) {
+            double d = segmentDistance(points[i], points[first], points[last]);
+            if (d > distance) {
+                distance = d;
+                farthest = i;
+            }
+        }
+        if (distance > tolerance) {
+            keep[farthest] = 1;
+            ranges.push_back({first, farthest});
+            ranges.push_back({farthest, last});
+        }
+        else {
+            deviation = std::max(deviation, distance);
+        }
+    }
+
+    for (size_t i = 0; i < points.size(); i++) {
+        if (keep[i]) kept.push_back(i);
+    }
+    return deviation;
+}
+
+struct RecordingCompileOptions {
+    double tolerance = 2.0;  // Pixels a simplified path may deviate from the recorded one
+    int idleMs = 20;         // Shorter gaps are carried into the next sleep instead of getting their own
+    int pauseMs = 100;       // A pointer or wheel resting this long ends a motion
+    int clickMs = 250;       // A button released this soon after its press, with nothing in between, is a click
+};
+
+struct RecordingCompileStats {
+    size_t events = 0;        // Recorded events read
+    size_t commands = 0;      // Commands written
+    size_t pathPoints = 0;    // Recorded pointer positions
+    size_t waypoints = 0;     // Pointer positions left after simplification
+    size_t skipped = 0;       // Events with no command equivalent (touch, unnamed keys)
+    double maxDeviation = 0;  // Largest distance of a recorded position from the simplified path, in pixels
+};
+
+/**
+ * @brief Compiles a --record-file recording into a command file
+ *
+ * Pointer moves become smooth mouse_move commands along the simplified path, one per
+ * waypoint, each as long as the recording took between them. A button press right after
+ * a move is folded into that move, and a press released within clickMs with nothing in
+ * between becomes a click whose hold is added to the sleep after it. Positions of clicks
+ * and ends of drags are exact. Key events form a
+ * chord when all keys go down before any comes up; otherwise they are kept as single
+ * keydown and keyup commands. Consecutive wheel events become one -k wheel. Gaps between
+ * commands become -s sleeps; gaps under idleMs add up until they are worth one.
+ */
+class RecordingCompiler {
+public:
+    // keyName returns the key_ name of a virtual key code, or "" if it has none
+    RecordingCompiler(const RecordingCompileOptions& options, std::function<std::string(uint16_t)> keyName)
+        : options(options), keyName(std::move(keyName)) {}
+
+    void compile(const std::vector<RecordedEvent>& events) {
+        for (const RecordedEvent& event : events) {
+            stats.events++;
+            bool key = (event.type == InputEventType::KeyDown || event.type == InputEventType::KeyUp);
+            if (!key) flushKeys();
+            if (event.type != InputEventType::MouseMove) flushPath();
+            if (event.type != InputEventType::Wheel) flushWheel();
+
+            switch (event.type) {
+                case InputEventType::MouseMove:
+                    addMove(event);
+                    break;
+                case InputEventType::MouseDown:
+                    pressButton(event);
+                    break;
+                case InputEventType::MouseUp:
+                    releaseButton(event);
+                    break;
+                case InputEventType::Wheel:
+                    addWheel(event);
+                    break;
+                case InputEventType::KeyDown:
+                case InputEventType::KeyUp:
+                    addKey(event);
+                    break;
+                default:
+                    stats.skipped++;
+                    break;
+            }
+        }
+        flushPath();
+        flushWheel();
+        flushKeys();
+        stats.commands = commands.size();
+    }
+
+    // One command per line
+    void write(std::ostream& out) const {
+        for (const Command& command : commands) out << command.format() << "\n";
+    }
+
+    const RecordingCompileStats& result() const { return stats; }
+
+private:
+    struct Command {
+        std::string key;
+        std::string action;  // Empty: the key's default
+        bool positioned = false;
+        int x = 0;
+        int y = 0;
+        std::string extra;  // Further options, e.g. the wheel amounts
+        int smoothMs = 0;   // 0: instant
+        int keyGap = 0;
+        int sleepMs = 0;
+
+        std::string format() const {
+            std::ostringstream line;
+            line << "-k " << key;
+            if (!action.empty()) line << " -a " << action;
+            if (positioned) line << " -x " << x << " -y " << y;
+            if (!extra.empty()) line << " " << extra;
+            if (smoothMs > 0) line << " -sm linear -smt " << smoothMs;
+            if (keyGap > 0) line << " -kg " << keyGap;
+            if (sleepMs > 0) line << " -s " << sleepMs;
+            return line.str();
+        }
+    };
+
+    static int toMs(int64_t ns) { return static_cast<int>(std::lround(static_cast<double>(ns) / 1e6)); }
+
+    // Append a command that starts at startNs and takes durationNs to replay
+    void emit(Command command, int64_t startNs, int64_t durationNs) {
+        if (!commands.empty()) wait(startNs);
+        commands.push_back(std::move(command));
+        endNs = startNs + durationNs;
+    }
+
+    // Turn the time from the end of the last command to ns into its sleep, or carry it if too short
+    void wait(int64_t ns) {
+        idleNs += ns - endNs;
+        endNs = ns;
+        if (idleNs >= static_cast<int64_t>(options.idleMs) * 1000000) {
+            commands.back().sleepMs += toMs(idleNs);
+            idleNs = 0;
+        }
+    }
+
+    // Fold a button command into the move just before it, if that move ends where the button acts
+    bool foldIntoMove(const Command& button, int64_t ns) {
+        if (commands.empty() || !button.positioned) return false;
+        Command& last = commands.back();
+        if (last.key != "mouse_move" || last.sleepMs > 0 || last.x != button.x || last.y != button.y) return false;
+        if (idleNs + (ns - endNs) >= static_cast<int64_t>(options.idleMs) * 1000000) return false;
+
+        wait(ns);
+        last.key = button.key;
+        last.action = button.action;
+        return true;
+    }
+
+    void addMove(const RecordedEvent& event) {
+        PathPoint point = {event.x, event.y, event.ns};
+        stats.pathPoints++;
+        if (!path.empty() && event.ns - path.back().ns >= static_cast<int64_t>(options.pauseMs) * 1000000) flushPath();
+
+        if (path.empty()) {
+            if (havePosition) {
+                path.push_back({position.x, position.y, event.ns});
+            }
+            else {
+                // Where the recording starts: jump there, then follow the path from it
+                Command jump;
+                jump.key = "mouse_move";
+                jump.positioned = true;
+                jump.x = event.x;
+                jump.y = event.y;
+                emit(jump, event.ns, 0);
+                stats.waypoints++;
+            }
+        }
+        path.push_back(point);
+        position = point;
+        havePosition = true;
+    }
+
+    void flushPath() {
+        if (path.size() >= 2) {
+            std::vector<size_t> kept;
+            stats.maxDeviation = std::max(stats.maxDeviation, simplifyPath(path, options.tolerance, kept));
+            for (size_t k = 1; k < kept.size(); k++) {
+                const PathPoint& from = path[kept[k - 1]];
+                const PathPoint& to = path[kept[k]];
+                Command move;
+                move.key = "mouse_move";
+                move.positioned = true;
+                move.x = to.x;
+                move.y = to.y;
+                move.smoothMs = toMs(to.ns - from.ns);
+                emit(move, from.ns, to.ns - from.ns);
+                stats.waypoints++;
+            }
+        }
+        path.clear();
+    }
+
+    Command buttonCommand(const RecordedEvent& event, const char* action) const {
+        static const char* const names[] = {"mouse_left", "mouse_right", "mouse_middle"};
+        Command command;
+        command.key = names[std::clamp(event.code, 0, 2)];
+        command.action = action;
+        command.positioned = havePosition;
+        command.x = position.x;
+        command.y = position.y;
+        return command;
+    }
+
+    void pressButton(const RecordedEvent& event) {
+        Command press = buttonCommand(event, "keydown");
+        if (!foldIntoMove(press, event.ns)) emit(press, event.ns, 0);
+        pressedAt = commands.size() - 1;
+    }
+
+    void releaseButton(const RecordedEvent& event) {
+        Command release = buttonCommand(event, "keyup");
+
+        // Released right after its press, with nothing in between: a click
+        if (pressedAt + 1 == commands.size()) {
+            Command& press = commands.back();
+            if (press.key == release.key && press.action == "keydown" && press.sleepMs == 0 &&
+                idleNs + (event.ns - endNs) < static_cast<int64_t>(options.clickMs) * 1000000) {
+                wait(event.ns);
+                press.action.clear();
+                pressedAt = kNone;
+                return;
+            }
+        }
+        if (!foldIntoMove(release, event.ns)) emit(release, event.ns, 0);
+        pressedAt = kNone;
+    }
+
+    void addWheel(const RecordedEvent& event) {
+        if (!wheel.empty() && event.ns - wheel.back().ns >= static_cast<int64_t>(options.pauseMs) * 1000000) flushWheel();
+        wheel.push_back(event);
+    }
+
+    void flushWheel() {
+        if (wheel.empty()) return;
+        int totalX = 0;
+        int totalY = 0;
+        for (const RecordedEvent& event : wheel) {
+            totalX += event.x;
+            totalY += event.y;
+        }
+
+        if (totalX != 0 || totalY != 0) {
+            auto notches = [](int delta) {
+                std::ostringstream text;
+                text << static_cast<double>(delta) / WHEEL_DELTA;
+                return text.str();
+            };
+            Command scroll;
+            scroll.key = "wheel";
+            if (totalX != 0) scroll.extra = "-dx " + notches(totalX);
+            if (totalY != 0) scroll.extra += std::string(scroll.extra.empty() ? "" : " ") + "-dy " + notches(totalY);
+            int64_t durationNs = wheel.back().ns - wheel.front().ns;
+            scroll.smoothMs = (wheel.size() > 1) ? toMs(durationNs) : 0;
+            emit(scroll, wheel.front().ns, durationNs);
+        }
+        wheel.clear();
+    }
+
+    void addKey(const RecordedEvent& event) {
+        uint16_t code = static_cast<uint16_t>(event.code & 0xff);
+        bool down = (event.type == InputEventType::KeyDown);
+        bool wasHeld = held[code];
+        held[code] = down;
+
+        // A release of a key that was never pressed, or part of a group that is no chord
+        if (rawKeys || (!down && !wasHeld)) {
+            emitKey(event);
+            rawKeys = held.any();
+            return;
+        }
+        keyGroup.push_back(event);
+        if (held.none()) compileKeyGroup();
+    }
+
+    // Emit the group as one chord if every key went down before any came up, else key by key
+    void compileKeyGroup() {
+        size_t count = keyGroup.size() / 2;
+        bool chord = (keyGroup.size() % 2 == 0);
+        std::string names;
+        for (size_t i = 0; chord && i < keyGroup.size(); i++) {
+            const RecordedEvent& event = keyGroup[i];
+            chord = (event.type == (i < count ? InputEventType::KeyDown : InputEventType::KeyUp));
+            if (chord && i < count) {
+                std::string name = keyName(static_cast<uint16_t>(event.code));
+                chord = !name.empty();
+                names += (i == 0 ? "" : "+") + name;
+            }
+        }
+        // Auto-repeat presses the same key twice
+        for (size_t i = 0; chord && i < count; i++) {
+            for (size_t j = 0; j < i; j++) {
+                if (keyGroup[j].code == keyGroup[i].code) chord = false;
+            }
+        }
+
+        if (chord) {
+            int64_t durationNs = keyGroup.back().ns - keyGroup.front().ns;
+            Command press;
+            press.key = names;
+            press.keyGap = (keyGroup.size() > 1) ? toMs(durationNs / static_cast<int64_t>(keyGroup.size() - 1)) : 0;
+            emit(press, keyGroup.front().ns, durationNs);
+        }
+        else {
+            for (const RecordedEvent& event : keyGroup) emitKey(event);
+        }
+        keyGroup.clear();
+    }
+
+    // Emit a key event on its own
+    void emitKey(const RecordedEvent& event) {
+        std::string name = keyName(static_cast<uint16_t>(event.code));
+        if (name.empty()) {
+            stats.skipped++;
+            return;
+        }
+        Command key;
+        key.key = name;
+        key.action = (event.type == InputEventType::KeyDown) ? "keydown" : "keyup";
+        emit(key, event.ns, 0);
+    }
+
+    // Something other than a key happened while keys are held; the chord is off
+    void flushKeys() {
+        if (keyGroup.empty()) return;
+        for (const RecordedEvent& event : keyGroup) emitKey(event);
+        keyGroup.clear();
+        rawKeys = held.any();
+    }
+
+    static constexpr size_t kNone = static_cast<size_t>(-1);
+
+    RecordingCompileOptions options;
+    std::function<std::string(uint16_t)> keyName;
+    RecordingCompileStats stats;
+    std::vector<Command> commands;
+    int64_t endNs = 0;   // When the last command is done replaying, in recording time
+    int64_t idleNs = 0;  // Idle time not yet turned into a sleep
+
+    std::vector<PathPoint> path;  // Pointer positions of the current motion, from where it started
+    PathPoint position = {0, 0, 0};
+    bool havePosition = false;
+    size_t pressedAt = kNone;  // Index of the command that pressed a button, until it is released
+
+    std::vector<RecordedEvent> wheel;  // Wheel events of the current scroll
+
+    std::vector<RecordedEvent> keyGroup;  // Key events since no key was held
+    std::bitset<256> held;
+    bool rawKeys = false;  // The current group is emitted key by key
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "script_check.h"
+
+// 64-bit FNV-1a hash of a line's text, the key of the compiled line cache
+inline uint64_t hashScriptLine(std::string_view line) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : line) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Length of the common prefix of two buffers of at least length bytes, compared a block at a time
+inline size_t commonPrefixLength(const char* a, const char* b, size_t length) {
+    constexpr size_t kBlock = 256;
+    size_t position = 0;
+    while (position + kBlock <= length && std::memcmp(a + position, b + position, kBlock) == 0) position += kBlock;
+    while (position < length && a[position] == b[position]) position++;
+    return position;
+}
+
+// Length of the common suffix of two buffers that end at aEnd and bEnd, at most length bytes
+inline size_t commonSuffixLength(const char* aEnd, const char* bEnd, size_t length) {
+    constexpr size_t kBlock = 256;
+    size_t matched = 0;
+    while (matched + kBlock <= length && std::memcmp(aEnd - matched - kBlock, bEnd - matched - kBlock, kBlock) == 0) matched += kBlock;
+    while (matched < length && aEnd[-static_cast<ptrdiff_t>(matched) - 1] == bEnd[-static_cast<ptrdiff_t>(matched) - 1]) matched++;
+    return matched;
+}
+
+// One command file line after compilation
+template <typename Command>
+struct CompiledLine {
+    std::string text;                           // Source text, to tell hash collisions apart
+    std::optional<Command> command;             // Empty for blank lines, comments, labels and errors
+    std::string label;                          // Name of a ":name" label line
+    std::vector<ScriptDiagnostic> diagnostics;  // Problems, with path and line left empty
+};
+
+// What one IncrementalScript::update looked at
+struct ScriptUpdate {
+    bool changed = false;   // The text differs from the previous one
+    size_t firstLine = 0;   // 0-based index of the first line of the changed range
+    size_t lineCount = 0;   // Lines of the new text in the changed range
+    size_t compiled = 0;    // Lines of that range that missed the cache and were compiled
+};
+
+/**
+ * @brief Command file kept compiled line by line across edits
+ *
+ * An update compares the new text with the previous one byte by byte from both ends,
+ * so only the lines between the first and the last difference are split again. Each
+ * of them is looked up in a cache keyed by its content hash and only compiled on a
+ * miss, which makes moved, duplicated and undone lines free as well. The cost of an
+ * edit is a memcmp of the file plus work proportional to the edited lines.
+ */
+template <typename Command>
+class IncrementalScript {
+public:
+    using Compiler = std::function<void(const std::string& line, CompiledLine<Command>& compiled)>;
+
+    explicit IncrementalScript(Compiler compile) : compile(std::move(compile)) {}
+
+    // Bring the script up to date with newText. Afterwards newText holds the previous text,
+    // so the caller can read the next version into its buffer without allocating.
+    ScriptUpdate update(std::string& newText) {
+        ScriptUpdate result;
+
+        // Longest common prefix and suffix; the suffix may not overlap the prefix
+        size_t shorter = std::min(text.size(), newText.size());
+        size_t prefix = commonPrefixLength(text.data(), newText.data(), shorter);
+        if (prefix == text.size() && prefix == newText.size() && !lines.empty()) return result;
+        result.changed = true;
+        size_t suffix = commonSuffixLength(text.data() + text.size(), newText.data() + newText.size(), shorter - prefix);
+
+        // Old lines [first, last) cover the difference. The line holding the first byte of the
+        // suffix is included too, as a deleted or inserted newline may have merged or split it.
+        size_t first = lineAt(prefix);
+        size_t last = lines.empty() ? 0 : lineAt(text.size() - suffix) + 1;
+        size_t begin = first < lines.size() ? lines[first].offset : text.size();
+        size_t end = lineEnd(last);
+        ptrdiff_t delta = static_cast<ptrdiff_t>(newText.size()) - static_cast<ptrdiff_t>(text.size());
+        text.swap(newText);
+
+        // Split the changed range of the new text; its end is a line boundary, as the suffix is shared
+        std::vector<Line> replaced;
+        size_t rangeEnd = static_cast<size_t>(static_cast<ptrdiff_t>(end) + delta);
+        for (size_t position = begin; position < rangeEnd;) {
+            size_t newline = text.find('\n', position);
+            size_t lineEnd = (newline == std::string::npos || newline >= rangeEnd) ? rangeEnd : newline;
+            size_t length = lineEnd - position;
+            if (length > 0 && text[position + length - 1] == '\r') length--;
+
+            Line line;
+            line.offset = position;
+            line.compiled = lookup(std::string_view(text).substr(position, length), result.compiled);
+            replaced.push_back(line);
+            position = lineEnd + 1;
+        }
+
+        for (size_t i = first; i < last; i++) errors -= lines[i].compiled->diagnostics.size();
+        for (const Line& line : replaced) errors += line.compiled->diagnostics.size();
+
+        // Splice the new range in and move the lines after it to their new offsets
+        size_t count = replaced.size();
+        if (count <= last - first) {
+            std::copy(replaced.begin(), replaced.end(), lines.begin() + first);
+            lines.erase(lines.begin() + first + count, lines.begin() + last);
+        }
+        else {
+            std::copy(replaced.begin(), replaced.begin() + (last - first), lines.begin() + first);
+            lines.insert(lines.begin() + last, replaced.begin() + (last - first), replaced.end());
+        }
+        if (delta != 0) {
+            for (size_t i = first + count; i < lines.size(); i++) lines[i].offset += delta;
+        }
+
+        prune();
+        result.firstLine = first;
+        result.lineCount = count;
+        return result;
+    }
+
+    size_t lineCount() const { return lines.size(); }
+    const CompiledLine<Command>& line(size_t index) const { return *lines[index].compiled; }
+
+    // Problems across the whole script
+    size_t errorCount() const { return errors; }
+
+    // 0-based index of the ":name" line, or lineCount() if there is none
+    size_t findLabel(const std::string& name) const {
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (lines[i].compiled->label == name) return i;
+        }
+        return lines.size();
+    }
+
+    // Problems of count lines from first, with path and line numbers filled in
+    std::vector<ScriptDiagnostic> diagnostics(const std::string& path, size_t first, size_t count) const {
+        std::vector<ScriptDiagnostic> found;
+        for (size_t i = first; i < std::min(first + count, lines.size()); i++) {
+            for (ScriptDiagnostic diagnostic : lines[i].compiled->diagnostics) {
+                diagnostic.path = path;
+                diagnostic.line = static_cast<int>(i) + 1;
+                found.push_back(std::move(diagnostic));
+            }
+        }
+        return found;
+    }
+
+private:
+    // Trivially copyable, so splicing an edit in is a memmove
+    struct Line {
+        size_t offset = 0;                                // Where the line starts in text
+        const CompiledLine<Command>* compiled = nullptr;  // Owned by the cache
+    };
+
+    // Index of the line that contains byte position, or lineCount() past the last line
+    size_t lineAt(size_t position) const {
+        auto it = std::upper_bound(lines.begin(), lines.end(), position, [](size_t value, const Line& line) { return value < line.offset; });
+        size_t index = static_cast<size_t>(it - lines.begin());
+        return index > 0 ? index - 1 : 0;
+    }
+
+    // Offset just past line index - 1, newline included
+    size_t lineEnd(size_t index) const {
+        return index < lines.size() ? lines[index].offset : text.size();
+    }
+
+    const CompiledLine<Command>* lookup(std::string_view source, size_t& compiled) {
+        uint64_t hash = hashScriptLine(source);
+        auto [first, last] = cache.equal_range(hash);
+        for (auto it = first; it != last; ++it) {
+            if (it->second->text == source) return it->second.get();
+        }
+
+        auto line = std::make_unique<CompiledLine<Command>>();
+        line->text = source;
+        compile(line->text, *line);
+        compiled++;
+        return cache.emplace(hash, std::move(line))->second.get();
+    }
+
+    // Forget lines no longer in the script once the cache has grown well past it
+    void prune() {
+        if (cache.size() <= 2 * lines.size() + 1024) return;
+        std::unordered_set<const CompiledLine<Command>*> live;
+        for (const Line& line : lines) live.insert(line.compiled);
+        for (auto it = cache.begin(); it != cache.end();) {
+            it = live.count(it->second.get()) ? std::next(it) : cache.erase(it);
+        }
+    }
+
+    Compiler compile;
+    std::string text;
+    std::vector<Line> lines;
+    std::unordered_multimap<uint64_t, std::unique_ptr<CompiledLine<Command>>> cache;
+    size_t errors = 0;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Lines per validation task; files longer than this are split into line ranges
+constexpr size_t kCheckChunkLines = 4096;
+
+// One problem found in a command file. Line and column are 1-based; 0 means the whole file
+struct ScriptDiagnostic {
+    std::string path;
+    int line = 0;
+    int column = 0;
+    std::string message;
+};
+
+/**
+ * @brief Split a command file line into arguments
+ *
+ * Arguments are separated by spaces; double quotes group spaces into one argument and
+ * are dropped. When columns is given it receives the 1-based column each argument starts at.
+ */
+inline std::vector<std::string> splitScriptLine(const std::string& line, std::vector<int>* columns = nullptr) {
+    std::vector<std::string> args;
+    std::string currentArg;
+    bool inQuotes = false;
+    int start = -1;
+
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+
+        if (c == ' ' && !inQuotes) {
+            if (!currentArg.empty()) {
+                args.push_back(currentArg);
+                if (columns) columns->push_back(start + 1);
+                currentArg.clear();
+            }
+            start = -1;
+            continue;
+        }
+
+        if (start < 0) start = static_cast<int>(i);
+        if (c == '"') {
+            inQuotes = !inQuotes;
+            continue;
+        }
+        currentArg += c;
+    }
+
+    if (!currentArg.empty()) {
+        args.push_back(currentArg);
+        if (columns) columns->push_back(start + 1);
+    }
+    return args;
+}
+
+// A ":name" line marks a place a run can start from; true with name set for such a line
+inline bool parseScriptLabel(const std::string& line, std::string& name) {
+    if (line.empty() || line[0] != ':') return false;
+    size_t end = line.find_last_not_of(" \t\r");
+    name = line.substr(1, end);
+    return true;
+}
+
+// Checks one non-empty, non-comment line and appends its problems with line left at 0
+using ScriptLineValidator = std::function<void(const std::string& line, std::vector<ScriptDiagnostic>& diagnostics)>;
+
+struct ScriptCheckResult {
+    size_t files = 0;
+    size_t lines = 0;
+    std::vector<ScriptDiagnostic> diagnostics;  // Sorted by path, line and column
+};
+
+// Expand directories (recursively, .txt files only) and keep plain file arguments as given
+inline std::vector<std::string> collectScriptFiles(const std::vector<std::string>& paths, std::vector<ScriptDiagnostic>& diagnostics) {
+    std::vector<std::string> files;
+    for (const std::string& path : paths) {
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error)) {
+            std::vector<std::string> found;
+            for (auto it = std::filesystem::recursive_directory_iterator(path, error);
+                 !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+                if (it->is_regular_file(error) && it->path().extension() == ".txt") found.push_back(it->path().string());
+            }
+            if (error) diagnostics.push_back({path, 0, 0, "Could not read directory: " + error.message()});
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        }
+        else {
+            files.push_back(path);
+        }
+    }
+    return files;
+}
+
+// Validate the lines of text that start at firstLine
+inline void checkScriptLines(std::string_view text, int firstLine, const ScriptLineValidator& validate,
+                             std::vector<ScriptDiagnostic>& diagnostics) {
+    int lineNumber = firstLine;
+    size_t position = 0;
+    std::string line;
+    while (position < text.size()) {
+        size_t end = text.find('\n', position);
+        if (end == std::string_view::npos) end = text.size();
+        line.assign(text.data() + position, end - position);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        position = end + 1;
+
+        if (!line.empty() && line[0] != '#') {
+            size_t before = diagnostics.size();
+            validate(line, diagnostics);
+            for (size_t i = before; i < diagnostics.size(); i++) diagnostics[i].line = lineNumber;
+        }
+        lineNumber++;
+    }
+}
+
+/**
+ * @brief Validate command files in parallel and collect every problem
+ *
+ * Each file is read by one task; files longer than chunkLines are cut at line
+ * boundaries and the ranges are validated as separate tasks, which idle workers steal.
+ * Unlike running a file, checking does not stop at the first bad line.
+ *
+ * @param paths Files and directories to check
+ * @param validate Per-line check, called concurrently from worker threads
+ * @param threads Worker count, 0 for one per hardware thread
+ */
+inline ScriptCheckResult checkScripts(const std::vector<std::string>& paths, const ScriptLineValidator& validate,
+                                      unsigned threads = 0, size_t chunkLines = kCheckChunkLines) {
+    ScriptCheckResult result;
+    std::vector<std::string> files = collectScriptFiles(paths, result.diagnostics);
+    result.files = files.size();
+
+    // File contents stay alive until every chunk that views them is done
+    std::vector<std::string> contents(files.size());
+    std::atomic<size_t> lines{0};
+    std::mutex resultMutex;
+
+    auto merge = [&](std::vector<ScriptDiagnostic>& found) {
+        if (found.empty()) return;
+        std::lock_guard<std::mutex> lock(resultMutex);
+        result.diagnostics.insert(result.diagnostics.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+    };
+
+    {
+        WorkStealingPool pool(threads);
+        for (size_t f = 0; f < files.size(); f++) {
+            pool.submit([&, f] {
+                std::ifstream input(files[f], std::ios::binary);
+                if (!input.is_open()) {
+                    std::vector<ScriptDiagnostic> found = {{files[f], 0, 0, "Could not open file"}};
+                    merge(found);
+                    return;
+                }
+                std::ostringstream buffer;
+                buffer << input.rdbuf();
+                contents[f] = buffer.str();
+                std::string_view text = contents[f];
+
+                // Cut at every chunkLines-th newline, remembering the first line number of each range
+                size_t begin = 0;
+                int firstLine = 1;
+                size_t lineCount = 0;
+                const char* data = text.data();
+                size_t position = 0;
+                while (position < text.size()) {
+                    const void* newline = std::memchr(data + position, '\n', text.size() - position);
+                    position = newline ? static_cast<size_t>(static_cast<const char*>(newline) - data) + 1 : text.size();
+                    lineCount++;
+                    if (lineCount % chunkLines == 0 || position == text.size()) {
+                        std::string_view range = text.substr(begin, position - begin);
+                        int rangeLine = firstLine;
+                        pool.submit([&, f, range, rangeLine] {
+                            std::vector<ScriptDiagnostic> found;
+                            checkScriptLines(range, rangeLine, validate, found);
+                            for (ScriptDiagnostic& diagnostic : found) diagnostic.path = files[f];
+                            merge(found);
+                        });
+                        begin = position;
+                        firstLine = static_cast<int>(lineCount) + 1;
+                    }
+                }
+                lines.fetch_add(lineCount, std::memory_order_relaxed);
+            });
+        }
+        pool.wait();
+    }
+
+    result.lines = lines.load();
+    std::stable_sort(result.diagnostics.begin(), result.diagnostics.end(), [](const ScriptDiagnostic& a, const ScriptDiagnostic& b) {
+        if (a.path != b.path) return a.path < b.path;
+        if (a.line != b.line) return a.line < b.line;
+        return a.column < b.column;
+    });
+    return result;
+}
+
+// Compiler-style "path:line:column: error: message"
+inline std::string formatDiagnostic(const ScriptDiagnostic& diagnostic) {
+    std::string text = diagnostic.path;
+    if (diagnostic.line > 0) text += ":" + std::to_string(diagnostic.line) + ":" + std::to_string(diagnostic.column);
+    return text + ": error: " + diagnostic.message;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Lock-free log-bucketed latency histogram (HDR style)
+ *
+ * Values are nanoseconds. Values below 32 ns get exact buckets; above that every
+ * power of two is split into 16 linear sub-buckets, so any recorded value is off
+ * by at most ~6%. Recording is a handful of relaxed atomic operations and never
+ * blocks, so it is safe on the injection hot path and from any thread.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kLinearLimit = 2 * kSubBuckets;
+    static constexpr int kBuckets = kLinearLimit + (64 - (kSubBucketBits + 1)) * kSubBuckets;
+
+    void record(std::chrono::nanoseconds value) {
+        recordNs(value.count() > 0 ? static_cast<uint64_t>(value.count()) : 0);
+    }
+
+    void recordNs(uint64_t ns) {
+        buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(ns, std::memory_order_relaxed);
+
+        uint64_t seen = minimum.load(std::memory_order_relaxed);
+        while (ns < seen && !minimum.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+        }
+        seen = maximum.load(std::memory_order_relaxed);
+        while (ns > seen && !maximum.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Add every value recorded in other, e.g. to report several injectors as one
+    void merge(const LatencyHistogram& other) {
+        if (other.count() == 0) return;
+        for (int i = 0; i < kBuckets; i++) {
+            uint64_t c = other.bucketCount(i);
+            if (c) buckets[i].fetch_add(c, std::memory_order_relaxed);
+        }
+        total.fetch_add(other.count(), std::memory_order_relaxed);
+        sum.fetch_add(other.sumNs(), std::memory_order_relaxed);
+
+        uint64_t seen = minimum.load(std::memory_order_relaxed);
+        while (other.minNs() < seen && !minimum.compare_exchange_weak(seen, other.minNs(), std::memory_order_relaxed)) {
+        }
+        seen = maximum.load(std::memory_order_relaxed);
+        while (other.maxNs() > seen && !maximum.compare_exchange_weak(seen, other.maxNs(), std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t sumNs() const { return sum.load(std::memory_order_relaxed); }
+    uint64_t minNs() const { return count() ? minimum.load(std::memory_order_relaxed) : 0; }
+    uint64_t maxNs() const { return maximum.load(std::memory_order_relaxed); }
+    uint64_t bucketCount(int index) const { return buckets[index].load(std::memory_order_relaxed); }
+
+    // Value at the given percentile (0-100), reported as the upper edge of its bucket
+    uint64_t percentileNs(double percentile) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(n) + 0.5);
+        rank = std::clamp<uint64_t>(rank, 1, n);
+
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; i++) {
+            seen += bucketCount(i);
+            if (seen >= rank) return std::min(bucketUpperNs(i), maxNs());
+        }
+        return maxNs();
+    }
+
+    static int bucketIndex(uint64_t ns) {
+        if (ns < kLinearLimit) return static_cast<int>(ns);
+        int msb = std::bit_width(ns) - 1;
+        int shift = msb - kSubBucketBits;
+        int sub = static_cast<int>((ns >> shift) & (kSubBuckets - 1));
+        return kLinearLimit + (msb - kSubBucketBits - 1) * kSubBuckets + sub;
+    }
+
+    // Smallest value that falls into the given bucket
+    static uint64_t bucketLowerNs(int index) {
+        if (index < kLinearLimit) return static_cast<uint64_t>(index);
+        int group = (index - kLinearLimit) / kSubBuckets;
+        int sub = (index - kLinearLimit) % kSubBuckets;
+        int shift = group + 1;
+        return static_cast<uint64_t>(kSubBuckets + sub) << shift;
+    }
+
+    // Largest value that falls into the given bucket
+    static uint64_t bucketUpperNs(int index) {
+        return (index + 1 < kBuckets) ? bucketLowerNs(index + 1) - 1 : UINT64_MAX;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> minimum{UINT64_MAX};
+    std::atomic<uint64_t> maximum{0};
+};
+
+// Histogram plus the metadata used when reporting it
+struct NamedHistogram {
+    const char* name;
+    const char* help;
+    const LatencyHistogram* histogram;
+};
+
+// Write a JSON object with count, mean, min/max and percentiles in microseconds, plus the non-empty buckets
+inline void writeHistogramsJson(std::ostream& out, const std::vector<NamedHistogram>& histograms) {
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+
+    out << "{\n";
+    for (size_t h = 0; h < histograms.size(); h++) {
+        const LatencyHistogram& histogram = *histograms[h].histogram;
+        uint64_t n = histogram.count();
+
+        out << "  \"" << histograms[h].name << "\": {";
+        out << "\"count\": " << n;
+        out << ", \"mean_us\": " << (n ? us(histogram.sumNs()) / static_cast<double>(n) : 0.0);
+        out << ", \"min_us\": " << us(histogram.minNs());
+        out << ", \"p50_us\": " << us(histogram.percentileNs(50));
+        out << ", \"p90_us\": " << us(histogram.percentileNs(90));
+        out << ", \"p99_us\": " << us(histogram.percentileNs(99));
+        out << ", \"p999_us\": " << us(histogram.percentileNs(99.9));
+        out << ", \"max_us\": " << us(histogram.maxNs());
+        out << ", \"buckets\": [";
+        bool first = true;
+        for (int i = 0; i < LatencyHistogram::kBuckets; i++) {
+            uint64_t c = histogram.bucketCount(i);
+            if (c == 0) continue;
+            out << (first ? "" : ", ") << "[" << us(LatencyHistogram::bucketUpperNs(i)) << ", " << c << "]";
+            first = false;
+        }
+        out << "]}" << (h + 1 < histograms.size() ? "," : "") << "\n";
+    }
+    out << "}\n";
+}
+
+// Write Prometheus text exposition format histograms in seconds, emitting only the non-empty buckets
+inline void writeHistogramsPrometheus(std::ostream& out, const std::vector<NamedHistogram>& histograms) {
+    auto seconds = [](uint64_t ns) { return static_cast<double>(ns) / 1e9; };
+
+    for (const NamedHistogram& named : histograms) {
+        const LatencyHistogram& histogram = *named.histogram;
+        std::string name = std::string("input_simulator_") + named.name + "_seconds";
+
+        out << "# HELP " << name << " " << named.help << "\n";
+        out << "# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        for (int i = 0; i < LatencyHistogram::kBuckets; i++) {
+            uint64_t c = histogram.bucketCount(i);
+            if (c == 0) continue;
+            cumulative += c;
+            out << name << "_bucket{le=\"" << seconds(LatencyHistogram::bucketUpperNs(i)) << "\"} " << cumulative << "\n";
+        }
+        out << name << "_bucket{le=\"+Inf\"} " << histogram.count() << "\n";
+        out << name << "_sum " << seconds(histogram.sumNs()) << "\n";
+        out << name << "_count " << histogram.count() << "\n";
+    }
+}
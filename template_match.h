@@ -0,0 +1,514 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.h"
+
+// Grayscale image with float samples, row-major
+struct GrayImage {
+    int width = 0;
+    int height = 0;
+    std::vector<float> data;
+
+    const float* row(int y) const { return data.data() + static_cast<size_t>(y) * width; }
+};
+
+// Luma of every pixel (ITU-R BT.601 weights)
+inline GrayImage toGray(const Frame& frame) {
+    GrayImage gray;
+    gray.width = frame.width;
+    gray.height = frame.height;
+    gray.data.resize(frame.pixels.size());
+    for (size_t i = 0; i < frame.pixels.size(); i++) {
+        uint32_t p = frame.pixels[i];
+        gray.data[i] = 0.299f * ((p >> 16) & 0xFF) + 0.587f * ((p >> 8) & 0xFF) + 0.114f * (p & 0xFF);
+    }
+    return gray;
+}
+
+// Luma at half resolution straight from the frame, skipping the full-size gray image
+inline GrayImage toGrayHalf(const Frame& frame) {
+    auto luma = [](uint32_t p) { return 0.299f * ((p >> 16) & 0xFF) + 0.587f * ((p >> 8) & 0xFF) + 0.114f * (p & 0xFF); };
+
+    GrayImage half;
+    half.width = frame.width / 2;
+    half.height = frame.height / 2;
+    half.data.resize(static_cast<size_t>(half.width) * half.height);
+    for (int y = 0; y < half.height; y++) {
+        const uint32_t* top = frame.pixels.data() + static_cast<size_t>(2 * y) * frame.width;
+        const uint32_t* bottom = top + frame.width;
+        float* out = half.data.data() + static_cast<size_t>(y) * half.width;
+        for (int x = 0; x < half.width; x++) {
+            out[x] = 0.25f * (luma(top[2 * x]) + luma(top[2 * x + 1]) + luma(bottom[2 * x]) + luma(bottom[2 * x + 1]));
+        }
+    }
+    return half;
+}
+
+// Halve both dimensions by averaging 2x2 blocks
+inline GrayImage downsample(const GrayImage& image) {
+    GrayImage half;
+    half.width = image.width / 2;
+    half.height = image.height / 2;
+    half.data.resize(static_cast<size_t>(half.width) * half.height);
+    for (int y = 0; y < half.height; y++) {
+        const float* top = image.row(2 * y);
+        const float* bottom = image.row(2 * y + 1);
+        float* out = half.data.data() + static_cast<size_t>(y) * half.width;
+        for (int x = 0; x < half.width; x++) {
+            out[x] = 0.25f * (top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1]);
+        }
+    }
+    return half;
+}
+
+// Correlation numerators for count (<= 8) neighbouring positions starting at (x, y). Scalar reference.
+inline void correlateSpanScalar(const GrayImage& image, const GrayImage& t, int x, int y, int count, float* out) {
+    for (int k = 0; k < count; k++) {
+        float sum = 0;
+        for (int row = 0; row < t.height; row++) {
+            const float* img = image.row(y + row) + x + k;
+            const float* tpl = t.row(row);
+            for (int i = 0; i < t.width; i++) sum += tpl[i] * img[i];
+        }
+        out[k] = sum;
+    }
+}
+
+#ifdef FRAMEBUFFER_X86
+// Four positions at once: each template sample is broadcast against four shifted image samples
+inline void correlateSpanSse2(const GrayImage& image, const GrayImage& t, int x, int y, int count, float* out) {
+    if (count < 4) return correlateSpanScalar(image, t, x, y, count, out);
+    __m128 acc = _mm_setzero_ps();
+    for (int row = 0; row < t.height; row++) {
+        const float* img = image.row(y + row) + x;
+        const float* tpl = t.row(row);
+        for (int i = 0; i < t.width; i++) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(tpl[i]), _mm_loadu_ps(img + i)));
+        }
+    }
+    _mm_storeu_ps(out, acc);
+    if (count > 4) correlateSpanScalar(image, t, x + 4, y, count - 4, out + 4);
+}
+
+
+// Eight positions at once, as above with 256-bit vectors
+FRAMEBUFFER_TARGET_AVX2 inline void correlateSpanAvx2(const GrayImage& image, const GrayImage& t, int x, int y, int count, float* out) {
+    if (count < 8) return correlateSpanSse2(image, t, x, y, count, out);
+    __m256 acc = _mm256_setzero_ps();
+    for (int row = 0; row < t.height; row++) {
+        const float* img = image.row(y + row) + x;
+        const float* tpl = t.row(row);
+        for (int i = 0; i < t.width; i++) {
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(tpl[i]), _mm256_loadu_ps(img + i)));
+        }
+    }
+    _mm256_storeu_ps(out, acc);
+}
+#endif
+
+constexpr int kSpanWidth = 8;
+
+inline void correlateSpan(const GrayImage& image, const GrayImage& t, int x, int y, int count, float* out, SimdLevel level) {
+#ifdef FRAMEBUFFER_X86
+    // A hand-set MatchOptions may ask for AVX2 on a CPU without it
+    if (level == SimdLevel::AVX2 && bestSimdLevel() == SimdLevel::AVX2) return correlateSpanAvx2(image, t, x, y, count, out);
+    if (level != SimdLevel::Scalar) {
+        correlateSpanSse2(image, t, x, y, std::min(count, 4), out);
+        if (count > 4) correlateSpanSse2(image, t, x + 4, y, count - 4, out + 4);
+        return;
+    }
+#endif
+    correlateSpanScalar(image, t, x, y, count, out);
+}
+
+// Summed-area tables of an image and its squares, for O(1) window variance
+struct IntegralImage {
+    int width = 0;  // Image width + 1
+    std::vector<double> sum;
+    std::vector<double> sumSquares;
+
+    explicit IntegralImage(const GrayImage& image) : width(image.width + 1) {
+        size_t size = static_cast<size_t>(width) * (image.height + 1);
+        sum.assign(size, 0.0);
+        sumSquares.assign(size, 0.0);
+        for (int y = 0; y < image.height; y++) {
+            double rowSum = 0, rowSquares = 0;
+            const float* row = image.row(y);
+            for (int x = 0; x < image.width; x++) {
+                rowSum += row[x];
+                rowSquares += static_cast<double>(row[x]) * row[x];
+                size_t at = static_cast<size_t>(y + 1) * width + x + 1;
+                sum[at] = sum[at - width] + rowSum;
+                sumSquares[at] = sumSquares[at - width] + rowSquares;
+            }
+        }
+    }
+
+    // Sum of squared deviations from the mean over a window
+    double windowEnergy(int x, int y, int w, int h) const {
+        auto box = [&](const std::vector<double>& table) {
+            size_t top = static_cast<size_t>(y) * width, bottom = static_cast<size_t>(y + h) * width;
+            return table[bottom + x + w] - table[bottom + x] - table[top + x + w] + table[top + x];
+        };
+        double s = box(sum);
+        return box(sumSquares) - s * s / (static_cast<double>(w) * h);
+    }
+};
+
+// One pyramid level of a template, stored zero-mean so the correlation needs no image mean
+struct TemplateLevel {
+    GrayImage zeroMean;
+    double norm = 0;  // sqrt of the sum of squared deviations
+};
+
+// Template prepared once for coarse-to-fine search
+struct TemplatePyramid {
+    std::vector<TemplateLevel> levels;  // levels[0] is full resolution
+};
+
+constexpr int kMaxPyramidLevels = 5;
+constexpr int kMinCoarseTemplateSide = 4;
+constexpr int kMinCoarseTemplateArea = 48;
+
+// Number of levels that keep the coarsest template big enough to still be distinctive
+inline int pyramidDepthFor(int templateWidth, int templateHeight) {
+    int levels = 1;
+    while (levels < kMaxPyramidLevels && std::min(templateWidth, templateHeight) / 2 >= kMinCoarseTemplateSide &&
+           (templateWidth / 2) * (templateHeight / 2) >= kMinCoarseTemplateArea) {
+        templateWidth /= 2;
+        templateHeight /= 2;
+        levels++;
+    }
+    return levels;
+}
+
+// A level must keep this fraction of the full-resolution contrast, or fine texture would vanish from the coarse search
+constexpr double kMinRetainedContrast = 0.35;
+
+inline TemplatePyramid buildTemplatePyramid(const Frame& image) {
+    TemplatePyramid pyramid;
+    GrayImage level = toGray(image);
+    int depth = pyramidDepthFor(image.width, image.height);
+    for (int l = 0; l < depth; l++) {
+        if (l > 0) level = downsample(level);
+
+        TemplateLevel prepared;
+        prepared.zeroMean = level;
+        double mean = 0;
+        for (float v : level.data) mean += v;
+        mean /= static_cast<double>(level.data.size());
+        double energy = 0;
+        for (float& v : prepared.zeroMean.data) {
+            v = static_cast<float>(v - mean);
+            energy += static_cast<double>(v) * v;
+        }
+        prepared.norm = std::sqrt(energy);
+
+        if (l > 0) {
+            const TemplateLevel& full = pyramid.levels[0];
+            double contrast = prepared.norm / std::sqrt(static_cast<double>(level.data.size()));
+            double fullContrast = full.norm / std::sqrt(static_cast<double>(full.zeroMean.data.size()));
+            if (contrast < kMinRetainedContrast * fullContrast) break;
+        }
+        pyramid.levels.push_back(std::move(prepared));
+    }
+    return pyramid;
+}
+
+struct MatchResult {
+    bool found = false;
+    int x = -1;  // Top-left of the best match, in frame coordinates
+    int y = -1;
+    float score = 0;  // Normalized cross-correlation, -1..1
+};
+
+struct MatchOptions {
+    float threshold = 0.9f;        // Minimum score to accept a match
+    int threads = 0;               // Worker threads for the coarse search (0: one per core)
+    SimdLevel simd = bestSimdLevel();
+    bool usePyramid = true;        // Disable to search exhaustively at full resolution
+};
+
+// Sum of squared deviations from the mean over a window, computed directly
+inline double windowEnergy(const GrayImage& image, int x, int y, int w, int h) {
+    double sum = 0, sumSquares = 0;
+    for (int row = 0; row < h; row++) {
+        const float* p = image.row(y + row) + x;
+        for (int i = 0; i < w; i++) {
+            sum += p[i];
+            sumSquares += static_cast<double>(p[i]) * p[i];
+        }
+    }
+    return sumSquares - sum * sum / (static_cast<double>(w) * h);
+}
+
+/**
+ * @brief Normalized cross-correlation from a position's numerator and window energy
+ *
+ * The template is zero-mean, so the numerator is a plain dot product with the
+ * image window and the image mean drops out.
+ */
+inline float normalizedScore(float numerator, double energy, const TemplateLevel& tpl) {
+    const GrayImage& t = tpl.zeroMean;
+    // Flat window or flat template; the threshold absorbs rounding in the integral tables
+    if (energy <= 1e-3 * t.width * t.height || tpl.norm <= 1e-6) return 0;
+    return static_cast<float>(std::clamp(numerator / (std::sqrt(energy) * tpl.norm), -1.0, 1.0));
+}
+
+// Best few positions of a search, kept sorted by score
+struct CandidateList {
+    static constexpr size_t kCapacity = 16;
+    std::vector<MatchResult> items;
+
+    void offer(int x, int y, float score, int separation) {
+        if (items.size() == kCapacity && score <= items.back().score) return;
+        // Keep only the better of two candidates that overlap
+        for (auto& item : items) {
+            if (std::abs(item.x - x) < separation && std::abs(item.y - y) < separation) {
+                if (score <= item.score) return;
+                item = {true, x, y, score};
+                std::sort(items.begin(), items.end(), [](const MatchResult& a, const MatchResult& b) { return a.score > b.score; });
+                return;
+            }
+        }
+        items.push_back({true, x, y, score});
+        std::sort(items.begin(), items.end(), [](const MatchResult& a, const MatchResult& b) { return a.score > b.score; });
+        if (items.size() > kCapacity) items.pop_back();
+    }
+};
+
+// Exhaustive search of every position, with rows partitioned across threads
+inline CandidateList searchExhaustive(const GrayImage& image, const IntegralImage& integral, const TemplateLevel& tpl, const MatchOptions& options) {
+    int rows = image.height - tpl.zeroMean.height + 1;
+    int cols = image.width - tpl.zeroMean.width + 1;
+    CandidateList merged;
+    if (rows <= 0 || cols <= 0) return merged;
+
+    int separation = std::max(1, std::min(tpl.zeroMean.width, tpl.zeroMean.height) / 2);
+    int threads = options.threads > 0 ? options.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::min(threads, rows);
+
+    std::vector<CandidateList> partial(threads);
+    auto work = [&](int index) {
+        int begin = rows * index / threads;
+        int end = rows * (index + 1) / threads;
+        float numerators[kSpanWidth];
+        for (int y = begin; y < end; y++) {
+            for (int x = 0; x < cols; x += kSpanWidth) {
+                int count = std::min(kSpanWidth, cols - x);
+                correlateSpan(image, tpl.zeroMean, x, y, count, numerators, options.simd);
+                for (int k = 0; k < count; k++) {
+                    double energy = integral.windowEnergy(x + k, y, tpl.zeroMean.width, tpl.zeroMean.height);
+                    partial[index].offer(x + k, y, normalizedScore(numerators[k], energy, tpl), separation);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; i++) workers.emplace_back(work, i);
+    work(0);
+    for (auto& worker : workers) worker.join();
+
+    for (const auto& list : partial) {
+        for (const auto& item : list.items) merged.offer(item.x, item.y, item.score, separation);
+    }
+    return merged;
+}
+
+// Best position within radius of (centerX, centerY). Few windows, so no integral image is needed.
+inline MatchResult searchAround(const GrayImage& image, const TemplateLevel& tpl, int centerX, int centerY, int radius, SimdLevel simd) {
+    MatchResult best;
+    best.score = -2;
+    int maxX = image.width - tpl.zeroMean.width;
+    int maxY = image.height - tpl.zeroMean.height;
+    int firstX = std::max(0, centerX - radius);
+    int lastX = std::min(maxX, centerX + radius);
+    float numerators[kSpanWidth];
+    for (int y = std::max(0, centerY - radius); y <= std::min(maxY, centerY + radius); y++) {
+        for (int x = firstX; x <= lastX; x += kSpanWidth) {
+            int count = std::min(kSpanWidth, lastX - x + 1);
+            correlateSpan(image, tpl.zeroMean, x, y, count, numerators, simd);
+            for (int k = 0; k < count; k++) {
+                double energy = windowEnergy(image, x + k, y, tpl.zeroMean.width, tpl.zeroMean.height);
+                float score = normalizedScore(numerators[k], energy, tpl);
+                if (score > best.score) best = {true, x + k, y, score};
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Locate a template in a frame with coarse-to-fine normalized cross-correlation
+ *
+ * The coarsest pyramid level is searched exhaustively; the best candidates are
+ * then refined in a small window at every finer level down to full resolution.
+ */
+inline MatchResult findTemplate(const Frame& frame, const TemplatePyramid& pyramid, const MatchOptions& options = {}) {
+    MatchResult result;
+    if (pyramid.levels.empty() || frame.width < pyramid.levels[0].zeroMean.width || frame.height < pyramid.levels[0].zeroMean.height) {
+        return result;
+    }
+
+    const TemplateLevel& full = pyramid.levels[0];
+    int depth = options.usePyramid ? static_cast<int>(pyramid.levels.size()) : 1;
+
+    // Stop at a level where the frame is no larger than the template
+    while (depth > 1 && ((frame.width >> (depth - 1)) < pyramid.levels[depth - 1].zeroMean.width ||
+                         (frame.height >> (depth - 1)) < pyramid.levels[depth - 1].zeroMean.height)) {
+        depth--;
+    }
+
+    // Only the reduced levels are built in full; level 0 is only looked at around candidates
+    std::vector<GrayImage> levels(depth);
+    if (depth == 1) {
+        levels[0] = toGray(frame);
+    }
+    else {
+        levels[1] = toGrayHalf(frame);
+        for (int l = 2; l < depth; l++) levels[l] = downsample(levels[l - 1]);
+    }
+
+    int coarsest = depth - 1;
+    IntegralImage coarseIntegral(levels[coarsest]);
+    CandidateList candidates = searchExhaustive(levels[coarsest], coarseIntegral, pyramid.levels[coarsest], options);
+
+    result.score = -2;
+    for (MatchResult candidate : candidates.items) {
+        for (int l = coarsest - 1; l >= 1; l--) {
+            candidate = searchAround(levels[l], pyramid.levels[l], candidate.x * 2, candidate.y * 2, 2, options.simd);
+        }
+        if (coarsest > 0) {
+            // Refine at full resolution on a gray crop just big enough for the search window
+            PixelRect window;
+            window.x = std::max(0, candidate.x * 2 - 2);
+            window.y = std::max(0, candidate.y * 2 - 2);
+            window.width = std::min(frame.width - window.x, full.zeroMean.width + 4);
+            window.height = std::min(frame.height - window.y, full.zeroMean.height + 4);
+            Frame crop;
+            if (!cropFrame(frame, window, crop)) continue;
+            candidate = searchAround(toGray(crop), full, candidate.x * 2 - window.x, candidate.y * 2 - window.y, 2, options.simd);
+            candidate.x += window.x;
+            candidate.y += window.y;
+        }
+        if (candidate.score > result.score) result = candidate;
+    }
+
+    result.found = result.score >= options.threshold;
+    return result;
+}
+
+// Cheap 64-bit fingerprint of a frame's pixels
+inline uint64_t hashFrame(const Frame& frame) {
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ (static_cast<uint64_t>(frame.width) << 32 | static_cast<uint32_t>(frame.height));
+    const uint32_t* pixels = frame.pixels.data();
+    size_t count = frame.pixels.size();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        uint64_t word = static_cast<uint64_t>(pixels[i]) | static_cast<uint64_t>(pixels[i + 1]) << 32;
+        hash = (hash ^ word) * 0x100000001B3ull;
+        hash ^= hash >> 29;
+    }
+    if (i < count) hash = (hash ^ pixels[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+/**
+ * @brief Loads templates once and remembers the last result per template and region
+ *
+ * A search on a frame identical to the previous one for the same template and
+ * region returns the cached result without correlating anything.
+ */
+class TemplateMatcher {
+public:
+    explicit TemplateMatcher(MatchOptions options = {}) : options(options) {}
+
+    // Changing the threshold invalidates cached results
+    void setOptions(const MatchOptions& newOptions) {
+        if (newOptions.threshold != options.threshold) results.clear();
+        options = newOptions;
+    }
+
+    // Returns false if the template could not be loaded
+    bool find(const std::string& templatePath, const Frame& frame, const PixelRect& region, MatchResult& result) {
+        const LoadedTemplate* pyramid = loadTemplate(templatePath);
+        if (!pyramid) return false;
+
+        std::string key = templatePath + "@" + std::to_string(region.x) + "," + std::to_string(region.y) + "," +
+                          std::to_string(region.width) + "x" + std::to_string(region.height);
+        uint64_t fingerprint = hashFrame(frame);
+
+        auto cached = results.find(key);
+        if (cached != results.end() && cached->second.fingerprint == fingerprint && cached->second.generation == pyramid->generation) {
+            cacheHits++;
+            result = cached->second.result;
+        }
+        else {
+            result = findTemplate(frame, pyramid->pyramid, options);
+            results[key] = {fingerprint, pyramid->generation, result};
+        }
+
+        // Report in screen coordinates
+        if (result.found) {
+            result.x += region.x;
+            result.y += region.y;
+        }
+        return true;
+    }
+
+    // Size of a loaded template, for turning a match into its center
+    bool templateSize(const std::string& templatePath, int& width, int& height) {
+        const LoadedTemplate* loaded = loadTemplate(templatePath);
+        if (!loaded) return false;
+        width = loaded->pyramid.levels[0].zeroMean.width;
+        height = loaded->pyramid.levels[0].zeroMean.height;
+        return true;
+    }
+
+    uint64_t hits() const { return cacheHits; }
+
+private:
+    struct LoadedTemplate {
+        std::filesystem::file_time_type modified;
+        TemplatePyramid pyramid;
+        uint64_t generation = 0;  // Changes whenever the template is (re)loaded
+    };
+
+    struct CachedResult {
+        uint64_t fingerprint;
+        uint64_t generation;
+        MatchResult result;
+    };
+
+    // Load or reuse a template pyramid, rebuilding it when the file changes
+    const LoadedTemplate* loadTemplate(const std::string& path) {
+        std::error_code error;
+        auto modified = std::filesystem::last_write_time(path, error);
+        if (error) return nullptr;
+
+        auto& loaded = templates[path];
+        if (loaded.generation == 0 || loaded.modified != modified) {
+            Frame image;
+            if (!loadPpm(path, image)) return nullptr;
+            loaded.pyramid = buildTemplatePyramid(image);
+            loaded.modified = modified;
+            loaded.generation = ++generations;
+        }
+        return &loaded;
+    }
+
+    MatchOptions options;
+    std::map<std::string, LoadedTemplate> templates;
+    std::map<std::string, CachedResult> results;
+    uint64_t generations = 0;
+    uint64_t cacheHits = 0;
+};
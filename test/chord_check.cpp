@@ -0,0 +1,78 @@
+// Checks of the key events compileChords emits. Builds anywhere:
+//   g++ -std=c++20 -O2 -I.. chord_check.cpp -o chord_check
+//   ./chord_check
+// Each case runs a few key commands through one held-key state, as a command file would,
+// and compares the events with the expected ones.
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "chord.h"
+
+constexpr uint16_t kCtrl = 0x11;
+constexpr uint16_t kShift = 0x10;
+constexpr uint16_t kC = 'C';
+
+struct Step {
+    std::vector<KeyChord> chords;
+    ChordAction action;
+};
+
+std::string describe(const std::vector<InputEvent>& events) {
+    std::string text;
+    for (const InputEvent& event : events) {
+        text += (event.type == InputEventType::KeyDown) ? " down " : " up ";
+        text += std::to_string(event.code);
+    }
+    return text.empty() ? " (none)" : text;
+}
+
+bool check(const std::string& name, const std::vector<Step>& steps, const std::vector<InputEvent>& expected, const KeyState& held) {
+    KeyState state;
+    InjectClock::time_point deadline = InjectClock::now();
+    std::vector<InputEvent> events;
+    for (const Step& step : steps) compileChords(step.chords, step.action, std::chrono::milliseconds(0), state, deadline, events);
+
+    bool same = events.size() == expected.size() && state == held;
+    for (size_t i = 0; same && i < events.size(); i++) {
+        same = events[i].type == expected[i].type && events[i].code == expected[i].code;
+    }
+    std::cout << (same ? "  ok      " : "  FAILED  ") << name << "\n";
+    if (!same) std::cout << "    got" << describe(events) << ", expected" << describe(expected) << "\n";
+    return same;
+}
+
+InputEvent down(uint16_t code) {
+    InputEvent event;
+    event.type = InputEventType::KeyDown;
+    event.code = code;
+    return event;
+}
+
+InputEvent up(uint16_t code) {
+    InputEvent event;
+    event.type = InputEventType::KeyUp;
+    event.code = code;
+    return event;
+}
+
+int main() {
+    bool ok = true;
+    KeyState none;
+    KeyState ctrl;
+    ctrl[kCtrl] = true;
+
+    ok = check("ctrl+shift+c clicks in order and releases in reverse", {{{{kCtrl, kShift, kC}}, ChordAction::Click}},
+               {down(kCtrl), down(kShift), down(kC), up(kC), up(kShift), up(kCtrl)}, none) && ok;
+    ok = check("a held ctrl is not pressed again by ctrl+c", {{{{kCtrl}}, ChordAction::Press}, {{{kCtrl, kC}}, ChordAction::Click}},
+               {down(kCtrl), down(kC), up(kC)}, ctrl) && ok;
+    // Nothing is left to press, so the click must not be dropped: the key goes up and down again and stays held
+    ok = check("key_ctrl down, key_ctrl click", {{{{kCtrl}}, ChordAction::Press}, {{{kCtrl}}, ChordAction::Click}},
+               {down(kCtrl), up(kCtrl), down(kCtrl)}, ctrl) && ok;
+    ok = check("key_ctrl down, key_ctrl click, key_ctrl up",
+               {{{{kCtrl}}, ChordAction::Press}, {{{kCtrl}}, ChordAction::Click}, {{{kCtrl}}, ChordAction::Release}},
+               {down(kCtrl), up(kCtrl), down(kCtrl), up(kCtrl)}, none) && ok;
+
+    if (!ok) std::cout << "FAILED\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+// Benchmark for the executor's per-event path. Builds wherever main.cpp does:
+//   g++ -std=c++20 -O2 -pthread -I.. executor_bench.cpp -o executor_bench
+//   ./executor_bench [moves] [duration ms]
+// Runs smooth moves three ways into a backend that only counts: bare enqueueEvent calls for the
+// same number of frames, the executor as it was with the easing mode compared as a string and
+// -v / -c checked at run time on every frame, and main.cpp's own kCommandHandlers entry for -c.
+// The injection thread is not started; the queued events are handed to the backend between
+// batches of moves, so only the executor side is timed. Checks that all three queue the same
+// number of frames and that both executors emit the same ones.
+#define main input_simulator_main
+#include "main.cpp"
+#undef main
+
+#include <iomanip>
+
+using Clock = std::chrono::steady_clock;
+
+// Adds up what it gets, so no loop can be optimized away
+class CountingBackend : public InputBackend {
+public:
+    void submit(const InputEvent* events, size_t count) override {
+        for (size_t i = 0; i < count; i++) checksum += static_cast<uint64_t>(events[i].x) * 31 + static_cast<uint64_t>(events[i].y) + events[i].flags;
+        submitted += count;
+    }
+    uint64_t checksum = 0;
+    uint64_t submitted = 0;
+};
+
+// Run-time options of the old path; volatile, as they come from the command line there
+volatile bool verboseFlag = false;
+volatile bool consistentFlag = true;
+std::atomic<bool> dpiAware{true};
+
+double calculateEasing(double t, const std::string& mode) {
+    if (mode == "linear") return t;
+    if (mode == "ease") {
+        if (t < 0.5) return 4 * t * t * t;
+        double f = (t - 1);
+        return 1 + 4 * f * f * f;
+    }
+    return t;
+}
+
+// The frame loop and SetConsistentCursorPos as they were before the specialization, on main.cpp's timeline and queue
+void runtimeMove(const CommandLineArgs& args) {
+    timeline = std::max(timeline, InjectClock::now());
+    enqueueEvent(InputEventType::Marker, MARKER_COMMAND_BEGIN);
+    int startX = lastPos.x, startY = lastPos.y;
+    if (startX != args.x || startY != args.y) {
+        int duration = args.smoothTime;
+        int targetFPS = (duration > 500) ? 60 : 120;
+        auto frameTime = std::chrono::milliseconds(1000 / targetFPS);
+        auto totalTime = std::chrono::milliseconds(duration);
+        auto startTime = timeline;
+        auto set = [&](int x, int y, uint8_t flags) {
+            if (!dpiAware.load()) dpiAware.store(true);
+            if (consistentFlag) {
+                lastPos.x = x;
+                lastPos.y = y;
+            }
+            if (verboseFlag) std::cout << "    move " << x << "," << y << "\n";
+            enqueueEvent(InputEventType::MouseMove, 0, x, y, flags);
+        };
+        for (auto elapsed = std::chrono::milliseconds(0); elapsed < totalTime; elapsed += frameTime) {
+            timeline = startTime + elapsed;
+            double easedT = calculateEasing(static_cast<double>(elapsed.count()) / duration, args.smooth);
+            set(startX + static_cast<int>((args.x - startX) * easedT), startY + static_cast<int>((args.y - startY) * easedT),
+                (elapsed.count() > 0) ? EVENT_FLAG_FRAME : 0);
+        }
+        timeline = startTime + totalTime;
+        set(args.x, args.y, EVENT_FLAG_FRAME);
+    }
+    enqueueEvent(InputEventType::Marker, MARKER_COMMAND_END);
+}
+
+// The same frame count and markers, with nothing computed per frame
+void bareMove(const CommandLineArgs& args) {
+    timeline = std::max(timeline, InjectClock::now());
+    enqueueEvent(InputEventType::Marker, MARKER_COMMAND_BEGIN);
+    if (lastPos.x != args.x || lastPos.y != args.y) {
+        auto frameTime = smoothFrameTime(args.smoothTime);
+        int frames = static_cast<int>((args.smoothTime + frameTime.count() - 1) / frameTime.count()) + 1;
+        for (int f = 0; f < frames; f++) enqueueEvent(InputEventType::MouseMove, 0, args.x, f, EVENT_FLAG_FRAME);
+        lastPos.x = args.x;
+        lastPos.y = args.y;
+    }
+    enqueueEvent(InputEventType::Marker, MARKER_COMMAND_END);
+}
+
+struct Result {
+    double nsPerEvent;
+    uint64_t checksum;
+    uint64_t events;
+};
+
+// Moves to alternating targets, linear and ease in turn, from the same start for every variant
+template <typename Move>
+Result measure(const std::vector<CommandLineArgs>& moves, Move&& move) {
+    CountingBackend backend;
+    Injector queue(backend);
+    injector = &queue;
+    lastPos = {0, 0};
+    lastPosKnown = true;
+
+    // Keep each batch well inside the ring, so a push never waits for room
+    constexpr size_t kBatch = 32;
+    auto start = Clock::now();
+    for (size_t i = 0; i < moves.size(); i++) {
+        move(moves[i]);
+        if (i % kBatch == kBatch - 1) queue.drainNow();
+    }
+    queue.drainNow();
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    injector = &defaultInjector;
+    return {ns / static_cast<double>(backend.submitted), backend.checksum, backend.submitted};
+}
+
+int main(int argc, char* argv[]) {
+    int count = (argc > 1) ? std::stoi(argv[1]) : 200000;
+    int duration = (argc > 2) ? std::stoi(argv[2]) : 300;
+
+    std::vector<CommandLineArgs> moves;
+    std::vector<ScriptDiagnostic> diagnostics;
+    for (int i = 0; i < count; i++) {
+        std::string line = "-k mouse_move -x " + std::to_string((i * 37) % 1920) + " -y " + std::to_string((i * 53) % 1080) + " -sm " +
+                           (i % 2 == 0 ? "ease" : "linear") + " -smt " + std::to_string(duration);
+        moves.push_back(parseScriptLine(line, diagnostics));
+    }
+    if (!diagnostics.empty()) {
+        std::cerr << formatDiagnostic(diagnostics[0]) << "\n";
+        return 1;
+    }
+
+    CommandHandler specializedHandler = kCommandHandlers[EXECUTOR_CONSISTENT];
+    Result bare = measure(moves, bareMove);
+    Result runtime = measure(moves, runtimeMove);
+    Result specialized = measure(moves, [&](const CommandLineArgs& args) { specializedHandler(args, 0); });
+
+    std::cout << count << " moves of " << duration << " ms, " << specialized.events << " events\n" << std::fixed << std::setprecision(2);
+    std::cout << "  bare enqueueEvent:     " << bare.nsPerEvent << " ns/event\n";
+    std::cout << "  run-time flags:        " << runtime.nsPerEvent << " ns/event (" << runtime.nsPerEvent - bare.nsPerEvent << " over bare)\n";
+    std::cout << "  specialized executor:  " << specialized.nsPerEvent << " ns/event (" << specialized.nsPerEvent - bare.nsPerEvent
+              << " over bare)\n";
+
+    bool ok = bare.events == specialized.events && runtime.events == specialized.events;
+    if (!ok) std::cout << "FAILED: the variants queued " << bare.events << ", " << runtime.events << " and " << specialized.events << " frames\n";
+    if (runtime.checksum != specialized.checksum) {
+        std::cout << "FAILED: the executors emitted different frames\n";
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
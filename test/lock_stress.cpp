@@ -0,0 +1,306 @@
+// Stress test for the cross-process input lock. Linux only:
+//   g++ -std=c++20 -O2 -pthread -I.. lock_stress.cpp -o lock_stress
+//   ./lock_stress [processes] [iterations] [input_simulator]
+// Times uncontended acquisitions, then forks processes that all take the lock in a loop and
+// checks that no two ever hold it at once, while some of them die holding it. A process killed
+// while waiting must not stall the ones behind it, nor one whose pid went to a new process. With the simulator given, it also runs it in
+// parallel with --lock command --record-file and checks that no two commands' events interleave.
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "input_lock.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Shared by the forked processes
+struct Arena {
+    std::atomic<int> inside;       // Processes holding the lock right now
+    std::atomic<uint64_t> overlaps;
+    std::atomic<uint64_t> grants;
+    LatencyHistogram waits;
+};
+
+double ms(uint64_t ns) { return static_cast<double>(ns) / 1e6; }
+
+// Take and release the lock count times; a crasher kills itself holding it half way
+void worker(const std::string& name, Arena* arena, int count, bool crasher) {
+    InputLock lock;
+    if (!lock.open(name, InputLockScope::Command)) _exit(2);
+    for (int i = 0; i < count; i++) {
+        lock.acquire();
+        if (arena->inside.fetch_add(1) != 0) arena->overlaps.fetch_add(1);
+        arena->grants.fetch_add(1);
+        if (crasher && i == count / 2) {
+            arena->inside.fetch_sub(1);  // Dies as if right after its last event, still holding the lock
+            kill(getpid(), SIGKILL);
+        }
+        auto until = Clock::now() + std::chrono::microseconds(2);
+        while (Clock::now() < until) {
+        }
+        arena->inside.fetch_sub(1);
+        lock.release();
+    }
+    arena->waits.merge(lock.waits());
+    _exit(0);
+}
+
+bool contended(const std::string& name, Arena* arena, int processes, int iterations, int crashers) {
+    InputLock probe;
+    probe.open(name, InputLockScope::Command);
+    uint64_t recoveredBefore = probe.totals().recoveries;
+
+    auto start = Clock::now();
+    std::vector<pid_t> children;
+    for (int p = 0; p < processes; p++) {
+        pid_t pid = fork();
+        if (pid == 0) worker(name, arena, iterations, p < crashers);
+        children.push_back(pid);
+    }
+    int finished = 0, killed = 0;
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) finished++;
+        if (WIFSIGNALED(status)) killed++;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    InputLockTotals totals = probe.totals();
+    uint64_t recovered = totals.recoveries - recoveredBefore;
+    std::cout << "  " << processes << " processes x " << iterations << " acquisitions, " << crashers << " dying while holding: "
+              << arena->grants.load() << " grants in " << std::fixed << std::setprecision(2) << seconds << " s ("
+              << std::setprecision(0) << static_cast<double>(arena->grants.load()) / seconds << "/s)\n";
+    std::cout << "    wait p50 " << std::setprecision(3) << ms(arena->waits.percentileNs(50)) << " ms  p99 " << ms(arena->waits.percentileNs(99))
+              << " ms  max " << ms(arena->waits.maxNs()) << " ms | overlaps " << arena->overlaps.load() << " | recovered " << recovered
+              << " | finished " << finished << ", killed " << killed << "\n";
+    return arena->overlaps.load() == 0 && finished == processes - crashers && killed == crashers && recovered == static_cast<uint64_t>(crashers);
+}
+
+// A holds the lock for 300 ms, B queues behind it and is killed while waiting, C queues behind B
+bool deadWaiter(const std::string& name) {
+    auto spawn = [&](int holdMs, int delayMs) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+            InputLock lock;
+            if (!lock.open(name, InputLockScope::Command)) _exit(2);
+            auto start = Clock::now();
+            lock.acquire();
+            int waited = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count());
+            std::this_thread::sleep_for(std::chrono::milliseconds(holdMs));
+            lock.release();
+            _exit(std::min(waited / 10, 250));  // Wait in 10 ms units
+        }
+        return pid;
+    };
+    pid_t a = spawn(300, 0);
+    pid_t b = spawn(0, 50);
+    pid_t c = spawn(0, 100);
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    kill(b, SIGKILL);
+
+    int statusA = 0, statusB = 0, statusC = 0;
+    waitpid(a, &statusA, 0);
+    waitpid(b, &statusB, 0);
+    waitpid(c, &statusC, 0);
+    int waitedC = WIFEXITED(statusC) ? WEXITSTATUS(statusC) * 10 : -1;
+    std::cout << "  Waiter killed in the queue: the next one waited " << waitedC << " ms for a 300 ms hold\n";
+    // C queued at 100 ms, so it gets the lock when A releases at 300 ms, plus a poll or two to skip B
+    return WIFSIGNALED(statusB) && waitedC >= 190 && waitedC < 200 + 2 * static_cast<int>(InputLock::kPoll.count()) + 50;
+}
+
+// The holder dies and the system gives its pid to a new process: waiters must still skip the ticket
+bool reusedPid(const std::string& name) {
+    pid_t holder = fork();
+    if (holder == 0) {
+        InputLock lock;
+        if (!lock.open(name, InputLockScope::Command)) _exit(2);
+        lock.acquire();
+        kill(getpid(), SIGKILL);
+    }
+    waitpid(holder, nullptr, 0);
+    // Start times count clock ticks, so the newcomer has to start a few ticks later to differ
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    pid_t newcomer = fork();  // Stands in for the process that got the pid
+    if (newcomer == 0) {
+        pause();
+        _exit(0);
+    }
+
+    // Put the newcomer's pid on the dead holder's ticket, keeping the holder's start time
+    int fd = shm_open(("/" + name).c_str(), O_RDWR, 0600);
+    void* view = (fd >= 0) ? mmap(nullptr, sizeof(InputLockShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (fd >= 0) close(fd);
+    if (view == MAP_FAILED) return false;
+    auto* shared = static_cast<InputLockShared*>(view);
+    shared->owners[shared->serving.load() % kInputLockSlots].store(static_cast<uint32_t>(newcomer));
+    munmap(view, sizeof(InputLockShared));
+
+    pid_t waiter = fork();
+    if (waiter == 0) {
+        InputLock lock;
+        if (!lock.open(name, InputLockScope::Command)) _exit(2);
+        lock.acquire();
+        lock.release();
+        _exit(0);
+    }
+    int status = 0;
+    bool done = false;
+    auto start = Clock::now();
+    while (!(done = waitpid(waiter, &status, WNOHANG) == waiter) && Clock::now() - start < std::chrono::seconds(2)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    int waited = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count());
+    if (!done) {
+        kill(waiter, SIGKILL);
+        waitpid(waiter, nullptr, 0);
+    }
+    kill(newcomer, SIGKILL);
+    waitpid(newcomer, nullptr, 0);
+    std::cout << "  Holder's pid reused by a live process: " << (done ? "the next one waited " + std::to_string(waited) + " ms" : "STILL WAITING after 2 s")
+              << "\n";
+    return done && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Events of one recording as (time, index of the command they belong to); a command ends with its mouse up
+struct Recorded {
+    int64_t time;
+    int process;
+    int command;
+};
+
+void readRecording(const std::string& path, int process, std::vector<Recorded>& events) {
+    std::ifstream in(path);
+    std::string line;
+    int command = 0;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        int64_t time = 0;
+        std::string name;
+        fields >> time >> name;
+        events.push_back({time, process, command});
+        if (name == "up") command++;
+    }
+}
+
+// Run the simulator in parallel; count the commands whose events another process's events cut into
+bool throughSimulator(const std::string& simulator, int processes, bool locked, int& interleaved) {
+    std::string base = "/tmp/lock_stress_" + std::to_string(getpid());
+    std::string script = base + ".txt";
+    {
+        std::ofstream out(script);
+        for (int i = 0; i < 20; i++) out << "-k mouse_left -x " << 100 + 10 * i << " -y 100 -sm linear -smt 50\n";
+    }
+
+    std::string display = "DISPLAY=:lock_stress_" + std::to_string(getpid());
+    std::vector<char*> env = {const_cast<char*>(display.c_str()), nullptr};
+    std::vector<pid_t> children;
+    for (int p = 0; p < processes; p++) {
+        std::vector<std::string> command = {simulator, "-f", script, "--record-file", base + "_" + std::to_string(p) + ".rec"};
+        if (locked) command.insert(command.end(), {"--lock", "command"});
+        std::vector<char*> argv;
+        for (std::string& arg : command) argv.push_back(arg.data());
+        argv.push_back(nullptr);
+        pid_t pid;
+        if (posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), env.data()) != 0) return false;
+        children.push_back(pid);
+    }
+    bool ok = true;
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    std::vector<Recorded> events;
+    for (int p = 0; p < processes; p++) {
+        std::string path = base + "_" + std::to_string(p) + ".rec";
+        readRecording(path, p, events);
+        unlink(path.c_str());
+    }
+    unlink(script.c_str());
+    shm_unlink(("/input_simulator_lock.:lock_stress_" + std::to_string(getpid())).c_str());
+
+    // In time order, a command is cut into if its events do not follow each other without a gap
+    std::stable_sort(events.begin(), events.end(), [](const Recorded& a, const Recorded& b) { return a.time < b.time; });
+    struct Span {
+        size_t first = SIZE_MAX;
+        size_t last = 0;
+        size_t count = 0;
+    };
+    std::map<std::pair<int, int>, Span> commands;
+    for (size_t i = 0; i < events.size(); i++) {
+        Span& span = commands[{events[i].process, events[i].command}];
+        span.first = std::min(span.first, i);
+        span.last = i;
+        span.count++;
+    }
+    interleaved = 0;
+    for (const auto& [key, span] : commands) {
+        if (span.last - span.first + 1 != span.count) interleaved++;
+    }
+    std::cout << "  " << processes << " simulators " << (locked ? "with" : "without") << " --lock command: " << events.size() << " events, "
+              << interleaved << " commands cut into by another process\n";
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    int processes = (argc > 1) ? std::stoi(argv[1]) : 16;
+    int iterations = (argc > 2) ? std::stoi(argv[2]) : 2000;
+    std::string name = "lock_stress_" + std::to_string(getpid());
+    bool ok = true;
+
+    {
+        InputLock lock;
+        if (!lock.open(name, InputLockScope::Command)) {
+            std::cerr << "Could not open the lock " << name << "\n";
+            return 1;
+        }
+        const int rounds = 1000000;
+        auto start = Clock::now();
+        for (int i = 0; i < rounds; i++) {
+            lock.acquire();
+            lock.release();
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / rounds;
+        std::cout << "Uncontended: " << std::fixed << std::setprecision(1) << ns << " ns per acquire and release\n";
+    }
+
+    std::cout << "Contended\n";
+    void* memory = mmap(nullptr, sizeof(Arena), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    for (int crashers : {0, 4}) {
+        Arena* arena = new (memory) Arena();
+        ok = contended(name, arena, processes, iterations, std::min(crashers, processes - 1)) && ok;
+        arena->~Arena();
+    }
+    ok = deadWaiter(name) && ok;
+    ok = reusedPid(name) && ok;
+    munmap(memory, sizeof(Arena));
+    shm_unlink(("/" + name).c_str());
+
+    if (argc > 3) {
+        std::cout << "Through " << argv[3] << "\n";
+        int unlocked = 0, locked = 0;
+        ok = throughSimulator(argv[3], 8, false, unlocked) && ok;
+        ok = throughSimulator(argv[3], 8, true, locked) && ok;
+        ok = ok && locked == 0;
+    }
+    if (!ok) std::cout << "FAILED\n";
+    return ok ? 0 : 1;
+}
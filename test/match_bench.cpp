@@ -0,0 +1,119 @@
+// Benchmark for template matching. Builds anywhere:
+//   g++ -std=c++20 -O2 -pthread -I.. match_bench.cpp -o match_bench
+// Runs on a synthetic 4K frame; pass "screen.ppm template.ppm" to also run on fixture images.
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include "template_match.h"
+
+// Random UI-like frame: flat panels with noise and a few gradients
+Frame makeSyntheticFrame(int width, int height, uint32_t seed) {
+    Frame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.pixels.resize(static_cast<size_t>(width) * height);
+
+    std::mt19937 rng(seed);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint32_t base = ((x / 160 + y / 90) % 3) * 60 + 40;
+            uint32_t v = std::min<uint32_t>(255, base + (x * 7 + y * 3) % 23 + rng() % 8);
+            frame.pixels[static_cast<size_t>(y) * width + x] = (v << 16) | ((v / 2) << 8) | (255 - v);
+        }
+    }
+    return frame;
+}
+
+// Paste a "button" (border, gradient fill, blocky glyphs) into the frame and return it as a template
+Frame plantTemplate(Frame& frame, int atX, int atY, int width, int height, uint32_t seed) {
+    Frame button;
+    button.width = width;
+    button.height = height;
+    button.pixels.resize(static_cast<size_t>(width) * height);
+
+    std::mt19937 rng(seed);
+    std::vector<bool> glyphs(static_cast<size_t>(width / 6) * (height / 8));
+    for (size_t i = 0; i < glyphs.size(); i++) glyphs[i] = rng() % 2;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint32_t v = 200 - y * 2;
+            bool border = x < 2 || y < 2 || x >= width - 2 || y >= height - 2;
+            bool inText = y >= 8 && y < height - 8 && x >= 6 && x < width - 6;
+            if (border || (inText && glyphs[static_cast<size_t>(y / 8) * (width / 6) + x / 6])) v = 30;
+            button.pixels[static_cast<size_t>(y) * width + x] = (v << 16) | (v << 8) | std::min<uint32_t>(255, v + 40);
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            frame.pixels[static_cast<size_t>(atY + y) * frame.width + atX + x] = button.pixels[static_cast<size_t>(y) * width + x];
+        }
+    }
+    return button;
+}
+
+// Time one configuration and print the result next to where the match was expected
+void run(const char* name, const Frame& frame, const TemplatePyramid& pyramid, const MatchOptions& options, int expectX, int expectY) {
+    const int rounds = 5;
+    MatchResult result;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) result = findTemplate(frame, pyramid, options);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+    std::cout << "  " << name << ": " << ms << " ms, match (" << result.x << ", " << result.y << ") score " << result.score;
+    if (expectX >= 0) std::cout << ((result.x == expectX && result.y == expectY) ? " [ok]" : " [WRONG]");
+    std::cout << "\n";
+}
+
+void runSuite(const Frame& frame, const Frame& button, int expectX, int expectY) {
+    TemplatePyramid pyramid = buildTemplatePyramid(button);
+    std::cout << "Frame " << frame.width << "x" << frame.height << ", template " << button.width << "x" << button.height
+              << ", " << pyramid.levels.size() << " pyramid levels\n";
+
+    MatchOptions options;
+    options.threads = 1;
+    options.simd = SimdLevel::Scalar;
+    run("pyramid, scalar, 1 thread", frame, pyramid, options, expectX, expectY);
+    if (bestSimdLevel() >= SimdLevel::SSE2) {
+        options.simd = SimdLevel::SSE2;
+        run("pyramid, sse2, 1 thread", frame, pyramid, options, expectX, expectY);
+    }
+    if (bestSimdLevel() >= SimdLevel::AVX2) {
+        options.simd = SimdLevel::AVX2;
+        run("pyramid, avx2, 1 thread", frame, pyramid, options, expectX, expectY);
+    }
+    options.simd = bestSimdLevel();
+    options.threads = 0;
+    run("pyramid, best simd, all cores", frame, pyramid, options, expectX, expectY);
+
+    // Second search of an unchanged frame through the matcher should hit the cache
+    const std::string templatePath = "match_bench_template.ppm";
+    savePpm(templatePath, button);
+    TemplateMatcher matcher;
+    PixelRect region{0, 0, frame.width, frame.height};
+    MatchResult result;
+    matcher.find(templatePath, frame, region, result);
+    auto start = std::chrono::steady_clock::now();
+    matcher.find(templatePath, frame, region, result);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  unchanged frame: " << ms << " ms, cache hits " << matcher.hits() << "\n";
+    std::filesystem::remove(templatePath);
+}
+
+int main(int argc, char* argv[]) {
+    Frame frame = makeSyntheticFrame(3840, 2160, 1);
+    Frame button = plantTemplate(frame, 2490, 700, 96, 40, 2);
+    std::cout << "Synthetic:\n";
+    runSuite(frame, button, 2490, 700);
+
+    if (argc >= 3) {
+        Frame screen, fixture;
+        if (!loadPpm(argv[1], screen) || !loadPpm(argv[2], fixture)) {
+            std::cout << "Could not load fixture images.\n";
+            return 1;
+        }
+        std::cout << "Fixture:\n";
+        runSuite(screen, fixture, -1, -1);
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Benchmark for the screen wait kernels and polling loop. Builds anywhere:
+//   g++ -std=c++20 -O2 -I.. pixel_bench.cpp -o pixel_bench
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "framebuffer.h"
+
+// Write a solid-color PPM, optionally with one differing pixel
+void writePpm(const std::string& path, int width, int height, uint32_t color, int changedIndex = -1) {
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary);
+    out << "P6\n" << width << " " << height << "\n255\n";
+    for (int i = 0; i < width * height; i++) {
+        uint32_t c = (i == changedIndex) ? ~color : color;
+        char rgb[3] = {static_cast<char>(c >> 16), static_cast<char>(c >> 8), static_cast<char>(c)};
+        out.write(rgb, 3);
+    }
+    out.close();
+    std::filesystem::rename(tmpPath, path);
+}
+
+void benchKernels() {
+    const int width = 3840, height = 2160;
+    const size_t count = static_cast<size_t>(width) * height;
+    std::vector<uint32_t> a(count), b(count);
+
+    std::mt19937 rng(42);
+    for (size_t i = 0; i < count; i++) {
+        a[i] = rng() & 0xFFFFFF;
+        b[i] = (i % 97 == 0) ? (rng() & 0xFFFFFF) : a[i];
+    }
+
+    const char* names[] = {"scalar", "sse2", "avx2"};
+    SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2};
+    for (int l = 0; l < 3; l++) {
+        if (levels[l] > bestSimdLevel()) continue;
+
+        const int rounds = 20;
+        size_t result = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            result += countDifferentPixels(a.data(), b.data(), count, 8, levels[l]);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / rounds;
+        std::cout << "  " << names[l] << ": " << ms << " ms per 4K frame, "
+                  << (count * sizeof(uint32_t) * 2 / 1e6) / ms << " GB/s, differing " << result / rounds << "\n";
+    }
+}
+
+void benchPolling() {
+    const std::string path = "pixel_bench_frame.ppm";
+    const int width = 640, height = 480;
+    writePpm(path, width, height, 0x336699);
+
+    PpmFrameSource source(path);
+    PixelRect region{100, 100, 200, 100};
+
+    // Change one pixel inside the region after a fixed delay and measure how soon the wait notices
+    const auto delay = std::chrono::milliseconds(50);
+    auto changedAt = std::chrono::steady_clock::now() + delay;
+    std::thread changer([&] {
+        std::this_thread::sleep_until(changedAt);
+        writePpm(path, width, height, 0x336699, 150 * width + 250);
+    });
+
+    bool changed = waitForRegionChange(source, region, 0, std::chrono::milliseconds(2000)) == WaitResult::Satisfied;
+    double reactionMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - changedAt).count();
+    changer.join();
+
+    bool found = waitForColor(source, PixelRect{250, 150, 1, 1}, ~0x336699u & 0xFFFFFF, 0, std::chrono::milliseconds(100)) == WaitResult::Satisfied;
+
+    std::cout << "  region change detected: " << (changed ? "yes" : "no") << ", " << reactionMs << " ms after the write\n";
+    std::cout << "  changed pixel color found: " << (found ? "yes" : "no") << "\n";
+    std::filesystem::remove(path);
+}
+
+int main() {
+    std::cout << "Comparison kernels (3840x2160, tolerance 8):\n";
+    benchKernels();
+    std::cout << "Polling a PPM frame source:\n";
+    benchPolling();
+    return 0;
+}
@@ -0,0 +1,233 @@
+// Throughput benchmark for the shared-memory command ring. Linux only:
+//   g++ -std=c++20 -O2 -pthread -I.. ring_bench.cpp -o ring_bench
+//   ./ring_bench [input_simulator]
+// First drives the ring alone, a server thread against 1-8 producer threads, and checks that
+// every command arrives once, in order per producer. Bursty pushes show that the server is
+// only woken when the ring goes from empty to non-empty. With the simulator given, it also
+// serves the ring with --shm --record-file and times commands end to end, and checks that a
+// client stopping inside a group, or sending a marker, cannot hang the server, and that a group
+// with a rejected command is dropped instead of holding back the commands after it.
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "command_ring.h"
+
+extern char** environ;
+
+using Clock = std::chrono::steady_clock;
+
+// The producer and its sequence number ride in the coordinates, so the server can check the order
+RingCommand makeCommand(int producer, int32_t sequence) {
+    RingCommand command;
+    command.type = static_cast<uint8_t>(InputEventType::MouseMove);
+    command.x = producer;
+    command.y = sequence;
+    return command;
+}
+
+bool openClient(CommandRingClient& client, const std::string& name) {
+    for (int attempt = 0; attempt < 2000; attempt++) {
+        if (client.open(name)) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+// Producers push count commands each in groups; returns false if the server saw a loss or reordering
+bool runRing(const std::string& name, int producers, int count, int group, std::chrono::microseconds pause) {
+    CommandRingServer server;
+    if (!server.create(name)) {
+        std::cerr << "Could not create shared memory " << name << "\n";
+        return false;
+    }
+
+    std::vector<int32_t> expected(producers, 0);
+    uint64_t received = 0;
+    bool inOrder = true;
+    std::thread consumer([&] {
+        RingCommand command;
+        for (;;) {
+            if (server.tryPop(command)) {
+                if (command.y != expected[command.x]++) inOrder = false;
+                received++;
+                continue;
+            }
+            if (server.stopRequested()) break;
+            server.wait(std::chrono::milliseconds(100));
+        }
+    });
+
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+            CommandRingClient client;
+            if (!openClient(client, name)) return;
+            std::vector<RingCommand> batch(group);
+            for (int sent = 0; sent < count; sent += group) {
+                for (int i = 0; i < group; i++) batch[i] = makeCommand(p, sent + i);
+                client.pushGroup(batch.data(), batch.size());
+                if (pause.count() > 0) std::this_thread::sleep_for(pause);
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    CommandRingClient stopper;
+    if (openClient(stopper, name)) stopper.requestStop();
+    consumer.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    uint64_t total = static_cast<uint64_t>(producers) * count;
+    bool ok = inOrder && received == total;
+    std::cout << "  " << std::setw(9) << producers << std::setw(7) << group << std::setw(10) << pause.count() << std::setw(12) << total
+              << std::fixed << std::setprecision(2) << std::setw(12) << static_cast<double>(total) / seconds / 1e6 << std::setw(10)
+              << server.wakeups() << (ok ? "" : "   LOST OR REORDERED") << "\n";
+    return ok;
+}
+
+// Start the simulator serving the ring into a recording and connect to it; 0 if either failed
+pid_t startSimulator(const std::string& simulator, const std::string& name, const std::string& recording, CommandRingClient& client) {
+    std::vector<std::string> command = {simulator, "--shm", name, "--record-file", recording};
+    std::vector<char*> argv;
+    for (const std::string& arg : command) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    if (posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) return 0;
+    if (!openClient(client, name)) {
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+        std::cerr << "The simulator did not create the ring\n";
+        return 0;
+    }
+    return pid;
+}
+
+int countLines(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    int lines = 0;
+    while (std::getline(in, line)) lines++;
+    return lines;
+}
+
+// Serve the ring with the simulator and time count commands from the first push until it exits
+bool runSimulator(const std::string& simulator, const std::string& name, int count) {
+    std::string recording = "/tmp/ring_bench_" + std::to_string(getpid()) + ".txt";
+    CommandRingClient client;
+    pid_t pid = startSimulator(simulator, name, recording, client);
+    if (pid == 0) return false;
+    auto start = Clock::now();
+    for (int i = 0; i < count; i++) client.push(makeCommand(0, i));
+    double pushSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    client.requestStop();
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    int lines = countLines(recording);
+    unlink(recording.c_str());
+
+    std::cout << "  " << count << " commands: pushed at " << std::fixed << std::setprecision(2) << count / pushSeconds / 1e6
+              << " M/s, all injected and recorded after " << std::setprecision(1) << seconds * 1e3 << " ms (" << count / seconds / 1e3
+              << " k/s); " << lines << " recorded\n";
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && lines == count;
+}
+
+// A client that stops after the first command of a group, or sends a command marker, must not
+// leave the server waiting: it has to exit, having injected the move and rejected the marker
+bool runUnfinishedGroup(const std::string& simulator, const std::string& name) {
+    std::string recording = "/tmp/ring_bench_" + std::to_string(getpid()) + ".txt";
+    CommandRingClient client;
+    pid_t pid = startSimulator(simulator, name, recording, client);
+    if (pid == 0) return false;
+
+    RingCommand marker;
+    marker.type = static_cast<uint8_t>(InputEventType::Marker);
+    marker.code = MARKER_COMMAND_BEGIN;
+    client.push(marker);
+    RingCommand move = makeCommand(0, 0);
+    move.flags = EVENT_FLAG_GROUPED;
+    client.push(move);
+    client.requestStop();
+
+    int status = 0;
+    bool exited = false;
+    auto until = Clock::now() + std::chrono::seconds(5);
+    while (!(exited = waitpid(pid, &status, WNOHANG) == pid) && Clock::now() < until) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (!exited) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+    int lines = countLines(recording);
+    unlink(recording.c_str());
+
+    bool ok = exited && WIFEXITED(status) && WEXITSTATUS(status) == 0 && lines == 1;
+    std::cout << "  unfinished group and a marker: " << (exited ? "exited" : "STILL RUNNING after 5 s") << ", " << lines << " recorded"
+              << (ok ? "" : "   FAILED") << "\n";
+    return ok;
+}
+
+// A group whose last command is rejected is dropped whole, and the move after it is injected at once
+bool runRejectedGroup(const std::string& simulator, const std::string& name) {
+    std::string recording = "/tmp/ring_bench_" + std::to_string(getpid()) + ".txt";
+    CommandRingClient client;
+    pid_t pid = startSimulator(simulator, name, recording, client);
+    if (pid == 0) return false;
+
+    RingCommand move = makeCommand(0, 0);
+    move.flags = EVENT_FLAG_GROUPED;
+    client.push(move);
+    RingCommand marker;
+    marker.type = static_cast<uint8_t>(InputEventType::Marker);
+    marker.code = MARKER_COMMAND_END;
+    client.push(marker);
+    client.push(makeCommand(0, 1));
+
+    int lines = 0;
+    auto until = Clock::now() + std::chrono::seconds(2);
+    while ((lines = countLines(recording)) < 1 && Clock::now() < until) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    client.requestStop();
+    waitpid(pid, nullptr, 0);
+    int total = countLines(recording);
+    unlink(recording.c_str());
+
+    bool ok = lines == 1 && total == 1;
+    std::cout << "  group ending in a marker: " << lines << " recorded before the stop, " << total << " in all" << (ok ? "" : "   FAILED") << "\n";
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::string name = "ring_bench_" + std::to_string(getpid());
+    bool ok = true;
+
+    std::cout << "Ring alone\n  producers  group  pause_us    commands  M cmds/s   wakeups\n";
+    for (int producers : {1, 2, 4, 8}) {
+        ok = runRing(name, producers, 1000000, 1, std::chrono::microseconds(0)) && ok;
+    }
+    ok = runRing(name, 4, 1000000, 16, std::chrono::microseconds(0)) && ok;
+    // Bursts with idle time in between: about one wakeup per burst, not per command
+    ok = runRing(name, 1, 20000, 100, std::chrono::microseconds(500)) && ok;
+
+    if (argc > 1) {
+        std::cout << "Through " << argv[1] << " --shm\n";
+        ok = runSimulator(argv[1], name, 200000) && ok;
+        ok = runUnfinishedGroup(argv[1], name) && ok;
+        ok = runRejectedGroup(argv[1], name) && ok;
+    }
+    return ok ? 0 : 1;
+}
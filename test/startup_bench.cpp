@@ -0,0 +1,122 @@
+// Cold-start benchmark: time from spawning the simulator to its first injected event. Linux only:
+//   g++ -std=c++20 -O2 startup_bench.cpp -o startup_bench
+//   ./startup_bench ../build/input_simulator [runs] [budget_ms]
+// Runs each command with --record-file, which stamps events with the same steady clock as this
+// process, so no input system is needed. Exits with 1 if a median exceeds budget_ms.
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern char** environ;
+
+using Clock = std::chrono::steady_clock;
+
+// Run program with args, output discarded; returns the time it took to exit, or a negative value on failure
+double spawnAndWait(const std::vector<std::string>& command, Clock::time_point& spawned) {
+    std::vector<char*> argv;
+    for (const std::string& arg : command) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    pid_t pid;
+    spawned = Clock::now();
+    int error = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) return -1;
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - spawned).count();
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? ms : -1;
+}
+
+// Steady clock time of the first event in a --record-file recording
+bool firstEventTime(const std::string& path, Clock::time_point& at) {
+    std::ifstream in(path);
+    int64_t ns = 0;
+    if (!(in >> ns)) return false;
+    at = Clock::time_point(std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(ns)));
+    return true;
+}
+
+double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(p / 100.0 * static_cast<double>(values.size() - 1) + 0.5);
+    return values[index];
+}
+
+void report(const std::string& name, const std::vector<double>& ms) {
+    std::cout << "  " << std::left << std::setw(44) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(9) << percentile(ms, 50) << std::setw(9) << percentile(ms, 90) << std::setw(9)
+              << percentile(ms, 100) << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: startup_bench <input_simulator> [runs] [budget_ms]\n";
+        return 2;
+    }
+    std::string simulator = argv[1];
+    int runs = (argc > 2) ? std::stoi(argv[2]) : 200;
+    double budgetMs = (argc > 3) ? std::stod(argv[3]) : 0;
+    std::string recording = "/tmp/startup_bench_" + std::to_string(getpid()) + ".txt";
+
+    const std::vector<std::vector<std::string>> commands = {
+        {"-k", "key_enter"},
+        {"-k", "ctrl+shift+key_s"},
+        {"-k", "mouse_left", "-x", "100", "-y", "100"},
+    };
+
+    std::cout << runs << " runs each, milliseconds                 p50      p90      max\n";
+
+    // The cost of process creation alone, for reference
+    std::vector<double> floor;
+    Clock::time_point spawned;
+    for (int run = 0; run < runs; run++) {
+        double ms = spawnAndWait({"/bin/true"}, spawned);
+        if (ms >= 0) floor.push_back(ms);
+    }
+    if (!floor.empty()) report("/bin/true spawn to exit", floor);
+
+    bool withinBudget = true;
+    for (const auto& command : commands) {
+        std::vector<std::string> full = {simulator, "--record-file", recording};
+        full.insert(full.end(), command.begin(), command.end());
+        std::string name;
+        for (const std::string& arg : command) name += (name.empty() ? "" : " ") + arg;
+
+        std::vector<double> toEvent, toExit;
+        for (int run = 0; run < runs; run++) {
+            unlink(recording.c_str());  // Creating the file is cheaper than truncating the last one
+            double exitMs = spawnAndWait(full, spawned);
+            Clock::time_point first;
+            if (exitMs < 0 || !firstEventTime(recording, first)) {
+                std::cerr << "Run of '" << name << "' failed or injected nothing\n";
+                unlink(recording.c_str());
+                return 1;
+            }
+            toEvent.push_back(std::chrono::duration<double, std::milli>(first - spawned).count());
+            toExit.push_back(exitMs);
+        }
+        report(name + ": first event", toEvent);
+        report(name + ": exit", toExit);
+        if (budgetMs > 0 && percentile(toEvent, 50) > budgetMs) withinBudget = false;
+    }
+    unlink(recording.c_str());
+
+    if (!withinBudget) std::cout << "Median time to first event exceeds the " << budgetMs << " ms budget\n";
+    return withinBudget ? 0 : 1;
+}
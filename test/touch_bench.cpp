@@ -0,0 +1,129 @@
+// Benchmark and check for multi-touch frames. Linux only:
+//   g++ -std=c++20 -O2 -pthread -I.. touch_bench.cpp -o touch_bench
+//   ./touch_bench [frames] [fingers]
+// Drives UinputTouchBackend with a stand-in file instead of /dev/uinput, times each 120 Hz frame
+// against its budget, then decodes the protocol B stream and checks every contact of every frame.
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "touch.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Receives whatever is not touch; the benchmark sends nothing else
+class NullBackend : public InputBackend {
+public:
+    void submit(const InputEvent*, size_t) override {}
+};
+
+struct Contact {
+    int x = -1;
+    int y = -1;
+    bool down = false;
+};
+
+// Contact positions of frame f: fingers on a circle that turns and breathes
+void framePositions(int frame, int fingers, std::vector<InputEvent>& events, InputEventType type) {
+    events.clear();
+    for (int i = 0; i < fingers; i++) {
+        double angle = 6.283185307179586 * i / fingers + frame * 0.01;
+        double radius = 300 + 100 * std::sin(frame * 0.05);
+        InputEvent event;
+        event.type = type;
+        event.code = static_cast<uint16_t>(i);
+        event.x = 960 + static_cast<int>(std::lround(radius * std::cos(angle)));
+        event.y = 540 + static_cast<int>(std::lround(radius * std::sin(angle)));
+        event.flags = (i + 1 < fingers) ? EVENT_FLAG_GROUPED : 0;
+        events.push_back(event);
+    }
+}
+
+double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(p / 100.0 * static_cast<double>(values.size() - 1) + 0.5);
+    return values[index];
+}
+
+int main(int argc, char* argv[]) {
+    int frames = (argc > 1) ? std::stoi(argv[1]) : 1200;
+    int fingers = (argc > 2) ? std::min(std::stoi(argv[2]), kMaxTouchContacts) : kMaxTouchContacts;
+    std::string path = "/tmp/touch_bench_" + std::to_string(getpid()) + ".bin";
+    const auto period = std::chrono::nanoseconds(1000000000 / kTouchFrameRate);
+
+    NullBackend next;
+    UinputTouchBackend touch(next);
+    bool created = false;
+    if (!touch.open(path, created)) {
+        std::cerr << "Could not open " << path << "\n";
+        return 1;
+    }
+
+    // Down, frames - 2 moves, up, each paced to the frame rate like the injection thread would
+    std::vector<InputEvent> events;
+    std::vector<std::vector<InputEvent>> expected;
+    std::vector<double> submitMs;
+    auto deadline = Clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        InputEventType type = (frame == 0) ? InputEventType::TouchDown
+                            : (frame == frames - 1) ? InputEventType::TouchUp : InputEventType::TouchMove;
+        framePositions(frame, fingers, events, type);
+        expected.push_back(events);
+
+        std::this_thread::sleep_until(deadline);
+        auto start = Clock::now();
+        touch.submit(events.data(), events.size());
+        submitMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        deadline += period;
+    }
+    touch.close();
+
+    double budgetMs = std::chrono::duration<double, std::milli>(period).count();
+    size_t over = static_cast<size_t>(std::count_if(submitMs.begin(), submitMs.end(), [&](double ms) { return ms > budgetMs; }));
+    std::cout << frames << " frames of " << fingers << " contacts at " << kTouchFrameRate << " Hz, milliseconds per frame\n";
+    std::cout << std::fixed << std::setprecision(4) << "  p50 " << percentile(submitMs, 50) << "  p99 " << percentile(submitMs, 99)
+              << "  max " << percentile(submitMs, 100) << "  over the " << budgetMs << " ms budget: " << over << "\n";
+
+    // Decode: every SYN_REPORT must close exactly one frame, with every contact where it was sent
+    std::ifstream in(path, std::ios::binary);
+    std::vector<Contact> slots(kMaxTouchContacts);
+    int slot = 0;
+    size_t frame = 0;
+    size_t errors = 0;
+    size_t bytes = 0;
+    input_event event;
+    while (in.read(reinterpret_cast<char*>(&event), sizeof(event))) {
+        bytes += sizeof(event);
+        if (event.type == EV_ABS && event.code == ABS_MT_SLOT) slot = event.value;
+        else if (event.type == EV_ABS && event.code == ABS_MT_TRACKING_ID) slots[slot].down = (event.value >= 0);
+        else if (event.type == EV_ABS && event.code == ABS_MT_POSITION_X) slots[slot].x = event.value;
+        else if (event.type == EV_ABS && event.code == ABS_MT_POSITION_Y) slots[slot].y = event.value;
+        else if (event.type == EV_SYN && event.code == SYN_REPORT) {
+            if (frame >= expected.size()) {
+                errors++;
+                break;
+            }
+            for (const InputEvent& sent : expected[frame]) {
+                const Contact& got = slots[sent.code];
+                bool down = (sent.type != InputEventType::TouchUp);
+                if (got.down != down || (down && (got.x != sent.x || got.y != sent.y))) errors++;
+            }
+            frame++;
+        }
+    }
+    unlink(path.c_str());
+
+    std::cout << "  " << frame << " reports decoded, " << std::setprecision(1) << static_cast<double>(bytes) / std::max<size_t>(frame, 1)
+              << " bytes each, " << errors << " mismatched contacts\n";
+    bool ok = (frame == expected.size() && errors == 0);
+    if (!ok) std::cout << "Decoded stream does not match the injected frames\n";
+    return ok ? 0 : 1;
+}
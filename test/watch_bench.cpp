@@ -0,0 +1,98 @@
+// Benchmark and consistency check for incremental script recompilation. Builds anywhere:
+//   g++ -std=c++20 -O2 -I.. watch_bench.cpp -o watch_bench
+// Edits a 100k-line script, timing each update and comparing it with a full compile.
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "script_cache.h"
+
+// Stand-in for the simulator's line compiler: a command is the line's argument list
+using Args = std::vector<std::string>;
+
+void compileLine(const std::string& line, CompiledLine<Args>& compiled) {
+    if (line.empty() || line[0] == '#') return;
+    if (parseScriptLabel(line, compiled.label)) return;
+    compiled.command = splitScriptLine(line);
+    if (compiled.command->front()[0] != '-') compiled.diagnostics.push_back({"", 0, 1, "Not an option."});
+}
+
+std::string makeLine(std::mt19937& rng) {
+    switch (rng() % 8) {
+        case 0: return "# comment " + std::to_string(rng() % 1000);
+        case 1: return "";
+        case 2: return ":label" + std::to_string(rng() % 100000);
+        default:
+            return "-k mouse_left -x " + std::to_string(rng() % 1920) + " -y " + std::to_string(rng() % 1080) + " -s " +
+                   std::to_string(rng() % 500);
+    }
+}
+
+std::string join(const std::vector<std::string>& lines) {
+    std::string text;
+    for (const std::string& line : lines) text += line + "\n";
+    return text;
+}
+
+// Every line of the incremental script must match what compiling the text from scratch gives
+bool sameAsFullCompile(const IncrementalScript<Args>& script, const std::string& text) {
+    IncrementalScript<Args> fresh(compileLine);
+    std::string copy = text;
+    fresh.update(copy);
+    if (fresh.lineCount() != script.lineCount() || fresh.errorCount() != script.errorCount()) return false;
+    for (size_t i = 0; i < fresh.lineCount(); i++) {
+        if (fresh.line(i).text != script.line(i).text || fresh.line(i).command != script.line(i).command) return false;
+    }
+    return true;
+}
+
+int main() {
+    const size_t lineCount = 100000;
+    std::mt19937 rng(7);
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < lineCount; i++) lines.push_back(makeLine(rng));
+
+    // Each version is read into the buffer the previous update handed back, as the watcher does
+    IncrementalScript<Args> script(compileLine);
+    std::string buffer = join(lines);
+    auto start = std::chrono::steady_clock::now();
+    script.update(buffer);
+    std::cout << "Initial compile of " << lineCount << " lines: "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+
+    // Random edits: change, insert or delete one line, or paste a block
+    const char* kinds[] = {"change one line", "insert one line", "delete one line", "insert 50 lines"};
+    double totalMs[4] = {}, worstMs[4] = {};
+    int counts[4] = {};
+    bool consistent = true;
+    for (int edit = 0; edit < 400; edit++) {
+        int kind = static_cast<int>(rng() % 4);
+        size_t at = rng() % lines.size();
+        if (kind == 0) lines[at] = makeLine(rng);
+        if (kind == 1) lines.insert(lines.begin() + at, makeLine(rng));
+        if (kind == 2) lines.erase(lines.begin() + at);
+        if (kind == 3) {
+            for (int i = 0; i < 50; i++) lines.insert(lines.begin() + at, makeLine(rng));
+        }
+        std::string text = join(lines);
+        buffer.assign(text);
+
+        start = std::chrono::steady_clock::now();
+        script.update(buffer);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        totalMs[kind] += ms;
+        worstMs[kind] = std::max(worstMs[kind], ms);
+        counts[kind]++;
+
+        if (edit % 50 == 0) consistent = consistent && sameAsFullCompile(script, text);
+    }
+
+    for (int kind = 0; kind < 4; kind++) {
+        std::cout << "  " << kinds[kind] << ": " << totalMs[kind] / counts[kind] << " ms average, " << worstMs[kind]
+                  << " ms worst\n";
+    }
+    std::cout << (consistent ? "Matches a full compile\n" : "MISMATCH with a full compile\n");
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,308 @@
+// Delivery test and throughput benchmark for -w window targets. Needs an X server, e.g. Xvfb:
+//   g++ -std=c++20 -O2 -pthread -I.. window_bench.cpp -o window_bench -lX11 -lXtst
+//   Xvfb :99 -screen 0 1920x1080x24 &
+//   DISPLAY=:99 ./window_bench [windows] [frames] [input_simulator]
+// Opens client windows that count what they receive, then drives every window from a thread of
+// its own through XWindowBackend and checks that each window got exactly its own events, in its
+// own coordinates, while the real pointer and the input focus stayed put. Reports the aggregate
+// events per second, and the cost of the first lookup by title against the cached window.
+// With the simulator given, it also runs one instance per window with -w at once.
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "window_backend.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kWindowSize = 200;
+
+// A window on a connection of its own that counts the events sent to it
+class Client {
+public:
+    bool open(int index) {
+        display = XOpenDisplay(nullptr);
+        if (!display) return false;
+        title = "window_bench " + std::to_string(index);
+
+        XSetWindowAttributes attributes = {};
+        attributes.override_redirect = True;
+        attributes.event_mask = StructureNotifyMask | PointerMotionMask | ButtonPressMask | ButtonReleaseMask | KeyPressMask | KeyReleaseMask;
+        window = XCreateWindow(display, DefaultRootWindow(display), 10 + (index % 8) * (kWindowSize + 10), 10 + (index / 8) * (kWindowSize + 10),
+                               kWindowSize, kWindowSize, 0, CopyFromParent, InputOutput, CopyFromParent, CWOverrideRedirect | CWEventMask,
+                               &attributes);
+        XStoreName(display, window, title.c_str());
+        XMapRaised(display, window);
+        XEvent event;
+        do {
+            XNextEvent(display, &event);
+        } while (event.type != MapNotify);
+        XSync(display, False);
+
+        running = true;
+        reader = std::thread([this] { run(); });
+        return true;
+    }
+
+    ~Client() {
+        running = false;
+        if (reader.joinable()) reader.join();
+        if (display) XCloseDisplay(display);
+    }
+
+    // Wait until count events have arrived, for at most the timeout
+    bool waitFor(uint64_t count, std::chrono::milliseconds timeout) {
+        auto until = Clock::now() + timeout;
+        while (received.load() < count && Clock::now() < until) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return received.load() >= count;
+    }
+
+    void reset() {
+        received = 0;
+        outside = 0;
+        unmarked = 0;
+        keys = 0;
+        buttons = 0;
+    }
+
+    std::string title;
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> outside{0};   // Pointer events with coordinates outside the window
+    std::atomic<uint64_t> unmarked{0};  // Events without the send_event flag, so not from this test
+    std::atomic<uint64_t> keys{0};
+    std::atomic<uint64_t> buttons{0};
+
+private:
+    void run() {
+        while (running) {
+            if (!XPending(display)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            XEvent event;
+            XNextEvent(display, &event);
+            int x = -1, y = -1;
+            switch (event.type) {
+                case MotionNotify:
+                    x = event.xmotion.x;
+                    y = event.xmotion.y;
+                    break;
+                case ButtonPress:
+                case ButtonRelease:
+                    x = event.xbutton.x;
+                    y = event.xbutton.y;
+                    buttons++;
+                    break;
+                case KeyPress:
+                case KeyRelease:
+                    keys++;
+                    break;
+                default:
+                    continue;
+            }
+            if (!event.xany.send_event) unmarked++;
+            if (x >= kWindowSize || y >= kWindowSize) outside++;
+            received++;
+        }
+    }
+
+    Display* display = nullptr;
+    Window window = 0;
+    std::thread reader;
+    std::atomic<bool> running{false};
+};
+
+// One batch per frame: a move, every eighth frame a click, every 16th a key press and release
+size_t frameEvents(int frame, std::vector<InputEvent>& events) {
+    events.clear();
+    InputEvent move;
+    move.type = InputEventType::MouseMove;
+    move.x = frame % kWindowSize;
+    move.y = (frame * 7) % kWindowSize;
+    events.push_back(move);
+    if (frame % 8 == 0) {
+        InputEvent click;
+        click.type = InputEventType::MouseDown;
+        events.push_back(click);
+        click.type = InputEventType::MouseUp;
+        events.push_back(click);
+    }
+    if (frame % 16 == 0) {
+        InputEvent key;
+        key.type = InputEventType::KeyDown;
+        key.code = 'A';
+        events.push_back(key);
+        key.type = InputEventType::KeyUp;
+        events.push_back(key);
+    }
+    return events.size();
+}
+
+struct Pointer {
+    int x = 0;
+    int y = 0;
+    Window focus = 0;
+};
+
+Pointer desktopState(Display* display) {
+    Pointer state;
+    Window root, child;
+    int windowX, windowY, revert;
+    unsigned int mask;
+    XQueryPointer(display, DefaultRootWindow(display), &root, &child, &state.x, &state.y, &windowX, &windowY, &mask);
+    XGetInputFocus(display, &state.focus, &revert);
+    return state;
+}
+
+// Run the simulator once per window at once, each with -w and the same script
+bool throughSimulator(const std::string& simulator, std::vector<std::unique_ptr<Client>>& clients) {
+    std::string script = "/tmp/window_bench_" + std::to_string(getpid()) + ".txt";
+    {
+        std::ofstream out(script);
+        for (int i = 0; i < 10; i++) out << "-k mouse_left -x " << 10 + 15 * i << " -y " << 150 - 10 * i << " -sm linear -smt 100\n";
+        out << "-k ctrl+key_s\n";
+    }
+    for (auto& client : clients) client->reset();
+
+    auto start = Clock::now();
+    std::vector<pid_t> children;
+    for (auto& client : clients) {
+        std::vector<std::string> command = {simulator, "-w", client->title, "-f", script};
+        std::vector<char*> argv;
+        for (std::string& arg : command) argv.push_back(arg.data());
+        argv.push_back(nullptr);
+        pid_t pid;
+        if (posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) return false;
+        children.push_back(pid);
+    }
+    bool ok = true;
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    unlink(script.c_str());
+
+    // The last events may still be on their way to the clients
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    uint64_t total = 0, clicks = 0, keys = 0, outside = 0;
+    for (auto& client : clients) {
+        total += client->received.load();
+        clicks += client->buttons.load();
+        keys += client->keys.load();
+        outside += client->outside.load();
+    }
+    std::cout << "  " << clients.size() << " simulators with -w: " << total << " events in " << std::fixed << std::setprecision(2) << seconds
+              << " s, " << clicks << " button and " << keys << " key events, " << outside << " outside their window\n";
+    // Ten clicks and one two-key chord per window
+    return ok && clicks == 20 * clients.size() && keys == 4 * clients.size() && outside == 0;
+}
+
+int main(int argc, char* argv[]) {
+    int windowCount = (argc > 1) ? std::stoi(argv[1]) : 8;
+    int frames = (argc > 2) ? std::stoi(argv[2]) : 20000;
+
+    // Clients and backends share Xlib across threads
+    XInitThreads();
+    Display* observer = XOpenDisplay(nullptr);
+    if (!observer) {
+        std::cerr << "Could not open the X display\n";
+        return 1;
+    }
+    std::vector<std::unique_ptr<Client>> clients;
+    for (int i = 0; i < windowCount; i++) {
+        clients.push_back(std::make_unique<Client>());
+        if (!clients.back()->open(i)) {
+            std::cerr << "Could not open client window " << i << "\n";
+            return 1;
+        }
+    }
+    XWarpPointer(observer, None, DefaultRootWindow(observer), 0, 0, 0, 0, 1900, 1060);
+    XSync(observer, False);
+    Pointer before = desktopState(observer);
+
+    // Looking a window up by title walks the whole tree; afterwards the backend keeps the window
+    std::vector<std::unique_ptr<XWindowBackend>> backends;
+    double lookupMs = 0;
+    for (auto& client : clients) {
+        auto backend = std::make_unique<XWindowBackend>();
+        if (!backend->connect()) return 1;
+        auto start = Clock::now();
+        if (!backend->attach(client->title)) {
+            std::cerr << "No window found for " << client->title << "\n";
+            return 1;
+        }
+        lookupMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        backends.push_back(std::move(backend));
+    }
+    std::cout << "Lookup by title: " << std::fixed << std::setprecision(3) << lookupMs / windowCount << " ms per window\n";
+
+    // Every window from a thread of its own, as separate executors would
+    std::vector<uint64_t> sent(windowCount, 0);
+    std::vector<std::thread> drivers;
+    auto start = Clock::now();
+    for (int w = 0; w < windowCount; w++) {
+        drivers.emplace_back([&, w] {
+            std::vector<InputEvent> events;
+            for (int frame = 0; frame < frames; frame++) {
+                sent[w] += frameEvents(frame, events);
+                backends[w]->submit(events.data(), events.size());
+            }
+        });
+    }
+    for (std::thread& driver : drivers) driver.join();
+    double submitSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    bool ok = true;
+    uint64_t total = 0;
+    for (int w = 0; w < windowCount; w++) {
+        ok = clients[w]->waitFor(sent[w], std::chrono::seconds(30)) && ok;
+        total += sent[w];
+    }
+    double deliverSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    uint64_t received = 0, outside = 0, unmarked = 0;
+    for (int w = 0; w < windowCount; w++) {
+        received += clients[w]->received.load();
+        outside += clients[w]->outside.load();
+        unmarked += clients[w]->unmarked.load();
+        if (clients[w]->received.load() != sent[w]) {
+            std::cout << "  " << clients[w]->title << ": sent " << sent[w] << ", received " << clients[w]->received.load() << "\n";
+            ok = false;
+        }
+    }
+    Pointer after = desktopState(observer);
+    bool untouched = before.x == after.x && before.y == after.y && before.focus == after.focus;
+
+    std::cout << windowCount << " windows x " << frames << " frames: " << total << " events sent in " << std::setprecision(2) << submitSeconds
+              << " s (" << std::setprecision(0) << static_cast<double>(total) / submitSeconds << "/s), all delivered after "
+              << std::setprecision(2) << deliverSeconds << " s (" << std::setprecision(0) << static_cast<double>(received) / deliverSeconds
+              << "/s)\n";
+    std::cout << "  received " << received << " | outside their window " << outside << " | not synthetic " << unmarked << " | pointer and focus "
+              << (untouched ? "unchanged" : "MOVED") << "\n";
+    ok = ok && outside == 0 && unmarked == 0 && untouched;
+
+    if (argc > 3) {
+        std::cout << "Through " << argv[3] << "\n";
+        ok = throughSimulator(argv[3], clients) && ok;
+        Pointer end = desktopState(observer);
+        ok = ok && end.x == before.x && end.y == before.y && end.focus == before.focus;
+    }
+
+    backends.clear();
+    clients.clear();
+    XCloseDisplay(observer);
+    if (!ok) std::cout << "FAILED\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+// Delivery test and throughput benchmark for the XTest backend. Needs an X server with XTest, e.g. Xvfb:
+//   g++ -std=c++20 -O2 -pthread -I.. xtest_bench.cpp -o xtest_bench -lX11 -lXtst
+//   Xvfb :99 -screen 0 1280x1024x24 &
+//   DISPLAY=:99 ./xtest_bench
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xtest_backend.h"
+
+// Fullscreen window on a separate connection that records what the server delivers
+class Receiver {
+public:
+    bool open() {
+        display = XOpenDisplay(nullptr);
+        if (!display) return false;
+
+        int screen = DefaultScreen(display);
+        XSetWindowAttributes attributes = {};
+        attributes.override_redirect = True;
+        attributes.event_mask = StructureNotifyMask | PointerMotionMask | ButtonPressMask | ButtonReleaseMask |
+                                KeyPressMask | KeyReleaseMask;
+        window = XCreateWindow(display, RootWindow(display, screen), 0, 0, DisplayWidth(display, screen),
+                               DisplayHeight(display, screen), 0, CopyFromParent, InputOutput, CopyFromParent,
+                               CWOverrideRedirect | CWEventMask, &attributes);
+        XMapRaised(display, window);
+
+        XEvent event;
+        do {
+            XNextEvent(display, &event);
+        } while (event.type != MapNotify);
+        XSetInputFocus(display, window, RevertToParent, CurrentTime);
+        XSync(display, False);
+        return true;
+    }
+
+    ~Receiver() {
+        if (display) XCloseDisplay(display);
+    }
+
+    // Collect events until count have arrived or nothing arrives for the timeout
+    std::vector<XEvent> collect(size_t count, std::chrono::milliseconds timeout = std::chrono::milliseconds(2000)) {
+        std::vector<XEvent> events;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (events.size() < count && std::chrono::steady_clock::now() < deadline) {
+            if (!XPending(display)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            XEvent event;
+            XNextEvent(display, &event);
+            if (event.type == MotionNotify || event.type == ButtonPress || event.type == ButtonRelease ||
+                event.type == KeyPress || event.type == KeyRelease) {
+                events.push_back(event);
+                deadline = std::chrono::steady_clock::now() + timeout;
+            }
+        }
+        return events;
+    }
+
+    Display* display = nullptr;
+    Window window = 0;
+};
+
+InputEvent makeEvent(InputEventType type, uint16_t code = 0, int x = 0, int y = 0) {
+    InputEvent event;
+    event.type = type;
+    event.code = code;
+    event.x = x;
+    event.y = y;
+    return event;
+}
+
+bool verifyDelivery(XTestBackend& backend, Receiver& receiver) {
+    std::vector<InputEvent> events = {
+        makeEvent(InputEventType::MouseMove, 0, 10, 10),
+        makeEvent(InputEventType::MouseMove, 0, 200, 150),
+        makeEvent(InputEventType::MouseDown, MOUSE_BUTTON_LEFT),
+        makeEvent(InputEventType::MouseUp, MOUSE_BUTTON_LEFT),
+        makeEvent(InputEventType::KeyDown, 'A'),
+        makeEvent(InputEventType::KeyUp, 'A'),
+        makeEvent(InputEventType::Wheel, 0, 0, WHEEL_DELTA),
+        makeEvent(InputEventType::Wheel, 0, -WHEEL_DELTA, 0),
+    };
+    backend.submit(events.data(), events.size());
+
+    KeyCode keyA = XKeysymToKeycode(receiver.display, XK_a);
+    struct Expected {
+        int type;
+        unsigned int detail;
+        const char* name;
+    };
+    const Expected expected[] = {
+        {MotionNotify, 0, "motion to (10, 10)"},
+        {MotionNotify, 0, "motion to (200, 150)"},
+        {ButtonPress, Button1, "left button press"},
+        {ButtonRelease, Button1, "left button release"},
+        {KeyPress, keyA, "key a press"},
+        {KeyRelease, keyA, "key a release"},
+        {ButtonPress, 4, "wheel up press"},
+        {ButtonRelease, 4, "wheel up release"},
+        {ButtonPress, 6, "wheel left press"},
+        {ButtonRelease, 6, "wheel left release"},
+    };
+    const size_t expectedCount = sizeof(expected) / sizeof(expected[0]);
+
+    std::vector<XEvent> received = receiver.collect(expectedCount);
+    bool ok = received.size() == expectedCount;
+    for (size_t i = 0; i < expectedCount; i++) {
+        bool match = false;
+        if (i < received.size() && received[i].type == expected[i].type) {
+            const XEvent& event = received[i];
+            if (event.type == MotionNotify)
+                match = (i == 0) ? (event.xmotion.x_root == 10 && event.xmotion.y_root == 10)
+                                 : (event.xmotion.x_root == 200 && event.xmotion.y_root == 150);
+            else if (event.type == ButtonPress || event.type == ButtonRelease)
+                match = event.xbutton.button == expected[i].detail;
+            else
+                match = event.xkey.keycode == expected[i].detail;
+        }
+        std::cout << "  " << (match ? "ok     " : "FAILED ") << expected[i].name << "\n";
+        ok = ok && match;
+    }
+    if (received.size() != expectedCount) {
+        std::cout << "  received " << received.size() << " events, expected " << expectedCount << "\n";
+    }
+    return ok;
+}
+
+// Motion events to alternating positions, so every one is delivered
+std::vector<InputEvent> motionEvents(size_t count) {
+    std::vector<InputEvent> events;
+    for (size_t i = 0; i < count; i++) {
+        events.push_back(makeEvent(InputEventType::MouseMove, 0, 100 + static_cast<int>(i % 2), 100));
+    }
+    return events;
+}
+
+void benchThroughput(XTestBackend& backend, Receiver& receiver) {
+    const size_t count = 20000;
+    std::vector<InputEvent> events = motionEvents(count);
+    Display* display = backend.connection();
+
+    // Baseline: one request and one flush per event
+    auto start = std::chrono::steady_clock::now();
+    for (const InputEvent& event : events) {
+        XTestFakeMotionEvent(display, -1, event.x, event.y, CurrentTime);
+        XFlush(display);
+    }
+    XSync(display, False);
+    double baselineSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t baselineDelivered = receiver.collect(count).size();
+
+    // Backend: one flush per injector batch
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i += Injector::kMaxBatch) {
+        backend.submit(events.data() + i, std::min(Injector::kMaxBatch, count - i));
+    }
+    XSync(display, False);
+    double batchedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t batchedDelivered = receiver.collect(count).size();
+
+    std::cout << "  per-event XFlush: " << count / baselineSeconds << " events/s, delivered " << baselineDelivered << "/" << count << "\n";
+    std::cout << "  batched (" << Injector::kMaxBatch << " per flush): " << count / batchedSeconds << " events/s, delivered "
+              << batchedDelivered << "/" << count << "\n";
+    std::cout << "  speedup: " << baselineSeconds / batchedSeconds << "x\n";
+}
+
+int main() {
+    XTestBackend backend;
+    Receiver receiver;
+    if (!backend.connect() || !receiver.open()) {
+        std::cout << "Could not open $DISPLAY with the XTest extension\n";
+        return 1;
+    }
+
+    std::cout << "Delivered events:\n";
+    bool ok = verifyDelivery(backend, receiver);
+    std::cout << "Throughput (motion events):\n";
+    benchThroughput(backend, receiver);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed-size thread pool where every worker owns a task deque
+ *
+ * A worker pushes and pops its own tasks at the back (LIFO, cache-warm), and when it
+ * runs dry it steals from the front of the other workers' deques. Tasks submitted from
+ * inside a task therefore stay on the submitting worker until someone is idle, which
+ * lets a task split its work (e.g. a large file into line ranges) without a central
+ * queue becoming the bottleneck. Submissions from outside the pool are spread
+ * round-robin.
+ */
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threads; i++) queues.push_back(std::make_unique<TaskQueue>());
+        for (unsigned i = 0; i < threads; i++) workers.emplace_back([this, i] { workerLoop(static_cast<int>(i)); });
+    }
+
+    ~WorkStealingPool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    void submit(std::function<void()> task) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+
+        int self = (currentPool() == this) ? currentWorker() : -1;
+        size_t target = (self >= 0) ? static_cast<size_t>(self) : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->mutex);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued++;
+        }
+        wakeup.notify_one();
+    }
+
+    // Block until every submitted task, including tasks submitted by tasks, has finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        idle.wait(lock, [this] { return pending.load(std::memory_order_acquire) == 0; });
+    }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    static const WorkStealingPool*& currentPool() {
+        thread_local const WorkStealingPool* pool = nullptr;
+        return pool;
+    }
+
+    static int& currentWorker() {
+        thread_local int index = -1;
+        return index;
+    }
+
+    // Own deque from the back first, then the other deques from the front
+    bool take(int self, std::function<void()>& task) {
+        {
+            TaskQueue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < queues.size(); offset++) {
+            TaskQueue& victim = *queues[(self + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(int self) {
+        currentPool() = this;
+        currentWorker() = self;
+
+        std::function<void()> task;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wakeup.wait(lock, [this] { return queued > 0 || stopping; });
+                if (queued == 0 && stopping) return;
+                queued--;
+            }
+
+            // A queued task is reserved for us, but another worker may be popping it; keep looking
+            while (!take(self, task)) std::this_thread::yield();
+
+            task();
+            task = nullptr;
+
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<size_t> pending{0};  // Submitted and not yet finished
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeup;
+    std::condition_variable idle;
+    size_t queued = 0;  // Tasks sitting in a deque and not yet claimed, guarded by sleepMutex
+    bool stopping = false;
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "injector.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Contacts a touch command can use at once; Windows touch injection allows no more
+constexpr int kMaxTouchContacts = 10;
+
+// Touch gestures are injected at the report rate of common touch digitizers
+constexpr int kTouchFrameRate = 120;
+
+#ifndef _WIN32
+/**
+ * @brief Encodes touch frames as Linux multitouch protocol B
+ *
+ * Contact i always uses slot i. Per changed contact, a frame selects its slot (only when it
+ * differs from the slot selected last, as the kernel remembers it), then sends a new tracking
+ * id on touch down or -1 on lift off, and the coordinates that changed. It ends with the
+ * single-touch emulation of the lowest active slot (BTN_TOUCH, ABS_X, ABS_Y) and SYN_REPORT.
+ */
+class TouchFrameEncoder {
+public:
+    void add(const InputEvent& event) {
+        int slot = event.code;
+        if (slot < 0 || slot >= kMaxTouchContacts) return;
+
+        switch (event.type) {
+            case InputEventType::TouchDown:
+                if (active[slot]) break;
+                selectSlot(slot);
+                emit(EV_ABS, ABS_MT_TRACKING_ID, nextTrackingId);
+                nextTrackingId = (nextTrackingId + 1) & 0xffff;
+                active[slot] = true;
+                contacts[slot] = {-1, -1};
+                moveTo(slot, event.x, event.y);
+                break;
+            case InputEventType::TouchMove:
+                if (active[slot]) moveTo(slot, event.x, event.y);
+                break;
+            case InputEventType::TouchUp:
+                if (!active[slot]) break;
+                selectSlot(slot);
+                emit(EV_ABS, ABS_MT_TRACKING_ID, -1);
+                active[slot] = false;
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Lift every active contact, e.g. when a run is aborted
+    void liftAll() {
+        for (int slot = 0; slot < kMaxTouchContacts; slot++) {
+            if (!active[slot]) continue;
+            InputEvent lift;
+            lift.type = InputEventType::TouchUp;
+            lift.code = static_cast<uint16_t>(slot);
+            add(lift);
+        }
+    }
+
+    // Complete the frame and return its events, to be written at once; empty if nothing changed
+    std::vector<input_event>& finish() {
+        if (!frame.empty()) {
+            int first = -1;
+            for (int slot = 0; slot < kMaxTouchContacts && first < 0; slot++) {
+                if (active[slot]) first = slot;
+            }
+            if ((first >= 0) != touching) {
+                touching = (first >= 0);
+                emit(EV_KEY, BTN_TOUCH, touching ? 1 : 0);
+            }
+            if (first >= 0) {
+                if (contacts[first].x != emulated.x) emit(EV_ABS, ABS_X, contacts[first].x);
+                if (contacts[first].y != emulated.y) emit(EV_ABS, ABS_Y, contacts[first].y);
+                emulated = contacts[first];
+            }
+            emit(EV_SYN, SYN_REPORT, 0);
+        }
+        return frame;
+    }
+
+    // Start the next frame
+    void clear() { frame.clear(); }
+
+private:
+    struct Position {
+        int x;
+        int y;
+    };
+
+    void selectSlot(int slot) {
+        if (slot == currentSlot) return;
+        emit(EV_ABS, ABS_MT_SLOT, slot);
+        currentSlot = slot;
+    }
+
+    void moveTo(int slot, int x, int y) {
+        if (x == contacts[slot].x && y == contacts[slot].y) return;
+        selectSlot(slot);
+        if (x != contacts[slot].x) emit(EV_ABS, ABS_MT_POSITION_X, x);
+        if (y != contacts[slot].y) emit(EV_ABS, ABS_MT_POSITION_Y, y);
+        contacts[slot] = {x, y};
+    }
+
+    void emit(uint16_t type, uint16_t code, int32_t value) {
+        input_event event = {};
+        event.type = type;
+        event.code = code;
+        event.value = value;
+        frame.push_back(event);
+    }
+
+    std::vector<input_event> frame;
+    int currentSlot = 0;  // A new device starts with slot 0 selected
+    int nextTrackingId = 0;
+    std::bitset<kMaxTouchContacts> active;
+    Position contacts[kMaxTouchContacts] = {};
+    Position emulated = {-1, -1};
+    bool touching = false;
+};
+
+/**
+ * @brief Injects touch events through a uinput touchscreen and passes everything else on
+ *
+ * Opening /dev/uinput (or any other character device) creates a direct-touch device
+ * whose axes span the screen of the next backend. Any other path is a stand-in: the
+ * raw input_event stream is written to it, so tests can decode what a device would get.
+ * Each frame, the touch events sharing a deadline, is encoded and written with one write().
+ */
+class UinputTouchBackend : public InputBackend {
+public:
+    explicit UinputTouchBackend(InputBackend& next) : next(&next) {}
+    ~UinputTouchBackend() { close(); }
+
+    // Called by the executor before its first touch event. created tells whether a device node was
+    // opened and a touchscreen created, rather than a stand-in file.
+    bool open(const std::string& path, bool& created) {
+        std::lock_guard<std::mutex> lock(mutex);
+        struct stat info;
+        created = (stat(path.c_str(), &info) == 0 && S_ISCHR(info.st_mode));
+        fd = created ? ::open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC)
+                     : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        if (created && !createDevice()) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        device = created;
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0) return;
+        if (device) ioctl(fd, UI_DEV_DESTROY);
+        ::close(fd);
+        fd = -1;
+    }
+
+    void submit(const InputEvent* events, size_t count) override {
+        size_t forward = 0;  // Start of the pending run of other events
+        for (size_t i = 0; i < count; i++) {
+            const InputEvent& event = events[i];
+            bool touch = (event.type == InputEventType::TouchDown || event.type == InputEventType::TouchMove ||
+                          event.type == InputEventType::TouchUp);
+            if (!touch) continue;
+
+            if (i > forward) next->submit(events + forward, i - forward);
+            forward = i + 1;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (aborted || fd < 0) continue;
+            encoder.add(event);
+            if (!(event.flags & EVENT_FLAG_GROUPED)) writeFrame();
+        }
+        if (count > forward) next->submit(events + forward, count - forward);
+    }
+
+    bool queryPointer(int& x, int& y) override { return next->queryPointer(x, y); }
+    bool screenSize(int& width, int& height) override { return next->screenSize(width, height); }
+
+    // Lift every contact, then let the next backend release its keys and buttons
+    void releaseHeldInput() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            aborted = true;
+            if (fd >= 0) {
+                encoder.liftAll();
+                writeFrame();
+            }
+        }
+        next->releaseHeldInput();
+    }
+
+private:
+    bool createDevice() {
+        int width = 32768, height = 32768;  // Device units when the screen size is unknown
+        next->screenSize(width, height);
+
+        bool ok = ioctl(fd, UI_SET_EVBIT, EV_SYN) == 0 && ioctl(fd, UI_SET_EVBIT, EV_KEY) == 0 &&
+                  ioctl(fd, UI_SET_KEYBIT, BTN_TOUCH) == 0 && ioctl(fd, UI_SET_EVBIT, EV_ABS) == 0 &&
+                  ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT) == 0;
+        auto axis = [&](uint16_t code, int32_t maximum) {
+            uinput_abs_setup setup = {};
+            setup.code = code;
+            setup.absinfo.maximum = maximum;
+            return ioctl(fd, UI_SET_ABSBIT, code) == 0 && ioctl(fd, UI_ABS_SETUP, &setup) == 0;
+        };
+        ok = ok && axis(ABS_X, width - 1) && axis(ABS_Y, height - 1) && axis(ABS_MT_SLOT, kMaxTouchContacts - 1) &&
+             axis(ABS_MT_TRACKING_ID, 0xffff) && axis(ABS_MT_POSITION_X, width - 1) && axis(ABS_MT_POSITION_Y, height - 1);
+
+        uinput_setup setup = {};
+        std::strncpy(setup.name, "input_simulator touch", UINPUT_MAX_NAME_SIZE - 1);
+        setup.id.bustype = BUS_VIRTUAL;
+        return ok && ioctl(fd, UI_DEV_SETUP, &setup) == 0 && ioctl(fd, UI_DEV_CREATE) == 0;
+    }
+
+    // Write the encoded frame; the kernel stamps device events itself, the stand-in gets the monotonic time
+    void writeFrame() {
+        std::vector<input_event>& frame = encoder.finish();
+        if (!frame.empty()) {
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            for (input_event& event : frame) {
+                event.input_event_sec = now.tv_sec;
+                event.input_event_usec = now.tv_nsec / 1000;
+            }
+            ssize_t written = write(fd, frame.data(), frame.size() * sizeof(input_event));
+            (void)written;
+        }
+        encoder.clear();
+    }
+
+    InputBackend* next;
+    TouchFrameEncoder encoder;
+
+    // Submit runs on the injection thread, releaseHeldInput on the signal thread
+    std::mutex mutex;
+    int fd = -1;
+    bool device = false;
+    bool aborted = false;
+};
+#endif
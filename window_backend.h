@@ -0,0 +1,616 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chord.h"
+#include "injector.h"
+#include "win32_compat.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <atomic>
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "xtest_backend.h"
+#endif
+
+// Time a backend whose window has gone waits before looking it up again, so a title search does not run every frame
+constexpr auto kWindowRetry = std::chrono::milliseconds(500);
+
+// Window id of a -w value written as a number (0x1e00007 or 31457287); false for a title
+inline bool parseWindowId(const std::string& text, uint64_t& id) {
+    if (text.empty() || text[0] < '0' || text[0] > '9') return false;
+    char* end = nullptr;
+    id = std::strtoull(text.c_str(), &end, 0);
+    return end && *end == '\0' && id != 0;
+}
+
+#ifdef _WIN32
+/**
+ * @brief Posts input to one window as window messages, for -w
+ *
+ * Neither the system cursor nor the keyboard focus moves, so several instances can drive
+ * different windows of one desktop at once. Coordinates are relative to the window's client
+ * area; mouse messages go to the deepest visible child under the point, keys to the child
+ * that has the focus within the window's thread. The window is looked up once, by handle or
+ * title, and again only if it is destroyed. Posted keys do not change the target's keyboard
+ * state, so an application that reads modifiers with GetKeyState does not see them.
+ */
+class WindowMessageBackend : public InputBackend {
+public:
+    // Find the window: a handle such as 0x1A0B2C, the title of a top-level window, or part of one
+    bool attach(const std::string& spec) {
+        std::lock_guard<std::mutex> lock(mutex);
+        target = spec;
+        return resolve();
+    }
+
+    HWND handle() const { return window; }
+
+    // Lookups of the window by handle or title, the first included
+    int lookups() const { return lookupCount; }
+
+    void submit(const InputEvent* events, size_t count) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (aborted || !current()) return;
+
+        for (size_t i = 0; i < count; i++) {
+            const InputEvent& event = events[i];
+            switch (event.type) {
+                case InputEventType::MouseMove:
+                    pointerX = event.x;
+                    pointerY = event.y;
+                    postMouse(WM_MOUSEMOVE, mouseKeys());
+                    break;
+                case InputEventType::MouseDown:
+                case InputEventType::MouseUp: {
+                    static const UINT downMessages[] = {WM_LBUTTONDOWN, WM_RBUTTONDOWN, WM_MBUTTONDOWN};
+                    static const UINT upMessages[] = {WM_LBUTTONUP, WM_RBUTTONUP, WM_MBUTTONUP};
+                    bool down = (event.type == InputEventType::MouseDown);
+                    heldButtons[event.code] = down;
+                    postMouse(down ? downMessages[event.code] : upMessages[event.code], mouseKeys());
+                    break;
+                }
+                case InputEventType::Wheel: {
+                    // Wheel messages carry screen coordinates
+                    POINT point = {pointerX, pointerY};
+                    ClientToScreen(window, &point);
+                    int delta = (event.x != 0) ? event.x : event.y;
+                    PostMessageA(windowAt(pointerX, pointerY).first, (event.x != 0) ? WM_MOUSEHWHEEL : WM_MOUSEWHEEL,
+                                 MAKEWPARAM(mouseKeys(), static_cast<short>(delta)), MAKELPARAM(point.x, point.y));
+                    break;
+                }
+                case InputEventType::KeyDown:
+                case InputEventType::KeyUp:
+                    if (event.code < heldKeys.size()) postKey(event.code, event.type == InputEventType::KeyDown);
+                    break;
+                case InputEventType::TouchDown:
+                case InputEventType::TouchMove:
+                case InputEventType::TouchUp:
+                case InputEventType::Marker:
+                    break;
+            }
+        }
+        if (!IsWindow(window)) lost();
+    }
+
+    // The pointer only this window sees, in client coordinates, starting at (0, 0)
+    bool queryPointer(int& x, int& y) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        x = pointerX;
+        y = pointerY;
+        return true;
+    }
+
+    bool screenSize(int& width, int& height) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        RECT client;
+        if (!window || !GetClientRect(window, &client)) return false;
+        width = client.right - client.left;
+        height = client.bottom - client.top;
+        return true;
+    }
+
+    // Release every key and button that was pressed and not released, and drop all later events
+    void releaseHeldInput() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+        if (!window) return;
+
+        static const UINT upMessages[] = {WM_LBUTTONUP, WM_RBUTTONUP, WM_MBUTTONUP};
+        for (size_t code = 0; code < heldKeys.size(); code++) {
+            if (heldKeys[code]) postKey(static_cast<WORD>(code), false);
+        }
+        for (size_t button = 0; button < heldButtons.size(); button++) {
+            if (!heldButtons[button]) continue;
+            heldButtons[button] = false;
+            postMouse(upMessages[button], mouseKeys());
+        }
+    }
+
+private:
+    struct Search {
+        const std::string* title;
+        HWND exact;
+        HWND partial;
+    };
+
+    // Visible top-level windows in z-order: the topmost exact title wins, else the topmost that contains it
+    static BOOL CALLBACK matchTitle(HWND candidate, LPARAM context) {
+        Search* search = reinterpret_cast<Search*>(context);
+        if (!IsWindowVisible(candidate)) return TRUE;
+        char text[512];
+        int length = GetWindowTextA(candidate, text, sizeof(text));
+        if (length <= 0) return TRUE;
+        std::string title(text, static_cast<size_t>(length));
+        if (title == *search->title) {
+            search->exact = candidate;
+            return FALSE;
+        }
+        if (!search->partial && title.find(*search->title) != std::string::npos) search->partial = candidate;
+        return TRUE;
+    }
+
+    bool resolve() {
+        lookupCount++;
+        retryAt = std::chrono::steady_clock::now() + kWindowRetry;
+        uint64_t id = 0;
+        if (parseWindowId(target, id)) {
+            window = reinterpret_cast<HWND>(static_cast<uintptr_t>(id));
+        }
+        else {
+            Search search = {&target, NULL, NULL};
+            EnumWindows(matchTitle, reinterpret_cast<LPARAM>(&search));
+            window = search.exact ? search.exact : search.partial;
+        }
+        if (window && !IsWindow(window)) window = NULL;
+        return window != NULL;
+    }
+
+    // Whether there is a window to post to, looking it up again a while after it went away
+    bool current() {
+        if (window) return true;
+        if (std::chrono::steady_clock::now() < retryAt) return false;
+        return resolve();
+    }
+
+    // Forget a destroyed window; keys and buttons it held are released with it
+    void lost() {
+        window = NULL;
+        heldKeys.reset();
+        heldButtons.reset();
+    }
+
+    // Deepest enabled, visible child under a client point, with the point in its client coordinates
+    std::pair<HWND, POINT> windowAt(int x, int y) const {
+        HWND child = window;
+        POINT point = {x, y};
+        for (;;) {
+            HWND next = ChildWindowFromPointEx(child, point, CWP_SKIPINVISIBLE | CWP_SKIPDISABLED | CWP_SKIPTRANSPARENT);
+            if (!next || next == child) return {child, point};
+            MapWindowPoints(child, next, &point, 1);
+            child = next;
+        }
+    }
+
+    void postMouse(UINT message, WPARAM keys) {
+        auto [child, point] = windowAt(pointerX, pointerY);
+        PostMessageA(child, message, keys, MAKELPARAM(point.x, point.y));
+    }
+
+    // Buttons and modifiers held, as mouse messages report them
+    WPARAM mouseKeys() const {
+        WPARAM keys = 0;
+        if (heldButtons[0]) keys |= MK_LBUTTON;
+        if (heldButtons[1]) keys |= MK_RBUTTON;
+        if (heldButtons[2]) keys |= MK_MBUTTON;
+        if (heldKeys[VK_SHIFT]) keys |= MK_SHIFT;
+        if (heldKeys[VK_CONTROL]) keys |= MK_CONTROL;
+        return keys;
+    }
+
+    // Keys go to the child focused within the window's thread, as the real keyboard's would
+    void postKey(WORD code, bool down) {
+        heldKeys[code] = down;
+        HWND receiver = window;
+        GUITHREADINFO info = {};
+        info.cbSize = sizeof(info);
+        if (GetGUIThreadInfo(GetWindowThreadProcessId(window, NULL), &info) && info.hwndFocus &&
+            (info.hwndFocus == window || IsChild(window, info.hwndFocus)))
+            receiver = info.hwndFocus;
+
+        // Repeat count 1 and the scan code; a release also sets the previous state and transition bits
+        LPARAM flags = 1 | (static_cast<LPARAM>(MapVirtualKeyA(code, MAPVK_VK_TO_VSC)) << 16);
+        if (heldKeys[VK_MENU]) flags |= LPARAM(1) << 29;
+        if (!down) flags |= (LPARAM(1) << 30) | (LPARAM(1) << 31);
+        bool system = heldKeys[VK_MENU] || code == VK_MENU;
+        UINT message = down ? (system ? WM_SYSKEYDOWN : WM_KEYDOWN) : (system ? WM_SYSKEYUP : WM_KEYUP);
+        PostMessageA(receiver, message, code, flags);
+    }
+
+    std::string target;
+    HWND window = NULL;
+    int lookupCount = 0;
+    std::chrono::steady_clock::time_point retryAt;
+
+    // Submit runs on the injection thread, queryPointer on the executor and releaseHeldInput on a control handler thread
+    std::mutex mutex;
+    bool aborted = false;
+    int pointerX = 0;
+    int pointerY = 0;
+    KeyState heldKeys;
+    std::bitset<3> heldButtons;
+};
+#else
+// BadWindow errors seen so far. A window can be destroyed between any two requests that name
+// it, and Xlib's default handler would exit; a backend that sees the count change checks its window.
+inline std::atomic<uint64_t> xWindowErrors{0};
+inline XErrorHandler previousXErrorHandler = nullptr;
+
+inline int countBadWindow(Display* display, XErrorEvent* error) {
+    if (error->error_code == BadWindow) {
+        xWindowErrors.fetch_add(1);
+        return 0;
+    }
+    return previousXErrorHandler ? previousXErrorHandler(display, error) : 0;
+}
+
+/**
+ * @brief Sends input to one X window with XSendEvent, for -w
+ *
+ * The pointer and the input focus stay where they are, so several instances, or several
+ * targets of one, can drive different windows of one display at once. Coordinates are
+ * relative to the window. Events carry the modifier and button state this backend holds,
+ * and go to the window itself, as toolkits that draw their own widgets expect; clients
+ * that reject synthetic events (the send_event flag) ignore them.
+ *
+ * The window is looked up once, by id or title, and its position and size are kept up to
+ * date from the ConfigureNotify events it sends this connection, so a batch costs no round
+ * trip. It is looked up again only after it has been destroyed.
+ */
+class XWindowBackend : public InputBackend {
+public:
+    ~XWindowBackend() { disconnect(); }
+
+    // Connect to the named display, or $DISPLAY when null
+    bool connect(const char* displayName = nullptr) {
+        if (display) return true;
+        XInitThreads();
+        static std::once_flag handlerOnce;
+        std::call_once(handlerOnce, [] { previousXErrorHandler = XSetErrorHandler(countBadWindow); });
+
+        display = XOpenDisplay(displayName);
+        if (!display) return false;
+        root = DefaultRootWindow(display);
+        netWmName = XInternAtom(display, "_NET_WM_NAME", False);
+        utf8String = XInternAtom(display, "UTF8_STRING", False);
+        keycodes.fill(0);
+        for (const auto& [virtualKey, keysym] : kVirtualKeySyms) {
+            keycodes[virtualKey] = XKeysymToKeycode(display, keysym);
+        }
+        return true;
+    }
+
+    void disconnect() {
+        if (!display) return;
+        XCloseDisplay(display);
+        display = nullptr;
+    }
+
+    // Find the window: an id such as 0x1e00007, a title, or part of one
+    bool attach(const std::string& spec) {
+        std::lock_guard<std::mutex> lock(mutex);
+        target = spec;
+        return display && resolve();
+    }
+
+    Window handle() const { return window; }
+
+    // Lookups of the window by id or title, the first included
+    int lookups() const { return lookupCount; }
+
+    void submit(const InputEvent* events, size_t count) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!display || aborted || !current()) return;
+
+        for (size_t i = 0; i < count; i++) {
+            const InputEvent& event = events[i];
+            switch (event.type) {
+                case InputEventType::MouseMove:
+                    pointerX = event.x;
+                    pointerY = event.y;
+                    sendMotion();
+                    break;
+                case InputEventType::MouseDown:
+                case InputEventType::MouseUp: {
+                    static const unsigned int buttons[] = {Button1, Button3, Button2};
+                    bool down = (event.type == InputEventType::MouseDown);
+                    sendButton(buttons[event.code], down);
+                    heldButtons[event.code] = down;
+                    break;
+                }
+                case InputEventType::Wheel: {
+                    // Presses and releases of buttons 4-7, with sub-notch deltas added up as XTestBackend does
+                    bool horizontal = (event.x != 0);
+                    int& remainder = horizontal ? wheelRemainderX : wheelRemainderY;
+                    remainder += horizontal ? event.x : event.y;
+                    int notches = remainder / WHEEL_DELTA;
+                    remainder -= notches * WHEEL_DELTA;
+                    unsigned int button = horizontal ? (notches > 0 ? 7 : 6) : (notches > 0 ? 4 : 5);
+                    for (int n = 0; n < std::abs(notches); n++) {
+                        sendButton(button, true);
+                        sendButton(button, false);
+                    }
+                    break;
+                }
+                case InputEventType::KeyDown:
+                case InputEventType::KeyUp: {
+                    if (event.code >= keycodes.size() || keycodes[event.code] == 0) break;
+                    bool down = (event.type == InputEventType::KeyDown);
+                    sendKey(keycodes[event.code], down);
+                    heldKeys[event.code] = down;
+                    break;
+                }
+                case InputEventType::TouchDown:
+                case InputEventType::TouchMove:
+                case InputEventType::TouchUp:
+                case InputEventType::Marker:
+                    break;
+            }
+        }
+        XFlush(display);
+    }
+
+    // The pointer only this window sees, relative to it, starting at (0, 0)
+    bool queryPointer(int& x, int& y) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        x = pointerX;
+        y = pointerY;
+        return true;
+    }
+
+    bool screenSize(int& width, int& height) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!window) return false;
+        width = windowWidth;
+        height = windowHeight;
+        return true;
+    }
+
+    // Release every key and button that was pressed and not released, and drop all later events
+    void releaseHeldInput() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+        if (!display || !window) return;
+
+        static const unsigned int buttons[] = {Button1, Button3, Button2};
+        for (size_t code = 0; code < heldKeys.size(); code++) {
+            if (!heldKeys[code]) continue;
+            sendKey(keycodes[code], false);
+            heldKeys[code] = false;
+        }
+        for (size_t button = 0; button < heldButtons.size(); button++) {
+            if (!heldButtons[button]) continue;
+            sendButton(buttons[button], false);
+            heldButtons[button] = false;
+        }
+        XSync(display, False);
+    }
+
+private:
+    bool resolve() {
+        lookupCount++;
+        retryAt = std::chrono::steady_clock::now() + kWindowRetry;
+        seenErrors = xWindowErrors.load();
+
+        uint64_t id = 0;
+        Window found = parseWindowId(target, id) ? static_cast<Window>(id) : findByTitle(target);
+        XWindowAttributes attributes;
+        if (!found || !XGetWindowAttributes(display, found, &attributes)) {
+            window = 0;
+            return false;
+        }
+        window = found;
+        windowWidth = attributes.width;
+        windowHeight = attributes.height;
+        originKnown = false;
+        // Moves, resizes and the window's end arrive as events on this connection
+        XSelectInput(display, window, StructureNotifyMask);
+        return true;
+    }
+
+    // Whether there is a window to send to, with its root position known; no round trip unless something changed
+    bool current() {
+        while (window && XPending(display)) {
+            XEvent event;
+            XNextEvent(display, &event);
+            if (event.type == DestroyNotify && event.xdestroywindow.window == window) {
+                lost();
+            }
+            else if (event.type == ConfigureNotify && event.xconfigure.window == window) {
+                windowWidth = event.xconfigure.width;
+                windowHeight = event.xconfigure.height;
+                originKnown = false;
+            }
+            else if (event.type == ReparentNotify && event.xreparent.window == window) {
+                originKnown = false;
+            }
+        }
+        if (window && xWindowErrors.load() != seenErrors) {
+            seenErrors = xWindowErrors.load();
+            XWindowAttributes attributes;
+            if (!XGetWindowAttributes(display, window, &attributes)) lost();
+        }
+        if (!window && (std::chrono::steady_clock::now() < retryAt || !resolve())) return false;
+
+        if (!originKnown) {
+            Window child;
+            originKnown = XTranslateCoordinates(display, window, root, 0, 0, &originX, &originY, &child);
+        }
+        return true;
+    }
+
+    // Forget a destroyed window; keys and buttons it held are released with it
+    void lost() {
+        window = 0;
+        heldKeys.reset();
+        heldButtons.reset();
+    }
+
+    // Depth first from the root in stacking order: the topmost exact title wins, else the topmost that contains it
+    Window findByTitle(const std::string& wanted) {
+        Window partial = 0;
+        std::vector<Window> pending = {root};
+        while (!pending.empty()) {
+            Window candidate = pending.back();
+            pending.pop_back();
+            std::string title = windowTitle(candidate);
+            if (!title.empty()) {
+                if (title == wanted) return candidate;
+                if (!partial && title.find(wanted) != std::string::npos) partial = candidate;
+            }
+
+            Window rootReturn, parent;
+            Window* children = nullptr;
+            unsigned int childCount = 0;
+            if (XQueryTree(display, candidate, &rootReturn, &parent, &children, &childCount)) {
+                // Children come bottom to top; the last pushed is searched first
+                pending.insert(pending.end(), children, children + childCount);
+                if (children) XFree(children);
+            }
+        }
+        return partial;
+    }
+
+    // _NET_WM_NAME in UTF-8, or WM_NAME for clients that set only that
+    std::string windowTitle(Window candidate) {
+        std::string title;
+        Atom type;
+        int format;
+        unsigned long items, remaining;
+        unsigned char* data = nullptr;
+        if (XGetWindowProperty(display, candidate, netWmName, 0, 1024, False, utf8String, &type, &format, &items, &remaining, &data) == Success &&
+            data) {
+            if (type == utf8String && format == 8) title.assign(reinterpret_cast<char*>(data), items);
+            XFree(data);
+        }
+        if (!title.empty()) return title;
+
+        char* name = nullptr;
+        if (XFetchName(display, candidate, &name) && name) {
+            title = name;
+            XFree(name);
+        }
+        return title;
+    }
+
+    // Modifiers and buttons held before the event, as core events report them
+    unsigned int state() const {
+        unsigned int mask = 0;
+        if (heldKeys[VK_SHIFT]) mask |= ShiftMask;
+        if (heldKeys[VK_CONTROL]) mask |= ControlMask;
+        if (heldKeys[VK_MENU]) mask |= Mod1Mask;
+        if (heldKeys[VK_LWIN]) mask |= Mod4Mask;
+        if (heldButtons[0]) mask |= Button1Mask;
+        if (heldButtons[1]) mask |= Button3Mask;
+        if (heldButtons[2]) mask |= Button2Mask;
+        return mask;
+    }
+
+    void sendMotion() {
+        XEvent event = {};
+        XMotionEvent& motion = event.xmotion;
+        motion.type = MotionNotify;
+        motion.display = display;
+        motion.window = window;
+        motion.root = root;
+        motion.time = CurrentTime;
+        motion.x = pointerX;
+        motion.y = pointerY;
+        motion.x_root = originX + pointerX;
+        motion.y_root = originY + pointerY;
+        motion.state = state();
+        motion.is_hint = NotifyNormal;
+        motion.same_screen = True;
+        long mask = PointerMotionMask;
+        if (heldButtons.any()) mask |= ButtonMotionMask | (heldButtons[0] ? Button1MotionMask : 0) | (heldButtons[1] ? Button3MotionMask : 0) |
+                                       (heldButtons[2] ? Button2MotionMask : 0);
+        XSendEvent(display, window, True, mask, &event);
+    }
+
+    void sendButton(unsigned int button, bool down) {
+        XEvent event = {};
+        XButtonEvent& press = event.xbutton;
+        press.type = down ? ButtonPress : ButtonRelease;
+        press.display = display;
+        press.window = window;
+        press.root = root;
+        press.time = CurrentTime;
+        press.x = pointerX;
+        press.y = pointerY;
+        press.x_root = originX + pointerX;
+        press.y_root = originY + pointerY;
+        press.state = state();
+        press.button = button;
+        press.same_screen = True;
+        XSendEvent(display, window, True, down ? ButtonPressMask : ButtonReleaseMask, &event);
+    }
+
+    void sendKey(KeyCode keycode, bool down) {
+        XEvent event = {};
+        XKeyEvent& key = event.xkey;
+        key.type = down ? KeyPress : KeyRelease;
+        key.display = display;
+        key.window = window;
+        key.root = root;
+        key.time = CurrentTime;
+        key.x = pointerX;
+        key.y = pointerY;
+        key.x_root = originX + pointerX;
+        key.y_root = originY + pointerY;
+        key.state = state();
+        key.keycode = keycode;
+        key.same_screen = True;
+        XSendEvent(display, window, True, down ? KeyPressMask : KeyReleaseMask, &event);
+    }
+
+    Display* display = nullptr;
+    Window root = 0;
+    Atom netWmName = None;
+    Atom utf8String = None;
+    std::array<KeyCode, 256> keycodes{};
+
+    std::string target;
+    Window window = 0;
+    int lookupCount = 0;
+    uint64_t seenErrors = 0;
+    std::chrono::steady_clock::time_point retryAt;
+    int windowWidth = 0;
+    int windowHeight = 0;
+    bool originKnown = false;
+    int originX = 0;  // Position of the window on the root, for the root coordinates of events
+    int originY = 0;
+
+    // Submit runs on the injection thread, queryPointer on the executor and releaseHeldInput on the signal thread
+    std::mutex mutex;
+    bool aborted = false;
+    int pointerX = 0;
+    int pointerY = 0;
+    KeyState heldKeys;
+    std::bitset<3> heldButtons;
+    int wheelRemainderX = 0;
+    int wheelRemainderY = 0;
+};
+#endif
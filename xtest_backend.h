@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <poll.h>
+
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+#include "chord.h"
+#include "injector.h"
+#include "probe.h"
+#include "win32_compat.h"
+
+// X keysym for each virtual key code the simulator knows
+inline const std::pair<uint16_t, KeySym> kVirtualKeySyms[] = {
+    {VK_F1, XK_F1}, {VK_F2, XK_F2}, {VK_F3, XK_F3}, {VK_F4, XK_F4},
+    {VK_F5, XK_F5}, {VK_F6, XK_F6}, {VK_F7, XK_F7}, {VK_F8, XK_F8},
+    {VK_F9, XK_F9}, {VK_F10, XK_F10}, {VK_F11, XK_F11}, {VK_F12, XK_F12},
+
+    {VK_CONTROL, XK_Control_L}, {VK_SHIFT, XK_Shift_L}, {VK_MENU, XK_Alt_L}, {VK_LWIN, XK_Super_L},
+    {VK_ESCAPE, XK_Escape}, {VK_RETURN, XK_Return}, {VK_SPACE, XK_space}, {VK_TAB, XK_Tab},
+    {VK_BACK, XK_BackSpace}, {VK_DELETE, XK_Delete}, {VK_INSERT, XK_Insert},
+
+    {VK_HOME, XK_Home}, {VK_END, XK_End}, {VK_PRIOR, XK_Prior}, {VK_NEXT, XK_Next},
+    {VK_LEFT, XK_Left}, {VK_RIGHT, XK_Right}, {VK_UP, XK_Up}, {VK_DOWN, XK_Down},
+
+    {'A', XK_a}, {'B', XK_b}, {'C', XK_c}, {'D', XK_d}, {'E', XK_e}, {'F', XK_f}, {'G', XK_g},
+    {'H', XK_h}, {'I', XK_i}, {'J', XK_j}, {'K', XK_k}, {'L', XK_l}, {'M', XK_m}, {'N', XK_n},
+    {'O', XK_o}, {'P', XK_p}, {'Q', XK_q}, {'R', XK_r}, {'S', XK_s}, {'T', XK_t}, {'U', XK_u},
+    {'V', XK_v}, {'W', XK_w}, {'X', XK_x}, {'Y', XK_y}, {'Z', XK_z},
+    {'0', XK_0}, {'1', XK_1}, {'2', XK_2}, {'3', XK_3}, {'4', XK_4},
+    {'5', XK_5}, {'6', XK_6}, {'7', XK_7}, {'8', XK_8}, {'9', XK_9},
+
+    // US layout keys, named after their unshifted symbol
+    {VK_OEM_MINUS, XK_minus}, {VK_OEM_PLUS, XK_equal}, {VK_OEM_COMMA, XK_comma}, {VK_OEM_PERIOD, XK_period},
+    {VK_OEM_1, XK_semicolon}, {VK_OEM_2, XK_slash}, {VK_OEM_3, XK_grave}, {VK_OEM_4, XK_bracketleft},
+    {VK_OEM_5, XK_backslash}, {VK_OEM_6, XK_bracketright}, {VK_OEM_7, XK_apostrophe},
+};
+
+/**
+ * @brief Injects event batches into an X server with the XTest extension
+ *
+ * Fake input requests only go into Xlib's output buffer, so a whole batch (one
+ * smooth movement frame, one chord) costs a single XFlush instead of a round trip
+ * per event. Virtual key codes are translated to keycodes with a table resolved once
+ * when connecting.
+ */
+class XTestBackend : public InputBackend {
+public:
+    ~XTestBackend() { disconnect(); }
+
+    // Connect to the named display, or $DISPLAY when null
+    bool connect(const char* displayName = nullptr) {
+        if (display) return true;
+
+        // The display is shared by the injection thread, cursor queries and the abort handler
+        XInitThreads();
+        display = XOpenDisplay(displayName);
+        if (!display) return false;
+
+        int eventBase, errorBase, major, minor;
+        if (!XTestQueryExtension(display, &eventBase, &errorBase, &major, &minor)) {
+            disconnect();
+            return false;
+        }
+
+        keycodes.fill(0);
+        unmapped = 0;
+        for (const auto& [virtualKey, keysym] : kVirtualKeySyms) {
+            keycodes[virtualKey] = XKeysymToKeycode(display, keysym);
+            if (keycodes[virtualKey] == 0) unmapped++;
+        }
+        return true;
+    }
+
+    void disconnect() {
+        if (!display) return;
+        {
+            // Half a notch or more that the script scrolled but never completed comes out as one last notch
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!aborted) {
+                sendNotches(true, roundedNotches(wheelRemainderX));
+                sendNotches(false, roundedNotches(wheelRemainderY));
+            }
+            wheelRemainderX = wheelRemainderY = 0;
+        }
+        XCloseDisplay(display);
+        display = nullptr;
+    }
+
+    Display* connection() const { return display; }
+
+    // Known keys the server's keymap has no keycode for; their events are dropped
+    int unmappedKeys() const { return unmapped; }
+
+    void submit(const InputEvent* events, size_t count) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!display || aborted) return;
+
+        for (size_t i = 0; i < count; i++) {
+            const InputEvent& event = events[i];
+            switch (event.type) {
+                case InputEventType::MouseMove:
+                    XTestFakeMotionEvent(display, -1, event.x, event.y, CurrentTime);
+                    break;
+                case InputEventType::MouseDown:
+                case InputEventType::MouseUp: {
+                    static const unsigned int buttons[] = {Button1, Button3, Button2};
+                    bool down = (event.type == InputEventType::MouseDown);
+                    XTestFakeButtonEvent(display, buttons[event.code], down, CurrentTime);
+                    heldButtons[event.code] = down;
+                    break;
+                }
+                case InputEventType::Wheel: {
+                    // Each notch is a press and release of buttons 4/5 (vertical) or 6/7 (horizontal).
+                    // Core events have no finer steps, so sub-notch deltas add up until they make one.
+                    bool horizontal = (event.x != 0);
+                    int& remainder = horizontal ? wheelRemainderX : wheelRemainderY;
+                    remainder += horizontal ? event.x : event.y;
+                    int notches = remainder / WHEEL_DELTA;
+                    remainder -= notches * WHEEL_DELTA;
+                    sendNotches(horizontal, notches);
+                    break;
+                }
+                case InputEventType::KeyDown:
+                case InputEventType::KeyUp: {
+                    if (event.code >= keycodes.size() || keycodes[event.code] == 0) break;
+                    bool down = (event.type == InputEventType::KeyDown);
+                    XTestFakeKeyEvent(display, keycodes[event.code], down, CurrentTime);
+                    heldKeys[event.code] = down;
+                    break;
+                }
+                case InputEventType::TouchDown:
+                case InputEventType::TouchMove:
+                case InputEventType::TouchUp:
+                case InputEventType::Marker:
+                    break;
+            }
+        }
+        XFlush(display);
+    }
+
+    bool screenSize(int& width, int& height) override {
+        if (!display) return false;
+        width = DisplayWidth(display, DefaultScreen(display));
+        height = DisplayHeight(display, DefaultScreen(display));
+        return true;
+    }
+
+    bool queryPointer(int& x, int& y) override {
+        if (!display) return false;
+        Window root, child;
+        int windowX, windowY;
+        unsigned int mask;
+        return XQueryPointer(display, DefaultRootWindow(display), &root, &child, &x, &y, &windowX, &windowY, &mask);
+    }
+
+    // Release every key and button that was pressed and not released, and drop all later events
+    void releaseHeldInput() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+        if (!display) return;
+
+        static const unsigned int buttons[] = {Button1, Button3, Button2};
+        for (size_t code = 0; code < heldKeys.size(); code++) {
+            if (heldKeys[code]) XTestFakeKeyEvent(display, keycodes[code], False, CurrentTime);
+        }
+        for (size_t button = 0; button < heldButtons.size(); button++) {
+            if (heldButtons[button]) XTestFakeButtonEvent(display, buttons[button], False, CurrentTime);
+        }
+        XSync(display, False);
+        heldKeys.reset();
+        heldButtons.reset();
+    }
+
+private:
+    // Press and release the wheel button once per notch; positive is up or right
+    void sendNotches(bool horizontal, int notches) {
+        unsigned int button = horizontal ? (notches > 0 ? 7 : 6) : (notches > 0 ? 4 : 5);
+        for (int n = 0; n < std::abs(notches); n++) {
+            XTestFakeButtonEvent(display, button, True, CurrentTime);
+            XTestFakeButtonEvent(display, button, False, CurrentTime);
+        }
+    }
+
+    // A remainder rounded to the nearest whole notch, -1, 0 or 1
+    static int roundedNotches(int remainder) {
+        if (remainder >= WHEEL_DELTA / 2) return 1;
+        if (remainder <= -WHEEL_DELTA / 2) return -1;
+        return 0;
+    }
+
+    Display* display = nullptr;
+    std::array<KeyCode, 256> keycodes{};
+    int unmapped = 0;
+
+    std::mutex mutex;
+    bool aborted = false;
+    KeyState heldKeys;
+    std::bitset<3> heldButtons;
+    int wheelRemainderX = 0;  // Scrolled but not yet sent, in WHEEL_DELTA units
+    int wheelRemainderY = 0;
+};
+
+/**
+ * @brief Receives latency probe clicks in a small window over the probe square
+ *
+ * The window is override-redirect, so no window manager delays or decorates it, and it
+ * is read on its own connection and thread, like any other client of the server.
+ */
+class XProbeListener {
+public:
+    ~XProbeListener() { stop(); }
+
+    bool start(LatencyProbe& probe, const char* displayName = nullptr) {
+        display = XOpenDisplay(displayName);
+        if (!display) return false;
+
+        XSetWindowAttributes attributes = {};
+        attributes.override_redirect = True;
+        attributes.event_mask = ButtonPressMask | StructureNotifyMask;
+        window = XCreateWindow(display, DefaultRootWindow(display), probe.x(0), probe.y(0), kProbeGrid, kProbeGrid, 0,
+                               CopyFromParent, InputOutput, CopyFromParent, CWOverrideRedirect | CWEventMask, &attributes);
+        XMapRaised(display, window);
+        XEvent event;
+        do {
+            XNextEvent(display, &event);
+        } while (event.type != MapNotify);
+
+        running = true;
+        listener = std::thread([this, &probe] { run(probe); });
+        return true;
+    }
+
+    void stop() {
+        running = false;
+        if (listener.joinable()) listener.join();
+        if (display) XCloseDisplay(display);
+        display = nullptr;
+    }
+
+private:
+    void run(LatencyProbe& probe) {
+        pollfd request = {ConnectionNumber(display), POLLIN, 0};
+        while (running) {
+            if (!XPending(display)) {
+                poll(&request, 1, 20);
+                continue;
+            }
+            XEvent event;
+            XNextEvent(display, &event);
+            if (event.type == ButtonPress && event.xbutton.button == Button1) {
+                probe.deliver(ProbeStage::Window, event.xbutton.x_root, event.xbutton.y_root, InjectClock::now());
+            }
+        }
+    }
+
+    Display* display = nullptr;
+    Window window = 0;
+    std::thread listener;
+    std::atomic<bool> running{false};
+};